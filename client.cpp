@@ -10,6 +10,7 @@
 #include <thread_pool.hpp>
 #include <xmit_order.hpp>
 #include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
 #include <client.hpp>
 #include <tracer.hpp>
 
@@ -23,9 +24,11 @@ namespace trading {
   init(const std::string& host,
        const size_t port,
        const size_t nsenders,
-       const size_t norders) {
+       const size_t norders,
+       const std::string& shm_path) {
 
     host_ = host;
+    shm_path_ = shm_path;
     port_ = port;
     nsenders_ = nsenders;
     norders_ = norders;
@@ -54,41 +57,11 @@ namespace trading {
   static const size_t nstocks = sizeof(stocks)/sizeof(std::string);
 
   //###########################################################################
-  /// STRUCT: Trader Info
+  /// Connect
   //###########################################################################
-  struct trader_info_t {
-    trader_info_t(const std::string& name,
-                  const int id) :
-      name_(name),
-      id_(id)
-    {}
-    std::string name_;
-    int         id_;
-  };
-
-  //###########################################################################
-  /// Some fake traders
-  //###########################################################################
-  static const trader_info_t trader_info[] = {
-    trader_info_t("John",  100),
-    trader_info_t("James", 101),
-    trader_info_t("Fred",  102),
-    trader_info_t("Tony",  103),
-    trader_info_t("Mike",  104),
-    trader_info_t("Jim",   105),
-    trader_info_t("Dave",  106),
-    trader_info_t("Andy",  107),
-    trader_info_t("Dan",   108),
-    trader_info_t("Luke",  109)
-  };
-  static const size_t ntraders = sizeof(trader_info)/sizeof(trader_info_t);
-
-  //###########################################################################
-  /// Sender Thread
-  //###########################################################################
-  void
+  int
   client_t::
-  sender(int trader_id) {
+  connect() {
 
     /// create socket
     int socket = ::socket(AF_INET, SOCK_STREAM, 0);
@@ -98,7 +71,7 @@ namespace trading {
       TRACE_BEGIN << "Failed to create socket, errno: " << errno
                   << std::endl << " strerror: " << strerror(errno)
                   << std::endl; perror("Socket create: "); TRACE_END
-      return;
+      return -1;
     }
     /// access host entry for host name
     struct hostent* srv = gethostbyname(host_.c_str());
@@ -108,7 +81,8 @@ namespace trading {
       TRACE << " strerror: " << strerror(errno) << std::endl;
       perror("gethostbyname:");
       TRACE_END
-      return;
+      ::close(socket);
+      return -1;
     }
     /// fill sockaddr_in structure, use the addr from gethostbyname
     struct sockaddr_in addr;
@@ -118,93 +92,202 @@ namespace trading {
     addr.sin_port = htons(port_);
     
     /// connect to server
-    if (connect(socket, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+    if (::connect(socket, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
       TRACE_BEGIN << "Connect failed, errno: " << errno << std::endl
                   << " strerror: " << strerror(errno) << std::endl;
       perror("gethostbyname:");
       TRACE_END
+      ::close(socket);
+      return -1;
+    }
+    return socket;
+  }
+
+  //###########################################################################
+  /// Sender Thread
+  //###########################################################################
+  void
+  client_t::
+  sender(int trader_id) {
+
+    ////////
+    /// on the server's host the session may run over shared memory, set
+    /// up through the server's Unix socket
+    ////////
+    int socket = -1;
+    shm_channel_ptr channel;
+    if (! shm_path_.empty()) {
+      try {
+        channel = shm_connect(shm_path_, socket);
+      }
+      catch (const std::string& ex) {
+        TRACE_BEGIN << ex << std::endl; TRACE_END
+        return;
+      }
+    }
+    else if ((socket = connect()) == -1) {
       return;
     }
-    /// write trader id post connect
-    char trader_id_buf[8];
-    sprintf(trader_id_buf, "%d", 100);
-    ssize_t n = ::write(socket, &trader_id_buf, sizeof(trader_id_buf));
-    if (n != sizeof(trader_id_buf)) {
-      TRACE_BEGIN << "Send trader id failed, errno: " << errno << std::endl
+    /// log in post connect; the server acks or rejects and closes
+    session_ptr session = boost::make_shared<session_t>(socket, channel);
+    transmission::message_t login;
+    login.type_ = transmission::message_t::login;
+    login.version_ = transmission::max_version;
+    login.trader_id_ = trader_id;
+    if (! send(*session, login)) {
+      TRACE_BEGIN << "Send login failed, errno: " << errno << std::endl
                   << " strerror: " << strerror(errno) << std::endl;
-      perror("gethostbyname:");
       TRACE_END
       return;
     }
     /// start receiver thread
     concurrent::thread_pool_t& pool = concurrent::thread_pool_t::instance();
-    pool.post(boost::bind(&client_t::receiver, this, socket));
+    pool.post(boost::bind(&client_t::receiver, this, session));
 
     size_t stock_ndx = 0;
-    size_t trader_ndx = 0;
     int quantity = 100;
+    int price = 1000;
     int side_ndx = 0;
 
     for (size_t i = 0; i < nbatch_size_; ++i) {
 
-      /// fill transmission order
-      transmission::order_t order;
-
-      strcpy(order.stock_, stocks[stock_ndx].c_str());
-      strcpy(order.trader_, trader_info[trader_ndx].name_.c_str());
-      order.trader_id_ = trader_info[trader_ndx].id_;
+      /// fill transmission order; the stock is NUL padded, as constructed
+      transmission::message_t order;
+      order.type_ = transmission::message_t::new_order;
+      const std::string& stock = stocks[stock_ndx];
+      ::memcpy(order.stock_, stock.data(),
+               std::min(stock.size(), sizeof(order.stock_)));
       order.quantity_ = quantity;
-      order.balance_ = quantity;
       order.side_ = side_ndx;
-
-      TRACE_BEGIN << "sending order: " << order << std::endl; TRACE_END
+      order.price_ = price + static_cast<int>(i % 5) - 2;
 
       /// write to socket which will send data to client
-      ssize_t n = ::write(socket, &order, sizeof(order));
-      if (n != sizeof(order)) {
-        TRACE_BEGIN << "Failed to write order to socket. Bytes written: "
-                    << n << " sizeof(order): 152" << std::endl; TRACE_END
+      if (! send(*session, order)) {
+        TRACE_BEGIN << "Failed to write order to socket, errno: " << errno
+                    << std::endl; TRACE_END
         break;
       }
-      /// move socket, trader and side indices
+      TRACE_BEGIN << "sent order: " << order << std::endl; TRACE_END
+
+      /// move stock and side indices
       stock_ndx = ++stock_ndx % nstocks;
-      trader_ndx = ++trader_ndx % ntraders;
       side_ndx = ++side_ndx % 2;
       quantity += ++quantity % 100;
     }
   }
 
+  //###########################################################################
+  /// Send
+  //###########################################################################
+  bool
+  client_t::
+  send(session_t& session, transmission::message_t& msg) {
+
+    /// number and write under the lock, so numbers go out in order
+    char buf[transmission::max_size];
+    boost::lock_guard<boost::mutex> lock(session.mutex_);
+    msg.sequence_ = ++session.sequence_;
+    size_t n = transmission::encode(msg, buf);
+    if (session.channel_) {
+      shm_write(*session.channel_, session.socket_, buf, n);
+      return true;
+    }
+    return ::write(session.socket_, buf, n) == static_cast<ssize_t>(n);
+  }
+
   //###########################################################################
   /// Receiver Thread
   //###########################################################################
   void
   client_t::
-  receiver(int socket) {
+  receiver(session_ptr session) {
+
+    size_t nresting = 0;
+    std::vector<char> buf(64 * 1024);
+    size_t have = 0;
 
     for (;;) {
 
-      /// read order on socket
-      transmission::order_t order;
-      ssize_t n = ::read(socket, &order, sizeof(order));
-      if (n != sizeof(order)) {
+      /// read what the socket has, then decode every complete message
+      ssize_t n = session->channel_ ?
+        shm_read(*session->channel_, session->socket_, &buf[have],
+                 buf.size() - have) :
+        ::read(session->socket_, &buf[have], buf.size() - have);
+      if (n <= 0) {
         TRACE_BEGIN << "Failed to read response from server. Bytes read: "
-                    << n << " sizeof(order): " << sizeof(order) << std::endl;
+                    << n << std::endl; TRACE_END
+        break;
+      }
+      have += n;
+      size_t framed = 0;
+      transmission::message_t msg;
+      int k;
+      while ((k = transmission::decode(&buf[framed], have - framed, msg)) >
+             0) {
+        framed += k;
+        TRACE_BEGIN << "received update on: " << msg << std::endl;
         TRACE_END
+        if (! request(*session, msg, nresting))
+          return;
+      }
+      if (k < 0) {
+        TRACE_BEGIN << "Bad protocol, malformed message from server"
+                    << std::endl; TRACE_END
         break;
       }
-      TRACE_BEGIN << "received update on: " << order << std::endl; TRACE_END
+      have -= framed;
+      ::memmove(&buf[0], &buf[framed], have);
+    }
+  }
+
+  //###########################################################################
+  /// Request
+  //###########################################################################
+  bool
+  client_t::
+  request(session_t& session,
+          const transmission::message_t& msg,
+          size_t& nresting) {
+
+    ////////
+    /// exercise cancel/replace: of the orders acknowledged as resting,
+    /// cancel every fifth and amend every third down to half its quantity
+    ////////
+    if (msg.type_ != transmission::message_t::ack || msg.balance_ == 0) {
+      return true;
+    }
+    ++nresting;
+    transmission::message_t request;
+    request.order_id_ = msg.order_id_;
+    if (nresting % 5 == 0) {
+      request.type_ = transmission::message_t::cancel;
+    }
+    else if (nresting % 3 == 0) {
+      request.type_ = transmission::message_t::amend;
+      request.quantity_ = msg.quantity_ / 2;
+    }
+    else {
+      return true;
+    }
+    if (! send(session, request)) {
+      TRACE_BEGIN << "Failed to write request to socket, errno: " << errno
+                  << std::endl; TRACE_END
+      return false;
     }
+    TRACE_BEGIN << "sent request: " << request << std::endl; TRACE_END
+    return true;
   }
 }
 
 int main(int argc, const char** argv) {
-  if (argc != 5) {
+  if (argc != 5 && argc != 6) {
     std::cout << "Usage: <" << argv[0] << "> <host> <port> "
-              << "<# of sender threads> <# of sends>" << std::endl;
+              << "<# of sender threads> <# of sends> "
+              << "[<server's shared memory socket>]" << std::endl;
     return -1;
   }
   trading::client_t client;
-  client.init(argv[1], ::atoi(argv[2]), ::atoi(argv[3]), ::atoi(argv[4]));
-  concurrent::thread_pool_t::instance().iosvc().run();
+  client.init(argv[1], ::atoi(argv[2]), ::atoi(argv[3]), ::atoi(argv[4]),
+              argc == 6 ? argv[5] : "");
   concurrent::thread_pool_t::instance().wait();
 }
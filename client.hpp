@@ -3,6 +3,9 @@
 
 #include <string>
 #include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <xmit_order.hpp>
+#include <shm_channel.hpp>
 
 namespace trading {
 
@@ -23,21 +26,55 @@ namespace trading {
     /// @param[in] port         server port
     /// @param[in] senders      number of reader threads
     /// @param[in] nprocessors  number of total orders
+    /// @param[in] shm_path     server's Unix socket for sessions over shared
+    ///                         memory instead of TCP, empty for TCP
     /// @return                 none
     /// @throws                 std::string if any step fails
     //##########################################################################
     void init(const std::string& host,
               const size_t port,
               const size_t nsenders,
-              const size_t norders);
+              const size_t norders,
+              const std::string& shm_path);
   private:
 
+    //##########################################################################
+    /// STRUCT: Session
+    ///
+    /// One logged in connection, shared by its sender and receiver threads;
+    /// the mutex orders their writes and the sequence numbers they carry.
+    /// Over shared memory the messages go through the channel's rings, and
+    /// the socket is the channel's doorbell.
+    //##########################################################################
+    struct session_t {
+      session_t(int socket, const shm_channel_ptr& channel) :
+        socket_(socket), sequence_(0), channel_(channel) {}
+
+      int              socket_;
+      boost::uint32_t  sequence_;  /// last message sequence sent
+      shm_channel_ptr  channel_;   /// NULL on TCP
+      boost::mutex     mutex_;
+    };
+    typedef boost::shared_ptr<session_t> session_ptr;
+
+    //##########################################################################
+    /// Connect
+    ///
+    /// Creates a stream socket and connects it to the server.
+    ///
+    /// @param   none
+    /// @return  connected socket, -1 on failure
+    /// @throws  none
+    //##########################################################################
+    int connect();
+
     //##########################################################################
     /// Sender Thread
     ///
     /// - Creates stream socket.
-    /// - Connects to socket server.
-    /// - Sends client/trader id to server
+    /// - Connects to socket server, or sets up a shared memory session
+    ///   through its Unix socket (see shm_connect()).
+    /// - Logs in with the client/trader id.
     /// - Launches receiver thread.
     /// - Sends nbatch_size_ orders to socket server.
     ///
@@ -47,19 +84,49 @@ namespace trading {
     //##########################################################################
     void sender(int trader_id);
 
+    //##########################################################################
+    /// Send
+    ///
+    /// Numbers the message with the session's next sequence number and
+    /// writes it.
+    ///
+    /// @param[inout] session  session to send on
+    /// @param[inout] msg      message, sequence number set
+    /// @return                false if the write failed
+    /// @throws                none
+    //##########################################################################
+    bool send(session_t& session, transmission::message_t& msg);
+
     //##########################################################################
     /// Receiver Thread
     ///
-    /// - Reads order response from socket server
-    /// - Trades out order response.
+    /// - Reads server messages from the session's socket, or channel.
+    /// - Traces out each message.
+    /// - Sends requests for some of them (see request()).
+    ///
+    /// @param[in] session  session connected to server
+    /// @return             none
+    /// @throws             none
+    //##########################################################################
+    void receiver(session_ptr session);
+
+    //##########################################################################
+    /// Request
+    ///
+    /// Cancels or amends some of the orders acknowledged as resting.
     ///
-    /// @param[in] socket  socket connection to server
-    /// @return            none
-    /// @throws            none
+    /// @param[inout] session   session the message was received on
+    /// @param[in]    msg       server message
+    /// @param[inout] nresting  orders acknowledged as resting so far
+    /// @return                 false if a request could not be sent
+    /// @throws                 none
     //##########################################################################
-    void receiver(int socket);
+    bool request(session_t& session,
+                 const transmission::message_t& msg,
+                 size_t& nresting);
 
     std::string   host_;
+    std::string   shm_path_;     /// empty for TCP
     size_t        port_;
     size_t        nsenders_;
     size_t        norders_;
@@ -1,29 +1,73 @@
 #ifndef __CONNECTION_INFO_HPP__
 #define __CONNECTION_INFO_HPP__
 
+#include <vector>
+#include <boost/cstdint.hpp>
 #include <boost/thread.hpp>
-#include <boost/shared_ptr.hpp>
-#include <boost/weak_ptr.hpp>
 
 namespace trading {
 
+  class shm_channel_t;
+  class order_t;
+
+  ////////
+  /// names a session in the session table: the slot's generation in the
+  /// high 32 bits, the slot index in the low ones; 0 names no session
+  ////////
+  typedef boost::uint64_t session_handle_t;
+
   //############################################################################
   /// STRUCT: Connection Info
   ///
   /// Identifies a socket connection from a client/trader. Contains trader id
-  /// and socket fd; order_t contains a weak ptr to an instance of conn info
-  /// in the conn info table (see socket_server_t). If the client disconnects,
-  /// the conn info entry is removed from the table. The shared_ptr obtained
-  /// from the weak ptr can then be used to check if the connection has been
-  /// closed.
+  /// and socket fd, and for a client on the same host the shared memory
+  /// channel of the session (see shm_channel_t); conn infos live in the
+  /// slots of the session table (see session_table_t) and order_t carries
+  /// the handle of its session. If the client disconnects, the slot is
+  /// closed and the handle no longer finds the conn info, or finds it
+  /// holding another handle.
+  ///
+  /// The session id is unique for the lifetime of the server; journal
+  /// records carry it. The slot of the handle keys the per shard lists of
+  /// the session's resting orders (cancel on disconnect); the disconnect
+  /// requests that cancel them are taken from the order pool at login.
+  ///
+  /// Processor threads append outbound reports to the send buffer, each
+  /// numbered with the session's next outbound sequence number; the reader
+  /// thread serving the connection writes it to the socket. The mutex
+  /// guards the handle, the socket, the sequence number and the send
+  /// buffer state.
   //############################################################################
   struct conn_info_t {
-    int           trader_id_;
-    int           socket_;
-    boost::mutex  mutex_; 
+
+    /// a client further behind than this is disconnected
+    enum { max_send_buffer = 16 << 20 };
+
+    conn_info_t() :
+      handle_(0),
+      trader_id_(0),
+      socket_(-1),
+      channel_(NULL),
+      session_id_(0),
+      reader_(0),
+      sequence_(0),
+      pending_(false),
+      overflow_(false) {}
+
+    session_handle_t   handle_;       /// 0 while the slot is free
+    int                trader_id_;
+    int                socket_;       /// -1 once closed
+    shm_channel_t*     channel_;      /// NULL on TCP, reader thread only
+    std::vector<order_t*>  disconnects_;  /// a request per shard, taken at
+                                          /// login, reader thread only
+    boost::uint64_t    session_id_;
+    size_t             reader_;       /// reader thread serving the socket
+    boost::uint32_t    sequence_;     /// last message sequence sent
+    std::vector<char>  send_buffer_;  /// reports not yet written
+    bool               pending_;      /// queued for its reader to flush
+    bool               overflow_;     /// send buffer exceeded the limit
+    boost::mutex       mutex_;
   };
-  typedef boost::shared_ptr<conn_info_t> conn_info_ptr;
-  typedef boost::weak_ptr<conn_info_t>   conn_info_wptr;
 
 }
 
@@ -0,0 +1,343 @@
+#include <journal.hpp>
+#include <tracer.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+namespace trading {
+
+  static const char      journal_magic[8] = "OBJRNL1";
+  static const unsigned  journal_version = 2;
+
+  //###########################################################################
+  /// Now (microseconds, monotonic)
+  //###########################################################################
+  static boost::uint64_t now_micros() {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+  }
+
+  //###########################################################################
+  /// Constructor (journal_t)
+  //###########################################################################
+  journal_t::
+  journal_t(const std::string& dir,
+            size_t nshards,
+            size_t price_levels,
+            size_t pool_size,
+            size_t segment_size,
+            size_t sync_messages,
+            size_t sync_micros,
+            size_t capacity) :
+    dir_(dir),
+    nshards_(nshards),
+    price_levels_(price_levels),
+    pool_size_(pool_size),
+    sync_messages_(sync_messages),
+    sync_micros_(sync_micros),
+    queue_(capacity),
+    stop_(false),
+    stopped_(false),
+    segment_(0),
+    fd_(-1),
+    base_(NULL),
+    offset_(0),
+    synced_(0),
+    written_(0),
+    syncs_(0) {
+
+    /// whole pages, at least one
+    size_t page = ::sysconf(_SC_PAGESIZE);
+    segment_size_ = (segment_size + page - 1) / page * page;
+    if (segment_size_ == 0) {
+      segment_size_ = page;
+    }
+    ////////
+    /// continue after the highest existing segment; earlier segments are
+    /// left for recovery
+    ////////
+    std::vector<unsigned> segments;
+    list(dir_, segments);
+    if (! segments.empty()) {
+      segment_ = segments.back();
+    }
+    open_segment();
+  }
+
+  //###########################################################################
+  /// Destructor (journal_t)
+  //###########################################################################
+  journal_t::
+  ~journal_t() {
+    try {
+      close_segment(false);
+    }
+    catch (const std::string&) {
+    }
+  }
+
+  //###########################################################################
+  /// Append (journal_t)
+  //###########################################################################
+  void
+  journal_t::
+  append(const journal_record_t& record) {
+
+    while (! queue_.try_push(record)) {
+      if (stopped_.load(boost::memory_order_acquire))
+        return;
+      boost::this_thread::yield();
+    }
+  }
+
+  //###########################################################################
+  /// Run (journal_t)
+  //###########################################################################
+  void
+  journal_t::
+  run() {
+
+    ////////
+    /// stopped also on failure, so neither appends nor shutdown wait on
+    /// a journal thread that is gone
+    ////////
+    try {
+      write();
+    }
+    catch (...) {
+      stopped_.store(true, boost::memory_order_release);
+      throw;
+    }
+    stopped_.store(true, boost::memory_order_release);
+  }
+
+  //###########################################################################
+  /// Write (journal_t)
+  //###########################################################################
+  void
+  journal_t::
+  write() {
+
+    const bool durable = sync_messages_ || sync_micros_;
+    journal_record_t record;
+    size_t pending = 0;
+    boost::uint64_t oldest = 0;
+
+    for (;;) {
+
+      /// write everything queued, committing every sync_messages_ records
+      size_t n = 0;
+      while (queue_.try_pop(record)) {
+        if (offset_ + sizeof(record) > segment_size_) {
+          close_segment(durable);
+          open_segment();
+        }
+        ::memcpy(base_ + offset_, &record, sizeof(record));
+        offset_ += sizeof(record);
+        ++n;
+        if (pending++ == 0) {
+          oldest = now_micros();
+        }
+        if (sync_messages_ && pending >= sync_messages_) {
+          sync();
+          pending = 0;
+        }
+        /// look at the clock now and then while draining a long backlog
+        else if (sync_micros_ && (pending & 255) == 0 &&
+                 now_micros() - oldest >= sync_micros_) {
+          sync();
+          pending = 0;
+        }
+      }
+      written_.fetch_add(n, boost::memory_order_relaxed);
+
+      /// commit once the oldest pending record is due
+      if (pending && sync_micros_ && now_micros() - oldest >= sync_micros_) {
+        sync();
+        pending = 0;
+      }
+      if (n == 0) {
+        if (stop_.load(boost::memory_order_acquire)) {
+          break;
+        }
+        boost::this_thread::sleep(boost::posix_time::microseconds(20));
+      }
+    }
+    if (pending && durable) {
+      sync();
+    }
+  }
+
+  //###########################################################################
+  /// List (journal_t)
+  //###########################################################################
+  void
+  journal_t::
+  list(const std::string& dir,
+       std::vector<unsigned>& segments) {
+
+    DIR* d = ::opendir(dir.c_str());
+    if (! d) {
+      throw "Failed to open journal directory: " + dir;
+    }
+    while (struct dirent* e = ::readdir(d)) {
+      unsigned n;
+      if (::sscanf(e->d_name, "journal.%u", &n) == 1) {
+        segments.push_back(n);
+      }
+    }
+    ::closedir(d);
+    std::sort(segments.begin(), segments.end());
+  }
+
+  //###########################################################################
+  /// Read (journal_t)
+  //###########################################################################
+  journal_header_t
+  journal_t::
+  read(const std::string& dir,
+       unsigned from,
+       std::vector<journal_record_t>& records) {
+
+    std::vector<unsigned> segments;
+    list(dir, segments);
+    journal_header_t written;
+    ::memset(&written, 0, sizeof(written));
+
+    for (size_t i = 0; i < segments.size(); ++i) {
+      if (segments[i] < from)
+        continue;
+
+      char name[32];
+      ::snprintf(name, sizeof(name), "journal.%06u", segments[i]);
+      std::string path = dir + "/" + name;
+      FILE* f = ::fopen(path.c_str(), "rb");
+      if (! f) {
+        throw "Failed to open journal segment: " + path;
+      }
+      journal_header_t header;
+      if (::fread(&header, sizeof(header), 1, f) != 1 ||
+          ::memcmp(header.magic_, journal_magic, sizeof(journal_magic)) ||
+          header.version_ != journal_version) {
+        ::fclose(f);
+        throw "Not a journal segment: " + path;
+      }
+      /// a zero sequence is the unwritten, preallocated rest of the segment
+      size_t size = records.size();
+      journal_record_t record;
+      while (::fread(&record, sizeof(record), 1, f) == 1 &&
+             record.sequence_ != 0) {
+        records.push_back(record);
+      }
+      ::fclose(f);
+
+      if (records.size() == size)
+        continue;
+      if (written.nshards_ && (written.nshards_ != header.nshards_ ||
+                               written.price_levels_ != header.price_levels_ ||
+                               written.pool_size_ != header.pool_size_)) {
+        throw "Journal segment was written with a different configuration: "
+          + path;
+      }
+      written = header;
+    }
+    return written;
+  }
+
+  //###########################################################################
+  /// Open Segment (journal_t)
+  //###########################################################################
+  void
+  journal_t::
+  open_segment() {
+
+    char name[32];
+    ::snprintf(name, sizeof(name), "journal.%06u", segment_ + 1);
+    std::string path = dir_ + "/" + name;
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd_ == -1) {
+      throw "Failed to create journal segment: " + path + ": " +
+        ::strerror(errno);
+    }
+    /// reserve the blocks now so appends never hit ENOSPC through a fault
+    int rc = ::posix_fallocate(fd_, 0, segment_size_);
+    if (rc != 0) {
+      ::close(fd_);
+      fd_ = -1;
+      throw "Failed to preallocate journal segment: " + path + ": " +
+        ::strerror(rc);
+    }
+    void* p = ::mmap(NULL, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd_, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd_);
+      fd_ = -1;
+      throw "Failed to map journal segment: " + path + ": " +
+        ::strerror(errno);
+    }
+    ::madvise(p, segment_size_, MADV_SEQUENTIAL);
+    base_ = static_cast<char*>(p);
+
+    /// records follow the header, still 64 byte aligned
+    journal_header_t header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic_, journal_magic, sizeof(header.magic_));
+    header.version_ = journal_version;
+    header.nshards_ = nshards_;
+    header.price_levels_ = price_levels_;
+    header.pool_size_ = pool_size_;
+    ::memcpy(base_, &header, sizeof(header));
+    offset_ = sizeof(header);
+    synced_ = 0;
+    segment_.fetch_add(1, boost::memory_order_release);
+
+    TRACE_BEGIN << "journal segment: " << path << std::endl; TRACE_END
+  }
+
+  //###########################################################################
+  /// Close Segment (journal_t)
+  //###########################################################################
+  void
+  journal_t::
+  close_segment(bool sync) {
+
+    if (! base_)
+      return;
+    if (sync) {
+      this->sync();
+    }
+    ::munmap(base_, segment_size_);
+    ::close(fd_);
+    base_ = NULL;
+    fd_ = -1;
+  }
+
+  //###########################################################################
+  /// Sync (journal_t)
+  //###########################################################################
+  void
+  journal_t::
+  sync() {
+
+    if (offset_ == synced_)
+      return;
+
+    /// msync wants a page aligned start
+    size_t page = ::sysconf(_SC_PAGESIZE);
+    size_t from = synced_ / page * page;
+    if (::msync(base_ + from, offset_ - from, MS_SYNC) == -1) {
+      throw std::string("Failed to sync journal: ") + ::strerror(errno);
+    }
+    synced_ = offset_;
+    syncs_.fetch_add(1, boost::memory_order_relaxed);
+  }
+
+}  /// namespace trading
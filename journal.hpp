@@ -0,0 +1,331 @@
+#ifndef __JOURNAL_HPP__
+#define __JOURNAL_HPP__
+
+#include <string>
+#include <vector>
+#include <string.h>
+#include <order.hpp>
+#include <ring_queue.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+
+namespace trading {
+
+  //############################################################################
+  /// STRUCT: Journal Record
+  ///
+  /// One inbound message as the processor thread matched it: new order,
+  /// with the order id it was assigned, cancel or amend request, or
+  /// disconnect request. Records are 64 bytes so they never straddle a
+  /// page of the segment.
+  ///
+  /// The sequence number is unique across shards and increases within a
+  /// shard; a zero sequence marks the end of the journal in a segment.
+  //############################################################################
+  struct journal_record_t {
+
+    //##########################################################################
+    /// Constructor (Default)
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    journal_record_t() {
+      ::memset(this, 0, sizeof(*this));
+    }
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// @param[in]  sequence   inbound sequence number
+    /// @param[in]  timestamp  nanoseconds since the epoch
+    /// @param[in]  order      inbound order or request
+    /// @return                none
+    /// @throws                none
+    //##########################################################################
+    journal_record_t(boost::uint64_t sequence,
+                     boost::uint64_t timestamp,
+                     const order_t& order) :
+      sequence_(sequence),
+      timestamp_(timestamp),
+      session_id_(order.session_id()),
+      order_id_(order.order_id()),
+      symbol_id_(order.symbol_id()),
+      type_(order.type()),
+      trader_id_(order.trader_id()),
+      quantity_(order.quantity()),
+      price_(order.price()),
+      side_(order.side()) {
+      ::memcpy(stock_, order.stock(), sizeof(stock_));
+    }
+
+    boost::uint64_t  sequence_;    /// inbound sequence number, 0 = end
+    boost::uint64_t  timestamp_;   /// time journaled, ns since the epoch
+    boost::uint64_t  session_id_;  /// session the message was received on
+    boost::uint64_t  order_id_;    /// order a request applies to, or the
+                                   /// shard that took a disconnect
+    boost::uint32_t  symbol_id_;   /// symbol id of a new order
+    boost::int32_t   type_;        /// order_t::type_t
+    boost::int32_t   trader_id_;
+    boost::int32_t   quantity_;    /// order quantity or amended quantity
+    boost::int32_t   price_;       /// limit price in ticks
+    boost::int32_t   side_;        /// order_t::side_t
+    char             stock_[order_t::stock_size];
+  };
+
+  //############################################################################
+  /// STRUCT: Journal Segment Header
+  ///
+  /// First 64 bytes of every segment, ahead of its records. Recovery and
+  /// replay route requests by order id modulo the shard count, so a
+  /// journal is only replayed with the shard count it was written with;
+  /// the book and pool sizes let the replay tool rebuild the same order
+  /// managers.
+  //############################################################################
+  struct journal_header_t {
+    char             magic_[8];      /// "OBJRNL1"
+    boost::uint32_t  version_;
+    boost::uint32_t  nshards_;       /// processor count it was written with
+    boost::uint64_t  price_levels_;  /// price ladder levels per book
+    boost::uint64_t  pool_size_;     /// orders preallocated in the pool
+    char             reserved_[32];
+  };
+
+  //############################################################################
+  /// CLASS: Journal
+  ///
+  /// Append only binary journal of inbound messages, written through a
+  /// memory mapped, preallocated segment file. When a segment is full the
+  /// next one is created; segments are named journal.<index> in the journal
+  /// directory and a new journal starts after the highest existing index.
+  /// Each segment starts with a journal_header_t.
+  ///
+  /// Processor threads append records to a lock free ring; a dedicated
+  /// journal thread drains the ring into the mapped segment, so matching
+  /// never waits on the file system. Durability is a group commit of
+  /// whatever the journal thread has written since the last msync:
+  /// - neither sync_messages nor sync_micros: no msync, pages are written
+  ///   back by the kernel (survives a process crash, not a power loss)
+  /// - sync_messages: msync once at least N records are pending
+  /// - sync_micros: msync once the oldest pending record is T us old
+  /// Execution reports are not held back until their inbound message is
+  /// synced.
+  //############################################################################
+  class journal_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// Creates the first segment.
+    ///
+    /// @param[in]  dir            journal directory, must exist
+    /// @param[in]  nshards        number of shards writing the journal
+    /// @param[in]  price_levels   price ladder levels per book
+    /// @param[in]  pool_size      orders preallocated in the pool
+    /// @param[in]  segment_size   bytes per segment, rounded up to pages
+    /// @param[in]  sync_messages  msync every N records, 0 = off
+    /// @param[in]  sync_micros    msync every T microseconds, 0 = off
+    /// @param[in]  capacity       records the ring holds
+    /// @return                    none
+    /// @throws                    std::string on failure
+    //##########################################################################
+    journal_t(const std::string& dir,
+              size_t nshards,
+              size_t price_levels,
+              size_t pool_size,
+              size_t segment_size,
+              size_t sync_messages,
+              size_t sync_micros,
+              size_t capacity = 65536);
+
+    //##########################################################################
+    /// Destructor
+    ///
+    /// Unmaps and closes the current segment.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    ~journal_t();
+
+    //##########################################################################
+    /// Append
+    ///
+    /// Queues a record for the journal thread; yields while the ring is
+    /// full, which only happens if the journal falls behind. Once run()
+    /// has returned, a record finding the ring full is dropped.
+    ///
+    /// @param[in]  record  record to append
+    /// @return             none
+    /// @throws             none
+    //##########################################################################
+    void append(const journal_record_t& record);
+
+    //##########################################################################
+    /// Run
+    ///
+    /// Journal thread: writes queued records and syncs them according to
+    /// the durability settings until stopped, then drains the ring and
+    /// syncs once more. The journal counts as stopped also when run()
+    /// throws; records written after the failure are lost.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  std::string if a segment can't be created or synced
+    //##########################################################################
+    void run();
+
+    //##########################################################################
+    /// Stop
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    void stop() { stop_.store(true, boost::memory_order_release); }
+
+    //##########################################################################
+    /// Stopped Accessor
+    ///
+    /// @param   none
+    /// @return  true once run() has drained the ring and returned
+    /// @throws  none
+    //##########################################################################
+    bool stopped() const { return stopped_.load(boost::memory_order_acquire); }
+
+    //##########################################################################
+    /// Segment Accessor
+    ///
+    /// @param   none
+    /// @return  index of the segment being written
+    /// @throws  none
+    //##########################################################################
+    unsigned segment() const {
+      return segment_.load(boost::memory_order_acquire);
+    }
+
+    //##########################################################################
+    /// Read
+    ///
+    /// Reads the records of every segment in dir from segment index from
+    /// on, in segment order, up to the end of the journal in each segment.
+    /// Segments without records are ignored; the others must agree on the
+    /// number of shards, price levels and pool size.
+    ///
+    /// @param[in]     dir      journal directory
+    /// @param[in]     from     first segment index to read
+    /// @param[inout]  records  records read, appended
+    /// @return        header of the segments the records were written to,
+    ///                all zero if no record was read
+    /// @throws        std::string if the directory or a segment can't be
+    ///                read, or segments disagree on their configuration
+    //##########################################################################
+    static journal_header_t read(const std::string& dir,
+                       unsigned from,
+                       std::vector<journal_record_t>& records);
+
+    //##########################################################################
+    /// Written Accessor
+    ///
+    /// @param   none
+    /// @return  records written to segments
+    /// @throws  none
+    //##########################################################################
+    boost::uint64_t written() const {
+      return written_.load(boost::memory_order_relaxed);
+    }
+
+    //##########################################################################
+    /// Syncs Accessor
+    ///
+    /// @param   none
+    /// @return  number of msync calls (group commits)
+    /// @throws  none
+    //##########################################################################
+    boost::uint64_t syncs() const {
+      return syncs_.load(boost::memory_order_relaxed);
+    }
+
+  private:
+
+    //##########################################################################
+    /// List
+    ///
+    /// @param[in]     dir       journal directory
+    /// @param[inout]  segments  indices of the segments in dir, ascending
+    /// @return        none
+    /// @throws        std::string if the directory can't be read
+    //##########################################################################
+    static void list(const std::string& dir, std::vector<unsigned>& segments);
+
+    //##########################################################################
+    /// Open Segment
+    ///
+    /// Creates, preallocates and maps the next segment file.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  std::string on failure
+    //##########################################################################
+    void open_segment();
+
+    //##########################################################################
+    /// Write
+    ///
+    /// The loop of run(), up to the last sync.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  std::string if a segment can't be created or synced
+    //##########################################################################
+    void write();
+
+    //##########################################################################
+    /// Close Segment
+    ///
+    /// @param[in]  sync  msync what is pending before unmapping
+    /// @return           none
+    /// @throws           std::string if the sync fails
+    //##########################################################################
+    void close_segment(bool sync);
+
+    //##########################################################################
+    /// Sync
+    ///
+    /// msyncs the pages written since the last sync.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  std::string on failure
+    //##########################################################################
+    void sync();
+
+    /// processors produce, the journal thread alone consumes
+    typedef concurrent::ring_queue_t<journal_record_t,
+                                     concurrent::single_consumer> queue_t;
+
+    std::string                     dir_;            /// journal directory
+    size_t                          nshards_;        /// shards writing
+    size_t                          price_levels_;   /// levels per book
+    size_t                          pool_size_;      /// orders in the pool
+    size_t                          segment_size_;   /// bytes per segment
+    size_t                          sync_messages_;  /// 0 = off
+    size_t                          sync_micros_;    /// 0 = off
+    queue_t                         queue_;          /// records to write
+    boost::atomic<bool>             stop_;           /// stop the thread
+    boost::atomic<bool>             stopped_;        /// thread returned
+    boost::atomic<unsigned>         segment_;        /// current segment
+    int                             fd_;             /// segment file
+    char*                           base_;           /// segment mapping
+    size_t                          offset_;         /// next write offset
+    size_t                          synced_;         /// synced up to
+    boost::atomic<boost::uint64_t>  written_;        /// records written
+    boost::atomic<boost::uint64_t>  syncs_;          /// msync calls
+  };
+
+}  /// namespace trading
+
+#endif
@@ -0,0 +1,93 @@
+#include <journal.hpp>
+#include <tracer.hpp>
+#include <iostream>
+#include <iomanip>
+#include <time.h>
+#include <stdlib.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+//##############################################################################
+/// Journal durability benchmark.
+///
+/// Appends the same number of records to a fresh journal at each durability
+/// level and reports records/sec from the first append until the journal
+/// thread has written (and, if durable, synced) the last one, plus the
+/// number of msync calls (group commits).
+//##############################################################################
+
+//##############################################################################
+/// Durability Level
+//##############################################################################
+struct level_t {
+  const char* name_;
+  size_t      sync_messages_;
+  size_t      sync_micros_;
+};
+
+static const level_t levels[] =
+{
+  { "no sync",            0,    0 },
+  { "msync every 1024",   1024, 0 },
+  { "msync every 64",     64,   0 },
+  { "msync every 1",      1,    0 },
+  { "msync every 1000us", 0,    1000 },
+  { "msync every 100us",  0,    100 }
+};
+static const size_t nlevels = sizeof(levels)/sizeof(level_t);
+
+static double now() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, const char** argv) {
+
+  if (argc != 3) {
+    std::cout << "Usage: "
+              << argv[0]
+              << " <empty journal directory> <records per level>"
+              << std::endl;
+    return -1;
+  }
+  size_t nrecords = ::atoi(argv[2]);
+  if (nrecords < 1) {
+    std::cout << "Records must be positive" << std::endl;
+    return -1;
+  }
+  trading::tracer_t::instance().disable();
+
+  const trading::conn_info_t* conn = NULL;
+  trading::order_t order("IBM", 0, "bench", 1, 100, 1000,
+                         trading::order_t::buy, conn);
+  try {
+
+    for (size_t l = 0; l < nlevels; ++l) {
+
+      /// each level writes its own segments after the previous level's
+      trading::journal_t journal(argv[1], 1, 4096, 262144, 64 << 20,
+                                 levels[l].sync_messages_,
+                                 levels[l].sync_micros_);
+      boost::thread writer(boost::bind(&trading::journal_t::run, &journal));
+
+      double start = now();
+      for (size_t i = 0; i < nrecords; ++i) {
+        journal.append(trading::journal_record_t(i + 1, 0, order));
+      }
+      journal.stop();
+      writer.join();
+      double secs = now() - start;
+
+      std::cout << std::left << std::setw(20) << levels[l].name_
+                << std::right << std::fixed << std::setprecision(0)
+                << std::setw(12) << nrecords / secs << " records/sec  "
+                << journal.syncs() << " syncs" << std::endl;
+    }
+  }
+  catch (const std::string& ex) {
+    std::cout << ex << std::endl;
+    return 1;
+  }
+  return 0;
+}
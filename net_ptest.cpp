@@ -0,0 +1,299 @@
+#include <xmit_order.hpp>
+#include <shm_channel.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+//##############################################################################
+/// Network loopback benchmark.
+///
+/// Drives a running socket_server through its sockets, one thread per
+/// session, to compare the reader backends (start the server once with
+/// and once without --io-uring) or any other change on the network path.
+///
+/// Each session logs in, then keeps a window of new orders in flight,
+/// writing as many as the window has room for in one write and timing
+/// each order from its write to its ack, which names the order (ref).
+/// Buys and sells alternate at one price on a stock of the session's own,
+/// so every other order fills and the books stay empty. Prints orders/sec
+/// over all sessions and the ack latency distribution; orders the server
+/// throttled count as answered, and are reported.
+///
+/// Given the path of the server's Unix socket (--shm) instead of a port,
+/// sessions run over shared memory rings, to compare against loopback TCP
+/// on the same host.
+//##############################################################################
+
+static boost::uint64_t now_nanos() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//##############################################################################
+/// STRUCT: Session
+///
+/// What one session thread needs and measures.
+//##############################################################################
+struct session_t {
+  session_t() :
+    id_(0), norders_(0), window_(0), throttled_(0), failed_(false) {}
+
+  int                           id_;
+  size_t                        norders_;
+  size_t                        window_;    /// orders in flight at most
+  std::vector<boost::uint64_t>  sent_;      /// write time by order
+  std::vector<boost::uint32_t>  latency_;   /// ns from write to ack
+  size_t                        throttled_; /// orders throttled
+  bool                          failed_;
+  trading::shm_channel_ptr      channel_;   /// NULL on TCP
+};
+
+static int connect_to(const char* host, const char* port) {
+
+  struct addrinfo hints;
+  ::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* addr;
+  if (::getaddrinfo(host, port, &hints, &addr) != 0)
+    return -1;
+  int s = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  if (s != -1 && ::connect(s, addr->ai_addr, addr->ai_addrlen) == -1) {
+    ::close(s);
+    s = -1;
+  }
+  ::freeaddrinfo(addr);
+  if (s != -1) {
+    int one = 1;
+    ::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return s;
+}
+
+/// writes everything, to the socket or the session's channel
+static bool put(session_t* s, int sock, const char* p, size_t size) {
+  if (s->channel_) {
+    trading::shm_write(*s->channel_, sock, p, size);
+    return true;
+  }
+  while (size) {
+    ssize_t w = ::write(sock, p, size);
+    if (w <= 0)
+      return false;
+    p += w;
+    size -= w;
+  }
+  return true;
+}
+
+/// reads what there is, from the socket or the session's channel
+static ssize_t get(session_t* s, int sock, char* p, size_t size) {
+  return s->channel_ ? trading::shm_read(*s->channel_, sock, p, size) :
+    ::read(sock, p, size);
+}
+
+//##############################################################################
+/// Session
+///
+/// Runs one session to completion once the barrier opens.
+//##############################################################################
+static void session(const char* host,
+                    const char* port,
+                    session_t* s,
+                    boost::barrier* start) {
+
+  /// a path names the server's Unix socket for shared memory sessions
+  int sock = -1;
+  if (::strchr(port, '/')) {
+    try {
+      s->channel_ = trading::shm_connect(port, sock);
+    }
+    catch (const std::string& ex) {
+      std::cout << ex << std::endl;
+      sock = -1;
+    }
+  }
+  else {
+    sock = connect_to(host, port);
+  }
+  start->wait();
+  if (sock == -1) {
+    s->failed_ = true;
+    return;
+  }
+  typedef transmission::message_t message_t;
+  char buf[transmission::max_size];
+  boost::uint32_t sequence = 0;
+
+  /// log on and wait for the ack
+  message_t msg;
+  msg.type_ = message_t::login;
+  msg.sequence_ = ++sequence;
+  msg.version_ = transmission::max_version;
+  msg.trader_id_ = 1000 + s->id_;
+  size_t n = transmission::encode(msg, buf);
+  std::vector<char> in(64 * 1024);
+  size_t have = 0;
+  int framed = 0;
+  if (! put(s, sock, buf, n)) {
+    s->failed_ = true;
+  }
+  while (! s->failed_ && framed == 0) {
+    ssize_t r = get(s, sock, &in[have], in.size() - have);
+    if (r <= 0)
+      s->failed_ = true;
+    else
+      framed = transmission::decode(&in[0], have += r, msg);
+  }
+  if (s->failed_ || framed < 0 || msg.type_ != message_t::login_ack) {
+    s->failed_ = true;
+    ::close(sock);
+    return;
+  }
+  have -= framed;
+  ::memmove(&in[0], &in[framed], have);
+
+  message_t order;
+  order.type_ = message_t::new_order;
+  ::snprintf(order.stock_, sizeof(order.stock_), "N%d", s->id_);
+  order.quantity_ = 1;
+  order.price_ = 100;
+
+  std::vector<char> out(s->window_ * transmission::max_size);
+  size_t sent = 0;
+  size_t acked = 0;
+
+  while (acked < s->norders_) {
+
+    /// fill the window in one write
+    size_t n = std::min(s->window_ - (sent - acked), s->norders_ - sent);
+    if (n) {
+      boost::uint64_t t = now_nanos();
+      size_t size = 0;
+      for (size_t i = 0; i < n; ++i) {
+        order.side_ = (sent + i) % 2;
+        order.sequence_ = ++sequence;
+        size += transmission::encode(order, &out[size]);
+        s->sent_[sent + i] = t;
+      }
+      if (! put(s, sock, &out[0], size)) {
+        s->failed_ = true;
+        ::close(sock);
+        return;
+      }
+      sent += n;
+    }
+
+    /// read what came back; fills and other reports are skipped
+    ssize_t r = get(s, sock, &in[have], in.size() - have);
+    if (r <= 0) {
+      s->failed_ = true;
+      break;
+    }
+    boost::uint64_t t = now_nanos();
+    have += r;
+    size_t done = 0;
+    message_t report;
+    int k;
+    while ((k = transmission::decode(&in[done], have - done, report)) > 0) {
+      done += k;
+      /// ref names the order acked; orders follow the login, sequence 1
+      if (report.type_ == message_t::ack ||
+          report.type_ == message_t::rejected ||
+          report.type_ == message_t::throttled) {
+        s->latency_[acked] = t - s->sent_[report.ref_ - 2];
+        ++acked;
+        s->throttled_ += report.type_ == message_t::throttled;
+      }
+    }
+    if (k < 0) {
+      s->failed_ = true;
+      break;
+    }
+    have -= done;
+    ::memmove(&in[0], &in[done], have);
+  }
+  ::close(sock);
+}
+
+int main(int argc, const char** argv) {
+
+  if (argc < 5 || argc > 6) {
+    std::cout << "Usage: "
+              << argv[0]
+              << " <host> <port | shm socket path> <sessions> "
+              << "<orders per session> [window]" << std::endl;
+    return -1;
+  }
+  size_t nsessions = ::atoi(argv[3]);
+  size_t norders = ::atoi(argv[4]);
+  size_t window = argc == 6 ? ::atoi(argv[5]) : 64;
+  if (nsessions < 1 || norders < 1 || window < 1) {
+    std::cout << "Sessions, orders and window must be positive"
+              << std::endl;
+    return -1;
+  }
+
+  std::vector<session_t> sessions(nsessions);
+  boost::barrier start(nsessions + 1);
+  boost::thread_group threads;
+  for (size_t i = 0; i < nsessions; ++i) {
+    session_t& s = sessions[i];
+    s.id_ = i;
+    s.norders_ = norders;
+    s.window_ = window;
+    s.sent_.resize(norders);
+    s.latency_.resize(norders);
+    threads.create_thread(boost::bind(&session, argv[1], argv[2], &s,
+                                      &start));
+  }
+  start.wait();
+  boost::uint64_t t0 = now_nanos();
+  threads.join_all();
+  double secs = (now_nanos() - t0) / 1e9;
+
+  std::vector<boost::uint32_t> latency;
+  latency.reserve(nsessions * norders);
+  size_t throttled = 0;
+  for (size_t i = 0; i < nsessions; ++i) {
+    if (sessions[i].failed_) {
+      std::cout << "session " << i << " failed: " << ::strerror(errno)
+                << std::endl;
+      return 1;
+    }
+    latency.insert(latency.end(), sessions[i].latency_.begin(),
+                   sessions[i].latency_.end());
+    throttled += sessions[i].throttled_;
+  }
+  std::sort(latency.begin(), latency.end());
+  size_t n = latency.size();
+
+  std::cout << std::fixed << std::setprecision(0)
+            << nsessions << " sessions, " << n << " orders, window "
+            << window << ": " << n / secs << " orders/sec, ack latency us"
+            << std::setprecision(1)
+            << " p50 " << latency[n / 2] / 1e3
+            << " p90 " << latency[n * 9 / 10] / 1e3
+            << " p99 " << latency[n * 99 / 100] / 1e3
+            << " p99.9 " << latency[n * 999 / 1000] / 1e3
+            << " max " << latency[n - 1] / 1e3
+            << std::endl;
+  if (throttled) {
+    std::cout << throttled << " orders throttled" << std::endl;
+  }
+  return 0;
+}
@@ -1,4 +1,6 @@
 #include <vector>
+#include <algorithm>
+#include <limits.h>
 #include <order.hpp>
 #include <tracer.hpp>
 #include <sstream>
@@ -7,12 +9,388 @@
 namespace trading {
 
   //###########################################################################
-  /// Process Order
+  /// Constructor (order_book_t)
+  //###########################################################################
+  order_book_t::
+  order_book_t(size_t nlevels) :
+    nlevels_(static_cast<int>(nlevels)),
+    base_(0),
+    reference_(0),
+    best_bid_(-1),
+    best_ask_(static_cast<int>(nlevels)),
+    free_(npos),
+    sequence_(0) {
+  }
+
+  //###########################################################################
+  /// Process Order (order_book_t)
+  //###########################################################################
+  bool
+  order_book_t::
+  process_order(order_ptr& order,
+                report_ring_t& reports) {
+
+    /// keeps every level offset and the recentered base from overflowing
+    if (order->price() <= 0 || order->price() > INT_MAX - nlevels_) {
+      TRACE_BEGIN << "rejected order priced out of range: " << order
+                  << std::endl; TRACE_END
+      return false;
+    }
+    ////////
+    /// an empty book is (re)centered on its last trade, or on the incoming
+    /// price until it first trades
+    ////////
+    if (best_bid_ < 0 && best_ask_ == nlevels_) {
+      recenter(reference_ ? reference_ : order->price());
+    }
+    /// map the limit price onto its level
+    int level = order->price() - base_;
+    if (level < 0 || level >= nlevels_) {
+      TRACE_BEGIN << "rejected order priced off the ladder ["
+                  << base_ << ", " << base_ + nlevels_ << "): "
+                  << order << std::endl; TRACE_END
+      return false;
+    }
+    reports.push(report_t::ack, order);
+
+    /// attempt to fill the order from the best contra price while it crosses
+    int balance = order->balance();
+
+    if (order->side() == order_t::buy) {
+      while (balance > 0 && best_ask_ <= level) {
+        balance = fill(best_ask_, order, balance, reports);
+        if (levels_[best_ask_].head_ == npos) {
+          best_ask_ = next_ask(best_ask_ + 1);
+        }
+      }
+    }
+    else {
+      while (balance > 0 && best_bid_ >= level) {
+        balance = fill(best_bid_, order, balance, reports);
+        if (levels_[best_bid_].head_ == npos) {
+          best_bid_ = next_bid(best_bid_ - 1);
+        }
+      }
+    }
+    ////////
+    /// if the balance on the input order fell to zero it is complete
+    /// (its last fill reported a zero balance), otherwise it rests at the
+    /// tail of its price level
+    ////////
+    order->balance(balance);
+    if (balance == 0) {
+      return true;
+    }
+    push_back(level, order, balance);
+    if (order->side() == order_t::buy) {
+      best_bid_ = std::max(best_bid_, level);
+    }
+    else {
+      best_ask_ = std::min(best_ask_, level);
+    }
+    TRACE_BEGIN << "inserted: " << order << std::endl
+                << *this << std::endl;
+    TRACE_END
+    return true;
+  }
+
+  //###########################################################################
+  /// Recenter (order_book_t)
+  //###########################################################################
+  void
+  order_book_t::
+  recenter(int price) {
+
+    if (levels_.empty()) {
+      level_t empty = { npos, npos };
+      levels_.resize(nlevels_, empty);
+      occupied_.resize((nlevels_ + 63) / 64, 0);
+    }
+    base_ = price - nlevels_ / 2;
+  }
+
+  //###########################################################################
+  /// Fill (order_book_t)
+  //###########################################################################
+  int
+  order_book_t::
+  fill(int level,
+       const order_ptr& order,
+       int balance,
+       report_ring_t& reports) {
+
+    level_t& lvl = levels_[level];
+    int price = base_ + level;
+
+    while (lvl.head_ != npos && balance > 0) {
+
+      index_t ndx = lvl.head_;
+      entry_t& rhs = slab_[ndx];
+      order_ptr resting = rhs.order_;
+
+      /// trade the smaller of the two balances at the resting price
+      int traded = std::min(rhs.balance_, balance);
+      rhs.balance_ -= traded;
+      balance -= traded;
+      resting->balance(rhs.balance_);
+      order->balance(balance);
+
+      /// report both sides of the trade
+      reference_ = price;
+      report_t& r = reports.push(report_t::fill, resting);
+      r.contra_id_ = order->order_id();
+      r.quantity_ = traded;
+      r.price_ = price;
+      report_t& a = reports.push(report_t::fill, order);
+      a.contra_id_ = resting->order_id();
+      a.quantity_ = traded;
+      a.price_ = price;
+
+      /// a resting order with nothing left is unlinked from the level
+      if (rhs.balance_ == 0) {
+        unlink(ndx);
+      }
+    }
+    return balance;
+  }
+
+  //###########################################################################
+  /// Push Back (order_book_t)
+  //###########################################################################
+  void
+  order_book_t::
+  push_back(int level,
+            const order_ptr& order,
+            int balance) {
+
+    /// reuse a free entry, otherwise grow the slab
+    index_t ndx = free_;
+    if (ndx != npos) {
+      free_ = slab_[ndx].next_;
+    }
+    else {
+      ndx = static_cast<index_t>(slab_.size());
+      slab_.push_back(entry_t());
+    }
+    level_t& lvl = levels_[level];
+    entry_t& entry = slab_[ndx];
+    entry.balance_ = balance;
+    entry.level_ = level;
+    entry.prev_ = lvl.tail_;
+    entry.next_ = npos;
+    entry.order_ = order;
+    order->entry_ = ndx;
+
+    /// link at the tail of the level and mark the level non-empty
+    if (lvl.tail_ == npos) {
+      lvl.head_ = ndx;
+      occupied_[level >> 6] |= boost::uint64_t(1) << (level & 63);
+    }
+    else {
+      slab_[lvl.tail_].next_ = ndx;
+    }
+    lvl.tail_ = ndx;
+  }
+
+  //###########################################################################
+  /// Unlink (order_book_t)
   //###########################################################################
   void
+  order_book_t::
+  unlink(index_t ndx) {
+
+    entry_t& entry = slab_[ndx];
+    level_t& lvl = levels_[entry.level_];
+
+    /// unlink from the level, mark it empty if it was the last entry
+    if (entry.prev_ == npos) {
+      lvl.head_ = entry.next_;
+    }
+    else {
+      slab_[entry.prev_].next_ = entry.next_;
+    }
+    if (entry.next_ == npos) {
+      lvl.tail_ = entry.prev_;
+    }
+    else {
+      slab_[entry.next_].prev_ = entry.prev_;
+    }
+    if (lvl.head_ == npos) {
+      occupied_[entry.level_ >> 6] &=
+        ~(boost::uint64_t(1) << (entry.level_ & 63));
+    }
+    /// put the entry on the free list
+    entry.order_ = NULL;
+    entry.next_ = free_;
+    free_ = ndx;
+  }
+
+  //###########################################################################
+  /// Update Best (order_book_t)
+  //###########################################################################
+  void
+  order_book_t::
+  update_best(int level) {
+
+    if (levels_[level].head_ != npos)
+      return;
+
+    if (level == best_bid_) {
+      best_bid_ = next_bid(level - 1);
+    }
+    else if (level == best_ask_) {
+      best_ask_ = next_ask(level + 1);
+    }
+  }
+
+  //###########################################################################
+  /// Cancel (order_book_t)
+  //###########################################################################
+  void
+  order_book_t::
+  cancel(order_ptr order) {
+
+    int level = slab_[order->entry_].level_;
+    unlink(order->entry_);
+    update_best(level);
+    order->balance(0);
+  }
+
+  //###########################################################################
+  /// Amend (order_book_t)
+  //###########################################################################
+  void
+  order_book_t::
+  amend(order_ptr order,
+        int quantity) {
+
+    /// keep what already traded, nothing left open means cancel
+    int balance = quantity - (order->quantity() - order->balance());
+    if (balance <= 0) {
+      cancel(order);
+      order->quantity(quantity);
+      return;
+    }
+    ////////
+    /// a larger quantity loses time priority and goes to the tail of the
+    /// level, a smaller one is reduced in place
+    ////////
+    if (quantity > order->quantity()) {
+      int level = slab_[order->entry_].level_;
+      unlink(order->entry_);
+      push_back(level, order, balance);
+    }
+    else {
+      slab_[order->entry_].balance_ = balance;
+    }
+    order->quantity(quantity);
+    order->balance(balance);
+  }
+
+  //###########################################################################
+  /// Restore (order_book_t)
+  //###########################################################################
+  bool
+  order_book_t::
+  restore(const order_ptr& order) {
+
+    if (levels_.empty()) {
+      recenter(order->price());
+    }
+    int level = order->price() - base_;
+    if (level < 0 || level >= nlevels_) {
+      return false;
+    }
+    push_back(level, order, order->balance());
+    if (order->side() == order_t::buy) {
+      best_bid_ = std::max(best_bid_, level);
+    }
+    else {
+      best_ask_ = std::min(best_ask_, level);
+    }
+    return true;
+  }
+
+  //###########################################################################
+  /// Anchor (order_book_t)
+  //###########################################################################
+  void
+  order_book_t::
+  anchor(int base, int reference) {
+
+    recenter(0);
+    base_ = base;
+    reference_ = reference;
+  }
+
+  //###########################################################################
+  /// Orders (order_book_t)
+  //###########################################################################
+  void
+  order_book_t::
+  orders(orders_t& orders) const {
+
+    for (int level = best_bid_; level >= 0; level = next_bid(level - 1)) {
+      for (index_t i = levels_[level].head_; i != npos; i = slab_[i].next_)
+        orders.push_back(slab_[i].order_);
+    }
+    for (int level = best_ask_; level < nlevels_;
+         level = next_ask(level + 1)) {
+      for (index_t i = levels_[level].head_; i != npos; i = slab_[i].next_)
+        orders.push_back(slab_[i].order_);
+    }
+  }
+
+  //###########################################################################
+  /// Next Ask (order_book_t)
+  //###########################################################################
+  int
+  order_book_t::
+  next_ask(int from) const {
+
+    if (from >= nlevels_)
+      return nlevels_;
+
+    size_t word = from >> 6;
+    boost::uint64_t bits = occupied_[word] & (~boost::uint64_t(0) << (from & 63));
+
+    while (bits == 0) {
+      if (++word == occupied_.size())
+        return nlevels_;
+      bits = occupied_[word];
+    }
+    return static_cast<int>(word * 64 + __builtin_ctzll(bits));
+  }
+
+  //###########################################################################
+  /// Next Bid (order_book_t)
+  //###########################################################################
+  int
+  order_book_t::
+  next_bid(int from) const {
+
+    if (from < 0)
+      return -1;
+
+    size_t word = from >> 6;
+    boost::uint64_t bits =
+      occupied_[word] & (~boost::uint64_t(0) >> (63 - (from & 63)));
+
+    while (bits == 0) {
+      if (word-- == 0)
+        return -1;
+      bits = occupied_[word];
+    }
+    return static_cast<int>(word * 64 + 63 - __builtin_clzll(bits));
+  }
+
+  //###########################################################################
+  /// Process Order (order_manager_t)
+  //###########################################################################
+  bool
   order_manager_t::
   process_order(order_ptr& order,
-                orders_t& to_notify) {
+                report_ring_t& reports) {
 
     TRACE_BEGIN << "processing order: " << std::endl
       << "*****************************************************************\n"
@@ -20,71 +398,353 @@ namespace trading {
       << "*****************************************************************\n";
     TRACE_END
 
-    /// reverse the side to fill the order
-    order_t::side_t other_side =
-      order->side() == order_t::buy ? order_t::sell : order_t::buy;
-
-    /// get the stock side index and find by stock and side
-    stock_side_index_t& ssi = orders_.get<STOCK_SIDE_INDEX>();
-    ssi_index_iterator_pair_t i =
-      ssi.equal_range(boost::make_tuple(order->stock(), other_side));
-
-    /// if order doesn't exist, add it and return
-    if (i.first == i.second) {
-      ssi.insert(order);
-      TRACE_BEGIN << "inserted: " << order << std::endl
-                  << *this << std::endl;
-      TRACE_END
-      return;
+    size_t first = reports.size();
+    bool accepted = match(order, reports);
+    notify(reports, first);
+    return accepted;
+  }
+
+  //###########################################################################
+  /// Process Orders (order_manager_t)
+  //###########################################################################
+  void
+  order_manager_t::
+  process_orders(order_ptr* orders,
+                 size_t count,
+                 report_ring_t& reports) {
+
+    TRACE_BEGIN << "processing batch of " << count << " orders"
+                << std::endl; TRACE_END
+
+    size_t first = reports.size();
+    for (size_t i = 0; i < count; ++i) {
+      match(orders[i], reports);
     }
-    /// if the input order isn't complete it must be added to the order table
-    bool must_add = false;
-
-    /// attempt to fill the order with existing orders
-    while (i.first != i.second) {
-
-      /// subtract traded balance from both sides of the trade
-      order_ptr rhs = *i.first;
-
-      int rhs_bal = rhs->balance() - order->balance();
-      int lhs_bal = order->balance() - rhs->balance();
-      
-      ////////
-      /// if the balance on the order in the order table falls to or
-      /// below zero, clear the balance on the order, add it to the
-      /// notification list and remove it from the order table
-      ////////
-      if (rhs_bal <= 0) {
-        rhs->balance(0);
-        to_notify.push_back(rhs);
-        i.first = ssi.erase(i.first);
+    notify(reports, first);
+  }
+
+  //###########################################################################
+  /// Match (order_manager_t)
+  //###########################################################################
+  bool
+  order_manager_t::
+  match(order_ptr& order,
+        report_ring_t& reports) {
+
+    if (order->type() == order_t::snapshot) {
+      return true;
+    }
+    if (order->type() == order_t::disconnect) {
+      cancel_session(*order, reports);
+      return true;
+    }
+    if (order->type() != order_t::new_order) {
+      if (! process_request(order, reports)) {
+        reports.push(report_t::rejected, order);
+        return false;
       }
-      /// otherwise update the balance and proceed to the next order
-      else {
-        rhs->balance(rhs_bal);
-        ++i.first;
+      return true;
+    }
+    /// a replayed order keeps the id it was assigned originally
+    if (order->order_id() == 0) {
+      order->order_id(next_id_);
+      next_id_ += id_stride_;
+    }
+    else {
+      next_id(order->order_id() + id_stride_);
+    }
+    order_book_t& book = this->book(order->symbol_id());
+    if (applied(book, *order)) {
+      reports.push(report_t::rejected, order);
+      return false;
+    }
+    size_t first = reports.size();
+    if (order->quantity() <= 0 || ! book.process_order(order, reports)) {
+      reports.push(report_t::rejected, order);
+      return false;
+    }
+    book.sequence(order->sequence());
+    /// filled resting orders leave the index, a resting input order joins it
+    for (size_t i = first; i < reports.size(); ++i) {
+      if (reports[i].balance_ == 0 && reports[i].order_ != order) {
+        retire(reports[i].order_);
       }
-      ////////
-      /// if the balance on the input order falls to or below zero,
-      /// clear the balance on the order and remember not to add this
-      /// order to the order table since it is complete
-      ////////
-      if (lhs_bal <= 0) {
-        order->balance(0);
-        to_notify.push_back(order);
-        must_add = false;
-        break;
+    }
+    if (order->balance() > 0) {
+      rest(order);
+    }
+    return true;
+  }
+
+  //###########################################################################
+  /// Process Request (order_manager_t)
+  //###########################################################################
+  bool
+  order_manager_t::
+  process_request(const order_ptr& request,
+                  report_ring_t& reports) {
+
+    /// only the connection that entered an order may cancel or amend it
+    order_ptr order = index_.find(request->order_id());
+    if (! order || ! order->same_session(*request)) {
+      TRACE_BEGIN << "rejected request for unknown order id: "
+                  << request->order_id() << std::endl; TRACE_END
+      return false;
+    }
+    order_book_t& book = books_[order->symbol_id()];
+    if (applied(book, *request)) {
+      return false;
+    }
+    book.sequence(request->sequence());
+    if (request->type() == order_t::cancel) {
+      book.cancel(order);
+      reports.push(report_t::cancelled, order);
+    }
+    else {
+      book.amend(order, request->quantity());
+      reports.push(report_t::amended, order);
+    }
+    if (order->balance() == 0) {
+      retire(order);
+    }
+    return true;
+  }
+
+  //###########################################################################
+  /// Restore (order_manager_t)
+  //###########################################################################
+  bool
+  order_manager_t::
+  restore(const order_ptr& order) {
+
+    if (! book(order->symbol_id()).restore(order)) {
+      return false;
+    }
+    next_id(order->order_id() + id_stride_);
+    rest(order);
+    return true;
+  }
+
+  //###########################################################################
+  /// Book (order_manager_t)
+  //###########################################################################
+  order_book_t&
+  order_manager_t::
+  book(boost::uint32_t symbol_id) {
+
+    /// books are indexed by symbol id
+    if (symbol_id >= books_.size()) {
+      books_.resize(symbol_id + 1, order_book_t(nlevels_));
+    }
+    return books_[symbol_id];
+  }
+
+  //###########################################################################
+  /// Applied (order_manager_t)
+  //###########################################################################
+  bool
+  order_manager_t::
+  applied(const order_book_t& book,
+          const order_t& order) const {
+
+    if (order.sequence() == 0 || order.sequence() > book.sequence())
+      return false;
+
+    TRACE_BEGIN << "message " << order.sequence() << " already applied, "
+                << "book is at " << book.sequence() << std::endl; TRACE_END
+    return true;
+  }
+
+  //###########################################################################
+  /// Rest (order_manager_t)
+  //###########################################################################
+  void
+  order_manager_t::
+  rest(const order_ptr& order) {
+
+    index_.insert(order);
+    if (! track_sessions_)
+      return;
+
+    order_ptr& head = session_list(*order);
+    order->session_prev_ = NULL;
+    order->session_next_ = head;
+    if (head) {
+      head->session_prev_ = order;
+    }
+    head = order;
+  }
+
+  //###########################################################################
+  /// Retire (order_manager_t)
+  //###########################################################################
+  void
+  order_manager_t::
+  retire(const order_ptr& order) {
+
+    index_.erase(order->order_id());
+    if (! track_sessions_)
+      return;
+
+    if (order->session_next_) {
+      order->session_next_->session_prev_ = order->session_prev_;
+    }
+    if (order->session_prev_) {
+      order->session_prev_->session_next_ = order->session_next_;
+    }
+    else {
+      session_list(*order) = order->session_next_;
+    }
+    order->session_prev_ = NULL;
+    order->session_next_ = NULL;
+  }
+
+  //###########################################################################
+  /// Cancel Session (order_manager_t)
+  //###########################################################################
+  void
+  order_manager_t::
+  cancel_session(const order_t& request,
+                 report_ring_t& reports) {
+
+    if (! track_sessions_)
+      return;
+    order_ptr order = session_list(request);
+    if (order) {
+      TRACE_BEGIN << "cancelling resting orders of session: "
+                  << request.session_id_ << std::endl; TRACE_END
+    }
+
+    ////////
+    /// books that saw the request before a snapshot are skipped, as for
+    /// any other request; a book at the request's own sequence number has
+    /// just had another of the session's orders cancelled by it
+    ////////
+    while (order) {
+      order_ptr next = order->session_next_;
+      order_book_t& book = books_[order->symbol_id()];
+      if (book.sequence() == request.sequence() ||
+          ! applied(book, request)) {
+        book.cancel(order);
+        book.sequence(request.sequence());
+        retire(order);
+        reports.push(report_t::cancelled, order);
       }
-      /// otherwise the order hasn't been completed yet, remember to add it
-      else {
-        order->balance(lhs_bal);
-        must_add = true;
+      order = next;
+    }
+    /// a recovered session ends with its disconnect
+    recovered_t::iterator it = recovered_.find(request.session_id_);
+    if (it != recovered_.end() && ! it->second) {
+      recovered_.erase(it);
+    }
+  }
+
+  //###########################################################################
+  /// Constructor (order_index_t)
+  //###########################################################################
+  order_index_t::
+  order_index_t(size_t capacity) :
+    bits_(4),
+    size_(0) {
+
+    while ((size_t(1) << bits_) < capacity * 2)
+      ++bits_;
+    mask_ = (size_t(1) << bits_) - 1;
+    slot_t empty = { 0, NULL };
+    slots_.resize(mask_ + 1, empty);
+  }
+
+  //###########################################################################
+  /// Insert (order_index_t)
+  //###########################################################################
+  void
+  order_index_t::
+  insert(order_ptr order) {
+
+    if ((size_ + 1) * 2 > slots_.size()) {
+      grow();
+    }
+    size_t i = slot(order->order_id());
+    while (slots_[i].order_id_ != 0) {
+      i = (i + 1) & mask_;
+    }
+    slots_[i].order_id_ = order->order_id();
+    slots_[i].order_ = order;
+    ++size_;
+  }
+
+  //###########################################################################
+  /// Find (order_index_t)
+  //###########################################################################
+  order_ptr
+  order_index_t::
+  find(boost::uint64_t order_id) const {
+
+    if (order_id == 0)
+      return NULL;
+
+    for (size_t i = slot(order_id); ; i = (i + 1) & mask_) {
+      if (slots_[i].order_id_ == order_id)
+        return slots_[i].order_;
+      if (slots_[i].order_id_ == 0)
+        return NULL;
+    }
+  }
+
+  //###########################################################################
+  /// Erase (order_index_t)
+  //###########################################################################
+  void
+  order_index_t::
+  erase(boost::uint64_t order_id) {
+
+    if (order_id == 0)
+      return;
+
+    size_t i = slot(order_id);
+    while (slots_[i].order_id_ != order_id) {
+      if (slots_[i].order_id_ == 0)
+        return;
+      i = (i + 1) & mask_;
+    }
+    ////////
+    /// shift back every following entry of the probe run whose home slot
+    /// doesn't lie cyclically in (i, j], so no lookup can stop early at
+    /// the hole left by the erased entry
+    ////////
+    for (size_t j = (i + 1) & mask_;
+         slots_[j].order_id_ != 0;
+         j = (j + 1) & mask_) {
+      size_t home = slot(slots_[j].order_id_);
+      if (((j - home) & mask_) >= ((j - i) & mask_)) {
+        slots_[i] = slots_[j];
+        i = j;
       }
     }
-    if (must_add) {
-      orders_.insert(order);
+    slots_[i].order_id_ = 0;
+    slots_[i].order_ = NULL;
+    --size_;
+  }
+
+  //###########################################################################
+  /// Grow (order_index_t)
+  //###########################################################################
+  void
+  order_index_t::
+  grow() {
+
+    std::vector<slot_t> old;
+    old.swap(slots_);
+    ++bits_;
+    mask_ = (size_t(1) << bits_) - 1;
+    slot_t empty = { 0, NULL };
+    slots_.resize(mask_ + 1, empty);
+    size_ = 0;
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (old[i].order_id_ != 0) {
+        insert(old[i].order_);
+      }
     }
-    notify(to_notify);
   }
 
   //###########################################################################
@@ -92,19 +752,40 @@ namespace trading {
   //###########################################################################
   void
   order_manager_t::
-  notify(const orders_t& orders) {
+  notify(const report_ring_t& reports,
+         size_t first) {
 
     TRACE_BEGIN << *this << std::endl
       << "*****************************************************************\n"
-      << "Updated orders: " << std::endl
+      << "Reports: " << std::endl
       << "*****************************************************************\n";
 
-    for (size_t i = 0; i < orders.size(); ++i)
-      TRACE << orders[i] << std::endl;
+    for (size_t i = first; i < reports.size(); ++i)
+      TRACE << reports[i] << std::endl;
 
     TRACE_END
   }
 
+  //###########################################################################
+  /// Operator<< (report_t)
+  //###########################################################################
+  std::ostream& operator<<(std::ostream& os, const report_t& report) {
+
+    static const char* types[] = {
+      "Ack", "Fill", "Cancelled", "Amended", "Rejected"
+    };
+    os << report.sequence_  << "\t"
+       << types[report.type_] << "\t"
+       << report.order_id_  << "\t"
+       << report.symbol_id_ << "\t"
+       << report.quantity_  << "\t"
+       << report.balance_   << "\t@"
+       << report.price_;
+    if (report.type_ == report_t::fill)
+      os << "\tvs " << report.contra_id_;
+    return os;
+  }
+
   //###########################################################################
   /// Operator<< (order_ptr)
   //###########################################################################
@@ -112,6 +793,7 @@ namespace trading {
 
     const char* side = order->side() == order_t::buy ? "Buy " : "Sell";
     os << order->stock()    << "\t"
+       << order->price()    << "\t"
        << order->quantity() << "\t"
        << order->balance()  << "\t"
        << side              << "\t"
@@ -119,6 +801,25 @@ namespace trading {
     return os;
   }
 
+  //###########################################################################
+  /// Operator<< (order_book_t)
+  //###########################################################################
+  std::ostream& operator<<(std::ostream& os, const order_book_t& book) {
+
+    /// highest price first, so asks print above bids
+    if (book.levels_.empty())
+      return os;
+    for (int level = book.nlevels_ - 1; level >= 0; --level) {
+      order_book_t::index_t ndx = book.levels_[level].head_;
+      while (ndx != order_book_t::npos) {
+        const order_book_t::entry_t& entry = book.slab_[ndx];
+        os << entry.order_ << std::endl;
+        ndx = entry.next_;
+      }
+    }
+    return os;
+  }
+
   //###########################################################################
   /// Operator<< (order_manager_t)
   //###########################################################################
@@ -127,12 +828,10 @@ namespace trading {
     os << "Order Table: " << std::endl;
     os << "*****************************************************************"
        << std::endl;
-    const stock_index_t& stock_index = om.orders_.get<STOCK_INDEX>();
-    for (stock_index_t::const_iterator i = stock_index.begin();
-         i != stock_index.end();
+    for (order_manager_t::books_t::const_iterator i = om.books_.begin();
+         i != om.books_.end();
          ++i) {
-      const order_ptr& p = *i;
-      os << p << std::endl;
+      os << *i;
     }
     os << "*****************************************************************";
     return os;
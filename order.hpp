@@ -4,49 +4,74 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 #include <iostream>
+#include <string.h>
 #include <conn_info.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/weak_ptr.hpp>
 #include <boost/make_shared.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/composite_key.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/thread.hpp>
 
 namespace trading {
 
-  namespace mti = boost::multi_index;
-
+  ////////
+  /// orders are allocated from an order_pool_t; an order_ptr is a plain
+  /// pointer into the pool and carries no ownership (see order_pool.hpp)
+  ////////
   class order_t;
-  typedef boost::shared_ptr<order_t> order_ptr;
+  typedef order_t*                   order_ptr;
   typedef std::vector<order_ptr>     orders_t;
 
   //###########################################################################
   /// CLASS: Order
   ///
   /// Minimal trade order, contains:
+  /// - Type (new order, or a cancel/amend request for a resting order)
+  /// - Order Id (server assigned, unique across shards)
+  /// - Session Id (of the connection the order was received on)
+  /// - Sequence (inbound sequence number, see socket_server_t)
   /// - Stock
+  /// - Symbol Id (dense id of the stock, see symbol_directory_t)
   /// - Trader
   /// - Trader Id
   /// - Quantity (original order amount)
   /// - Balance (amount remaining on the order)
+  /// - Price (limit price in integer ticks)
   /// - Side (buy or sell)
-  /// - Connection Info Weak Ptr
+  /// - Session Handle (of the connection, see session_table_t)
   ///
-  /// Shared pointers to orders are inserted into a multi-index container.
+  /// Resting orders are held by the order book of their stock; filled and
+  /// rejected orders are returned to the order pool by the processor thread
+  /// once the client has been notified. Names are kept in fixed size arrays
+  /// matching the transmission order so building an order allocates nothing.
   //###########################################################################
   class order_t {
   public:
 
+    /// sizes of the name fields, NUL terminator included
+    enum {
+      stock_size  = 8,
+      trader_size = 64
+    };
+
     /// Side - Buy or Sell
     enum side_t {
       buy,
       sell
     };
 
+    /// Type - new order, request against a resting order, a disconnect
+    /// request cancelling every resting order of a session, or a snapshot
+    /// request copying books for a snapshot (handled by the processor)
+    enum type_t {
+      new_order,
+      cancel,
+      amend,
+      disconnect,
+      snapshot
+    };
+
     //##########################################################################
     /// Constructor (Default)
     ///
@@ -57,38 +82,125 @@ namespace trading {
     /// @throws        none
     //##########################################################################
     order_t() :
+      type_(new_order),
+      order_id_(0),
+      entry_(0),
+      symbol_id_(0),
+      trader_id_(0),
       quantity_(0),
       balance_(0),
+      price_(0),
       side_(buy),
-      trader_id_(0)
-    {}
+      client_sequence_(0),
+      session_id_(0),
+      sequence_(0),
+      session_prev_(NULL),
+      session_next_(NULL) {
+      ::memset(stock_,  '\0', sizeof(stock_));
+      ::memset(trader_, '\0', sizeof(trader_));
+    }
 
     //##########################################################################
     /// Constructor
     ///
     /// Initializes members from arguments.
     ///
-    /// @param[in]  stock     stock name
-    /// @param[in]  trader    trader name
-    /// @param[in]  quantity  traded quantity
-    /// @param[in]  side      side (buy or sell)
-    /// @return               none
-    /// @throws               none
+    /// @param[in]  stock      stock name, truncated to stock_size - 1
+    /// @param[in]  symbol_id  symbol id of the stock
+    /// @param[in]  trader     trader name, truncated to trader_size - 1
+    /// @param[in]  trader_id  trader id
+    /// @param[in]  quantity   traded quantity
+    /// @param[in]  price      limit price in ticks
+    /// @param[in]  side       side (buy or sell)
+    /// @param[in]  conn_info  connection the order was received on, NULL
+    ///                        if none
+    /// @return                none
+    /// @throws                none
     //##########################################################################
-    order_t(const std::string& stock,
-            const std::string& trader,
+    order_t(const char* stock,
+            boost::uint32_t symbol_id,
+            const char* trader,
             int trader_id,
             int quantity,
+            int price,
             side_t side,
-            const conn_info_ptr& conn_info) :
-      stock_(stock),
-      trader_(trader),
+            const conn_info_t* conn_info) :
+      type_(new_order),
+      order_id_(0),
+      entry_(0),
+      symbol_id_(symbol_id),
       trader_id_(trader_id),
       quantity_(quantity),
       balance_(quantity),
+      price_(price),
       side_(side),
-      conn_info_(conn_info)
-    {}
+      client_sequence_(0),
+      session_id_(conn_info ? conn_info->session_id_ : 0),
+      sequence_(0),
+      session_prev_(NULL),
+      session_next_(NULL),
+      session_(conn_info ? conn_info->handle_ : 0) {
+      this->stock(stock);
+      this->trader(trader);
+    }
+
+    //##########################################################################
+    /// Constructor (Request)
+    ///
+    /// Initializes a cancel or amend request for a resting order, or a
+    /// disconnect request for the session of conn_info.
+    ///
+    /// @param[in]  type       cancel, amend or disconnect
+    /// @param[in]  order_id   id of the resting order, the shard taking
+    ///                        the request for a disconnect
+    /// @param[in]  quantity   new order quantity (amend only)
+    /// @param[in]  conn_info  connection the request was received on, NULL
+    ///                        if none
+    /// @return                none
+    /// @throws                none
+    //##########################################################################
+    order_t(type_t type,
+            boost::uint64_t order_id,
+            int quantity,
+            const conn_info_t* conn_info) :
+      type_(type),
+      order_id_(order_id),
+      entry_(0),
+      symbol_id_(0),
+      trader_id_(0),
+      quantity_(quantity),
+      balance_(quantity),
+      price_(0),
+      side_(buy),
+      client_sequence_(0),
+      session_id_(conn_info ? conn_info->session_id_ : 0),
+      sequence_(0),
+      session_prev_(NULL),
+      session_next_(NULL),
+      session_(conn_info ? conn_info->handle_ : 0) {
+      ::memset(stock_,  '\0', sizeof(stock_));
+      ::memset(trader_, '\0', sizeof(trader_));
+    }
+
+    //##########################################################################
+    /// Type Accessor
+    ///
+    /// @param[inout]  none
+    /// @param[in]     none
+    /// @return        type
+    /// @throws        none
+    //##########################################################################
+    type_t type() const { return type_; }
+
+    //##########################################################################
+    /// Order Id Accessor
+    ///
+    /// @param[inout]  none
+    /// @param[in]     none
+    /// @return        order id, 0 until assigned by the order manager
+    /// @throws        none
+    //##########################################################################
+    boost::uint64_t order_id() const { return order_id_; }
 
     //##########################################################################
     /// Stock Accessor
@@ -98,7 +210,17 @@ namespace trading {
     /// @return        stock name
     /// @throws        none
     //##########################################################################
-    const std::string& stock() const { return stock_; }
+    const char* stock() const { return stock_; }
+
+    //##########################################################################
+    /// Symbol Id Accessor
+    ///
+    /// @param[inout]  none
+    /// @param[in]     none
+    /// @return        symbol id
+    /// @throws        none
+    //##########################################################################
+    boost::uint32_t symbol_id() const { return symbol_id_; }
 
     //##########################################################################
     /// Trader Accessor
@@ -108,7 +230,7 @@ namespace trading {
     /// @return        trader name
     /// @throws        none
     //##########################################################################
-    const std::string& trader() const { return trader_; }
+    const char* trader() const { return trader_; }
 
     //##########################################################################
     /// Trader Id Accessor
@@ -140,6 +262,16 @@ namespace trading {
     //##########################################################################
     const int balance() const { return balance_; }
 
+    //##########################################################################
+    /// Price Accessor
+    ///
+    /// @param[inout]  none
+    /// @param[in]     none
+    /// @return        limit price in ticks
+    /// @throws        none
+    //##########################################################################
+    const int price() const { return price_; }
+
     //##########################################################################
     /// Side Accessor
     ///
@@ -151,14 +283,102 @@ namespace trading {
     const side_t side() const { return side_; }
 
     //##########################################################################
-    /// Connection Info Accessor
+    /// Session Id Accessor
     ///
     /// @param[inout]  none
     /// @param[in]     none
-    /// @return        conn_info_t shared ptr obtained from member weak ptr
+    /// @return        session id of the connection the order was received on
     /// @throws        none
     //##########################################################################
-    conn_info_ptr conn_info() { return conn_info_.lock(); }
+    boost::uint64_t session_id() const { return session_id_; }
+
+    //##########################################################################
+    /// Sequence Accessor
+    ///
+    /// @param[inout]  none
+    /// @param[in]     none
+    /// @return        inbound sequence number, 0 if not assigned
+    /// @throws        none
+    //##########################################################################
+    boost::uint64_t sequence() const { return sequence_; }
+
+    //##########################################################################
+    /// Client Sequence Accessor
+    ///
+    /// @param[inout]  none
+    /// @param[in]     none
+    /// @return        sequence number of the client message that entered
+    ///                the order or request, 0 if none
+    /// @throws        none
+    //##########################################################################
+    boost::uint32_t client_sequence() const { return client_sequence_; }
+
+    //##########################################################################
+    /// Session Accessor
+    ///
+    /// @param[inout]  none
+    /// @param[in]     none
+    /// @return        handle of the session the order was received on, 0 if
+    ///                none
+    /// @throws        none
+    //##########################################################################
+    session_handle_t session() const { return session_; }
+
+    //##########################################################################
+    /// Same Session
+    ///
+    /// @param[inout]  none
+    /// @param[in]     other  order to compare with
+    /// @return        true if both orders were received on the same connection
+    /// @throws        none
+    //##########################################################################
+    bool same_session(const order_t& other) const {
+      return session_id_ == other.session_id_;
+    }
+
+    //##########################################################################
+    /// Order Id Mutator
+    ///
+    /// @param[inout]  none
+    /// @param[in]     order_id
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void order_id(boost::uint64_t order_id) { order_id_ = order_id; }
+
+    //##########################################################################
+    /// Session Id Mutator
+    ///
+    /// Restored orders have no connection but keep their session.
+    ///
+    /// @param[inout]  none
+    /// @param[in]     session_id
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void session_id(boost::uint64_t session_id) { session_id_ = session_id; }
+
+    //##########################################################################
+    /// Sequence Mutator
+    ///
+    /// @param[inout]  none
+    /// @param[in]     sequence  inbound sequence number
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void sequence(boost::uint64_t sequence) { sequence_ = sequence; }
+
+    //##########################################################################
+    /// Client Sequence Mutator
+    ///
+    /// @param[inout]  none
+    /// @param[in]     sequence  client message sequence number
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void client_sequence(boost::uint32_t sequence) {
+      client_sequence_ = sequence;
+    }
 
     //##########################################################################
     /// Stock Mutator
@@ -168,7 +388,11 @@ namespace trading {
     /// @return        none
     /// @throws        none
     //##########################################################################
-    void stock(const std::string& stock) { stock_ = stock; }
+    void stock(const char* stock) {
+      size_t n = ::strnlen(stock, sizeof(stock_) - 1);
+      ::memcpy(stock_, stock, n);
+      ::memset(stock_ + n, '\0', sizeof(stock_) - n);
+    }
 
     //##########################################################################
     /// Trader Mutator
@@ -178,7 +402,11 @@ namespace trading {
     /// @return        none
     /// @throws        none
     //##########################################################################
-    void trader(const std::string& trader) { trader_ = trader; }
+    void trader(const char* trader) {
+      size_t n = ::strnlen(trader, sizeof(trader_) - 1);
+      ::memcpy(trader_, trader, n);
+      ::memset(trader_ + n, '\0', sizeof(trader_) - n);
+    }
 
     //##########################################################################
     /// Quantity Mutator
@@ -200,6 +428,16 @@ namespace trading {
     //##########################################################################
     void balance(int balance) { balance_ = balance; }
 
+    //##########################################################################
+    /// Price Mutator
+    ///
+    /// @param[inout]  none
+    /// @param[in]     price  limit price in ticks
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void price(int price) { price_ = price; }
+
     //##########################################################################
     /// Side Mutator
     ///
@@ -223,140 +461,772 @@ namespace trading {
     /// @throws               none
     //##########################################################################
     friend std::ostream& operator<<(std::ostream& os, const order_ptr& order);
-    friend struct balance_updater_t;
+    friend class order_book_t;
+    friend class order_manager_t;
 
-    std::string     stock_;
-    std::string     trader_;
+    type_t          type_;
+    boost::uint64_t order_id_;
+    boost::uint32_t entry_;      /// slab entry in the book while resting
+    char            stock_[stock_size];
+    char            trader_[trader_size];
+    boost::uint32_t symbol_id_;
     int             trader_id_;
     int             quantity_;
     int             balance_;
+    int             price_;
     side_t          side_;
-    conn_info_wptr  conn_info_;
+    boost::uint32_t client_sequence_;  /// echoed in reports (ref)
+    boost::uint64_t session_id_;
+    boost::uint64_t sequence_;
+    order_ptr       session_prev_;  /// session list links while resting
+    order_ptr       session_next_;  /// (cancel on disconnect only)
+    session_handle_t session_;     /// (see session_table_t)
   };
 
-  //############################################################################
-  /// STRUCT: Balance Updater
-  //############################################################################
-  struct balance_updater_t {
+  //###########################################################################
+  /// STRUCT: Execution Report
+  ///
+  /// Fixed size record of one event on one order, emitted by the matching
+  /// path while it runs and drained by the send path afterwards. The
+  /// record carries everything the client needs, so later events in the
+  /// same batch can change the order without changing earlier reports.
+  ///
+  /// A trade produces two fill reports, one per side, each naming the other
+  /// side as contra. For fills quantity_ and price_ are the traded amount
+  /// and price; for every other report they are the order's quantity and
+  /// limit price. order_ identifies the session to report to.
+  //###########################################################################
+  struct report_t {
 
-    balance_updater_t(int balance) :
-      balance_(balance)
-    {}
+    /// Report Type
+    enum type_t {
+      ack,
+      fill,
+      cancelled,
+      amended,
+      rejected
+    };
 
-    void operator()(order_ptr& order) {
-      order->balance_ = balance_;
+    boost::uint64_t  sequence_;   /// report sequence number of the shard
+    boost::uint64_t  order_id_;   /// reported order
+    boost::uint64_t  contra_id_;  /// order traded against, 0 unless a fill
+    order_ptr        order_;      /// reported order or rejected request
+    boost::uint32_t  symbol_id_;  /// symbol id of the order
+    boost::int32_t   type_;       /// type_t
+    boost::int32_t   quantity_;   /// fill quantity or order quantity
+    boost::int32_t   balance_;    /// open balance after the event
+    boost::int32_t   price_;      /// fill price or limit price
+  };
+
+  //###########################################################################
+  /// Operator<< (report_t)
+  ///
+  /// @param[inout]  os      output stream
+  /// @param[in]     report  execution report
+  /// @return                updated output stream
+  /// @throws                none
+  //###########################################################################
+  std::ostream& operator<<(std::ostream& os, const report_t& report);
+
+  //###########################################################################
+  /// CLASS: Report Ring
+  ///
+  /// Preallocated ring of execution reports owned by one processor thread.
+  /// The matching path pushes at the tail while it runs and the send path
+  /// pops from the head once the batch is matched. Pushing stamps the next
+  /// sequence number. A batch that produces more reports than fit doubles
+  /// the ring, so once the ring has grown to its working size reporting
+  /// does no heap allocation.
+  //###########################################################################
+  class report_ring_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// @param[in]  capacity  initial capacity, rounded up to a power of two
+    /// @return               none
+    /// @throws               none
+    //##########################################################################
+    explicit report_ring_t(size_t capacity = 4096) :
+      head_(0),
+      tail_(0),
+      sequence_(0) {
+      size_t n = 16;
+      while (n < capacity)
+        n <<= 1;
+      ring_.resize(n);
+    }
+
+    //##########################################################################
+    /// Push
+    ///
+    /// Appends a report of the order's current state; the caller adjusts
+    /// the fill fields through the returned reference.
+    ///
+    /// @param[in]  type   report type
+    /// @param[in]  order  reported order
+    /// @return            the new report
+    /// @throws            none
+    //##########################################################################
+    report_t& push(report_t::type_t type, const order_ptr& order);
+
+    //##########################################################################
+    /// Front
+    ///
+    /// @param   none
+    /// @return  oldest report, the ring must not be empty
+    /// @throws  none
+    //##########################################################################
+    const report_t& front() const { return ring_[head_ & (ring_.size() - 1)]; }
+
+    //##########################################################################
+    /// Pop Front
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    void pop_front() { ++head_; }
+
+    //##########################################################################
+    /// Operator[]
+    ///
+    /// @param[in]  i  position from the oldest report
+    /// @return        report
+    /// @throws        none
+    //##########################################################################
+    const report_t& operator[](size_t i) const {
+      return ring_[(head_ + i) & (ring_.size() - 1)];
     }
-    int balance_;
+
+    //##########################################################################
+    /// Size Accessor
+    ///
+    /// @param   none
+    /// @return  number of reports not yet popped
+    /// @throws  none
+    //##########################################################################
+    size_t size() const { return tail_ - head_; }
+
+    //##########################################################################
+    /// Empty Accessor
+    ///
+    /// @param   none
+    /// @return  true if every report was popped
+    /// @throws  none
+    //##########################################################################
+    bool empty() const { return head_ == tail_; }
+
+  private:
+
+    std::vector<report_t>  ring_;      /// power of two sized ring
+    size_t                 head_;      /// position of the oldest report
+    size_t                 tail_;      /// position of the next report
+    boost::uint64_t        sequence_;  /// sequence of the last report
   };
 
   //############################################################################
-  /// Multi-index container tag names
+  /// Push (report_ring_t)
   //############################################################################
-  struct STOCK_SIDE_INDEX {};
-  struct STOCK_INDEX      {};
-  struct TRADER_INDEX     {};
+  inline report_t& report_ring_t::push(report_t::type_t type,
+                                       const order_ptr& order) {
+
+    /// full: double and unwrap the live reports to the front
+    if (tail_ - head_ == ring_.size()) {
+      std::vector<report_t> ring(ring_.size() * 2);
+      for (size_t i = 0; i < size(); ++i)
+        ring[i] = (*this)[i];
+      ring_.swap(ring);
+      tail_ -= head_;
+      head_ = 0;
+    }
+    report_t& r = ring_[tail_++ & (ring_.size() - 1)];
+    r.sequence_ = ++sequence_;
+    r.order_id_ = order->order_id();
+    r.contra_id_ = 0;
+    r.order_ = order;
+    r.symbol_id_ = order->symbol_id();
+    r.type_ = type;
+    r.quantity_ = order->quantity();
+    r.balance_ = order->balance();
+    r.price_ = order->price();
+    return r;
+  }
 
   //############################################################################
-  /// Order table
+  /// CLASS: Order Book
+  ///
+  /// Book of open orders for a single stock. A book is owned by exactly one
+  /// order manager (and therefore one processor thread) so it is not thread
+  /// safe and needs no synchronization.
   ///
-  /// Indexed by:
-  /// - STOCK_SIDE_INDEX - composite key comprised of stock and side (buy|sell)
-  /// - STOCK_INDEX      - stock index  keyed by stock  name
-  /// - TRADER_INDEX     - trader index keyed by trader name
+  /// The book is a price ladder: an array of price levels indexed by the
+  /// tick offset of a price from the book's base price. Each level is a
+  /// doubly linked FIFO of open orders threaded by index through a slab of
+  /// fixed-size entries that keep the open balance inline next to the order
+  /// pointer; entries of filled orders go onto a free list for reuse. The
+  /// book never stays crossed, so a level holds either bids or asks. An
+  /// order remembers its slab entry while resting, so cancel and amend
+  /// unlink it in O(1).
+  ///
+  /// Best bid and best ask are tracked as level offsets, which makes finding
+  /// the best price and inserting at a level O(1). When a best level empties
+  /// the next one is found through a bitmap of non-empty levels, 64 levels
+  /// per word.
+  ///
+  /// The ladder is allocated on the first order. Whenever the book is empty
+  /// it is centered on the reference price, the price of the book's last
+  /// trade, or on the next order's price before the book's first trade; a
+  /// single order can thus only move the ladder of a book that never
+  /// traded, and only while it rests. Orders priced outside the ladder,
+  /// and prices not in [1, INT_MAX - levels], are rejected.
   //############################################################################
-  typedef mti::multi_index_container<
-    order_ptr,
-    mti::indexed_by<
-      mti::ordered_non_unique<
-        mti::tag<STOCK_SIDE_INDEX>,
-        mti::composite_key<
-          order_ptr,
-          mti::const_mem_fun<
-            order_t,
-            const std::string&,
-            &order_t::stock
-          >,
-          mti::const_mem_fun<
-            order_t,
-            const order_t::side_t,
-            &order_t::side
-          >
-        >
-      >,
-      mti::ordered_non_unique<
-        mti::tag<STOCK_INDEX>,
-        mti::const_mem_fun<
-          order_t,
-          const std::string&,
-          &order_t::stock
-        >
-      >,
-      mti::ordered_non_unique<
-        mti::tag<TRADER_INDEX>,
-        mti::const_mem_fun<
-          order_t,
-          const std::string&,
-          &order_t::trader
-        >
-      >
-    >
-  > order_table_t;
+  class order_book_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// Initializes an empty book; the ladder itself is allocated lazily.
+    ///
+    /// @param[in]  nlevels  number of price levels (ticks) in the ladder
+    /// @return              none
+    /// @throws              none
+    //##########################################################################
+    explicit order_book_t(size_t nlevels = 4096);
+
+    //##########################################################################
+    /// Process Order
+    ///
+    /// - Map the limit price onto its level; reject it if off the ladder or
+    ///   out of range.
+    /// - Report the order as acknowledged.
+    /// - Sweep contra levels from the best price while they cross the limit
+    ///   price, each level in time priority, reporting a fill for both
+    ///   sides of every trade.
+    /// - If the balance on a resting order goes to zero, unlink it from its
+    ///   level; if the balance on the input order goes to zero, stop.
+    /// - If the input order was not filled after the sweep, append it to
+    ///   the tail of its price level and update the best price.
+    ///
+    /// @param[inout]  reports  ack and fill reports of the input order
+    /// @param[in]     order    input order for this book's stock
+    /// @return        false if the order was rejected (nothing reported)
+    /// @throws        none
+    //##########################################################################
+    bool process_order(order_ptr& order, report_ring_t& reports);
+
+    //##########################################################################
+    /// Cancel
+    ///
+    /// Unlinks a resting order from its level and clears its balance.
+    ///
+    /// @param[in]  order  order resting in this book
+    /// @return            none
+    /// @throws            none
+    //##########################################################################
+    void cancel(order_ptr order);
+
+    //##########################################################################
+    /// Amend
+    ///
+    /// Changes the quantity of a resting order. The filled amount is kept,
+    /// so the new balance is the new quantity less what already traded; if
+    /// that leaves nothing open the order is cancelled. Reducing the
+    /// quantity keeps time priority, increasing it moves the order to the
+    /// tail of its level.
+    ///
+    /// @param[in]  order     order resting in this book
+    /// @param[in]  quantity  new order quantity
+    /// @return               none
+    /// @throws               none
+    //##########################################################################
+    void amend(order_ptr order, int quantity);
+
+    //##########################################################################
+    /// Restore
+    ///
+    /// Appends an order from a snapshot to the tail of its price level
+    /// without matching; orders must be restored in price-time order and
+    /// must not cross the book. A book not anchored (see anchor()) is
+    /// centered on the first order restored.
+    ///
+    /// @param[in]  order  resting order with its open balance
+    /// @return            false if the order is priced off the ladder
+    /// @throws            none
+    //##########################################################################
+    bool restore(const order_ptr& order);
+
+    //##########################################################################
+    /// Orders
+    ///
+    /// Appends the resting orders in price-time order, bids from the best
+    /// price down, then asks from the best price up.
+    ///
+    /// @param[inout]  orders  resting orders
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void orders(orders_t& orders) const;
+
+    //##########################################################################
+    /// Anchor
+    ///
+    /// Allocates the ladder at a snapshot's base price and restores the
+    /// reference price, before the snapshot's orders are restored. The
+    /// book must be empty.
+    ///
+    /// @param[in]  base       price of level 0
+    /// @param[in]  reference  price of the last trade, 0 if none
+    /// @return                none
+    /// @throws                none
+    //##########################################################################
+    void anchor(int base, int reference);
+
+    //##########################################################################
+    /// Base Accessor
+    ///
+    /// @param   none
+    /// @return  price of level 0 of the ladder
+    /// @throws  none
+    //##########################################################################
+    int base() const { return base_; }
+
+    //##########################################################################
+    /// Reference Accessor
+    ///
+    /// @param   none
+    /// @return  price of the last trade, 0 before the first trade
+    /// @throws  none
+    //##########################################################################
+    int reference() const { return reference_; }
+
+    //##########################################################################
+    /// Sequence Accessor
+    ///
+    /// @param   none
+    /// @return  sequence number of the last message applied to the book
+    /// @throws  none
+    //##########################################################################
+    boost::uint64_t sequence() const { return sequence_; }
+
+    //##########################################################################
+    /// Sequence Mutator
+    ///
+    /// @param[in]  sequence  sequence number of a message applied to the book
+    /// @return               none
+    /// @throws               none
+    //##########################################################################
+    void sequence(boost::uint64_t sequence) { sequence_ = sequence; }
+
+  private:
+
+    /// slab index; npos terminates a level FIFO or the free list
+    typedef boost::uint32_t index_t;
+    enum { npos = 0xffffffff };
+
+    //##########################################################################
+    /// STRUCT: Entry
+    ///
+    /// Slab entry of an open order.
+    //##########################################################################
+    struct entry_t {
+      int        balance_;  /// open balance, authoritative while resting
+      int        level_;    /// price level the entry is linked into
+      index_t    prev_;     /// previous entry in the level FIFO
+      index_t    next_;     /// next entry in the level FIFO or free list
+      order_ptr  order_;    /// order, used to report fills
+    };
+
+    //##########################################################################
+    /// STRUCT: Level
+    ///
+    /// Head and tail of one price level's intrusive FIFO.
+    //##########################################################################
+    struct level_t {
+      index_t head_;
+      index_t tail_;
+    };
+
+    //##########################################################################
+    /// Recenter
+    ///
+    /// Allocates the ladder if needed and moves the base price so that the
+    /// input price sits in the middle. The book must be empty.
+    ///
+    /// @param[in]  price  price to center on
+    /// @return            none
+    /// @throws            none
+    //##########################################################################
+    void recenter(int price);
+
+    //##########################################################################
+    /// Fill
+    ///
+    /// Fills the input balance against the level in time priority.
+    ///
+    /// @param[inout]  reports  fill reports of both sides
+    /// @param[in]     level    contra level
+    /// @param[in]     order    input order
+    /// @param[in]     balance  open balance of the input order
+    /// @return                 remaining balance of the input order
+    /// @throws                 none
+    //##########################################################################
+    int fill(int level, const order_ptr& order, int balance,
+             report_ring_t& reports);
+
+    //##########################################################################
+    /// Push Back
+    ///
+    /// Takes an entry off the free list (or grows the slab) and appends it
+    /// to the tail of the level.
+    ///
+    /// @param[in]  level    price level
+    /// @param[in]  order    order to rest in the book
+    /// @param[in]  balance  open balance of the order
+    /// @return              none
+    /// @throws              none
+    //##########################################################################
+    void push_back(int level, const order_ptr& order, int balance);
+
+    //##########################################################################
+    /// Unlink
+    ///
+    /// Unlinks an entry from its level and returns it to the free list. The
+    /// caller is responsible for moving the best price off an emptied level.
+    ///
+    /// @param[in]  ndx  slab index of a linked entry
+    /// @return          none
+    /// @throws          none
+    //##########################################################################
+    void unlink(index_t ndx);
+
+    //##########################################################################
+    /// Update Best
+    ///
+    /// Moves the best bid or ask off the level if it has become empty.
+    ///
+    /// @param[in]  level  price level
+    /// @return            none
+    /// @throws            none
+    //##########################################################################
+    void update_best(int level);
+
+    //##########################################################################
+    /// Next Ask
+    ///
+    /// @param[in]  from  first level to consider
+    /// @return           lowest non-empty level >= from, nlevels_ if none
+    /// @throws           none
+    //##########################################################################
+    int next_ask(int from) const;
+
+    //##########################################################################
+    /// Next Bid
+    ///
+    /// @param[in]  from  first level to consider
+    /// @return           highest non-empty level <= from, -1 if none
+    /// @throws           none
+    //##########################################################################
+    int next_bid(int from) const;
+
+    //##########################################################################
+    /// Operator<< (order_book_t)
+    ///
+    /// @param[inout]  os    output stream
+    /// @param[in]     book  order book
+    /// @return              updated output stream
+    /// @throws              none
+    //##########################################################################
+    friend std::ostream& operator<<(std::ostream& os, const order_book_t& book);
+
+    int                           nlevels_;   /// levels in the ladder
+    int                           base_;      /// price of level 0
+    int                           reference_; /// last trade price, 0 if none
+    int                           best_bid_;  /// best bid level, -1 if none
+    int                           best_ask_;  /// best ask level, nlevels_
+                                              /// if none
+    std::vector<level_t>          levels_;    /// price ladder
+    std::vector<boost::uint64_t>  occupied_;  /// bitmap of non-empty levels
+    std::vector<entry_t>          slab_;      /// entries of all open orders
+    index_t                       free_;      /// head of the free entry list
+    boost::uint64_t               sequence_;  /// last applied message
+  };
 
   //############################################################################
-  /// Shortened index typedefs
+  /// CLASS: Order Index
+  ///
+  /// Maps order ids of resting orders onto the orders. Open addressing with
+  /// linear probing over a power of two table; ids are spread with
+  /// fibonacci hashing and removal shifts the following probe run back
+  /// instead of leaving tombstones, so lookups stay O(1) under heavy
+  /// cancel/replace churn. The table doubles when it becomes half full.
+  /// Id 0 marks an empty slot.
   //############################################################################
-  typedef order_table_t::index<STOCK_SIDE_INDEX>::type  stock_side_index_t;
-  typedef order_table_t::index<STOCK_INDEX>::type       stock_index_t;
-  typedef order_table_t::index<TRADER_INDEX>::type      trader_index_t;
-  typedef std::pair<stock_side_index_t::iterator,
-                    stock_side_index_t::iterator> ssi_index_iterator_pair_t;
+  class order_index_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// @param[in]  capacity  expected number of resting orders
+    /// @return               none
+    /// @throws               none
+    //##########################################################################
+    explicit order_index_t(size_t capacity = 1024);
+
+    //##########################################################################
+    /// Insert
+    ///
+    /// @param[in]  order  resting order, keyed by its (unique) order id
+    /// @return            none
+    /// @throws            none
+    //##########################################################################
+    void insert(order_ptr order);
+
+    //##########################################################################
+    /// Find
+    ///
+    /// @param[in]  order_id  order id
+    /// @return               resting order, NULL if unknown
+    /// @throws               none
+    //##########################################################################
+    order_ptr find(boost::uint64_t order_id) const;
+
+    //##########################################################################
+    /// Erase
+    ///
+    /// @param[in]  order_id  order id, ignored if unknown
+    /// @return               none
+    /// @throws               none
+    //##########################################################################
+    void erase(boost::uint64_t order_id);
+
+    //##########################################################################
+    /// Size Accessor
+    ///
+    /// @param   none
+    /// @return  number of indexed orders
+    /// @throws  none
+    //##########################################################################
+    size_t size() const { return size_; }
+
+  private:
+
+    //##########################################################################
+    /// Slot
+    ///
+    /// @param[in]  order_id  order id
+    /// @return               home slot of the id
+    /// @throws               none
+    //##########################################################################
+    size_t slot(boost::uint64_t order_id) const {
+      return static_cast<size_t>(
+        (order_id * 0x9E3779B97F4A7C15ULL) >> (64 - bits_));
+    }
+
+    //##########################################################################
+    /// Grow
+    ///
+    /// Doubles the table and reinserts every order.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    void grow();
+
+    //##########################################################################
+    /// STRUCT: Slot
+    //##########################################################################
+    struct slot_t {
+      boost::uint64_t  order_id_;  /// 0 while empty
+      order_ptr        order_;
+    };
+
+    std::vector<slot_t>  slots_;  /// open addressing table
+    size_t               bits_;   /// log2 of the table size
+    size_t               mask_;   /// table size - 1
+    size_t               size_;   /// number of indexed orders
+  };
 
   //############################################################################
   /// CLASS: Order Manager
   ///
-  /// Rudimentary order manager; contains the order table and has an interface
-  /// method to accept and process an order.
+  /// Rudimentary order manager; contains one order book per stock and has an
+  /// interface method to accept and process an order. Books live in a flat
+  /// array indexed by the symbol id of their stock.
+  ///
+  /// The order manager is not thread safe. The socket server shards stocks
+  /// across processor threads and gives each processor its own order manager,
+  /// so every book is only ever touched by its owning thread.
+  ///
+  /// Each manager assigns ids to the new orders it accepts: the first id is
+  /// id_base + id_stride and every further id adds id_stride. Giving shard k
+  /// of n the base k and the stride n keeps ids unique across shards and
+  /// lets cancel and amend requests be routed by order id modulo n. Resting
+  /// orders are found by id through an order index, without a book scan.
   //############################################################################
   class order_manager_t {
   public:
 
+    //##########################################################################
+    /// Constructor
+    ///
+    /// Preallocates books for symbol ids in [0, nsymbols); the book array
+    /// grows on demand for larger ids.
+    ///
+    /// @param[in]  nsymbols   number of symbol ids
+    /// @param[in]  nlevels    number of price levels per book
+    /// @param[in]  norders    expected number of resting orders
+    /// @param[in]  id_base    order id base
+    /// @param[in]  id_stride  order id increment
+    /// @param[in]  nsessions  session table slots; if not 0, resting
+    ///                        orders are kept on per session lists so
+    ///                        disconnect requests can cancel them
+    /// @return                none
+    /// @throws                none
+    //##########################################################################
+    explicit order_manager_t(size_t nsymbols = 0,
+                             size_t nlevels = 4096,
+                             size_t norders = 1024,
+                             boost::uint64_t id_base = 0,
+                             boost::uint64_t id_stride = 1,
+                             size_t nsessions = 0) :
+      nlevels_(nlevels),
+      next_id_(id_base + id_stride),
+      id_stride_(id_stride),
+      books_(nsymbols, order_book_t(nlevels)),
+      index_(norders),
+      track_sessions_(nsessions != 0),
+      sessions_(nsessions)
+    {}
+
     //##########################################################################
     /// Process Order
     ///
-    /// - Reverse the side on the input order.
-    /// - Locate the [stock, side] tuple in the order table.
-    /// - If not found, add the input order to the order table.
-    /// - Otherwise iterate over all open orders in an attempt to complete
-    ///   the input order.
-    /// - If the balance on an order in the table goes to zero, remove it
-    ///   from the order table and add to a notification list.
-    /// - If the balance on the input order goes to zero, add it to the
-    ///   notification list and stop the iteration.
-    /// - If the input order was not filled after the iteration, add it to
-    ///   the order table.
-    /// - Notify any updated orders (print to screen).
+    /// New order:
+    /// - Assign the next order id, unless the order was replayed from the
+    ///   journal with the id it was assigned then.
+    /// - Locate the order book indexed by the order's symbol id.
+    /// - Let the book match the order (see order_book_t::process_order).
+    /// - Index the order by id if it rests, drop filled orders from the
+    ///   index.
     ///
-    /// @param[inout]  none
-    /// @param[in]     trader
+    /// Cancel or amend request:
+    /// - Find the resting order by id; reject the request if it is unknown
+    ///   or was entered on another connection.
+    /// - Cancel or amend it in its book (see order_book_t::amend) and
+    ///   report it; a cancelled order leaves the index.
+    ///
+    /// Disconnect request:
+    /// - Cancel and report every resting order of the request's session,
+    ///   walking the session's list in O(k) for its k orders in this shard.
+    ///   Requires session tracking; otherwise the request is ignored.
+    ///   Orders and requests replayed from the journal or restored from a
+    ///   snapshot have no session handle; their orders are listed by
+    ///   session id instead.
+    ///
+    /// A rejected order or request is reported as rejected. Finally notify
+    /// the new reports (print to screen). Reported orders with a zero
+    /// balance are complete and no longer referenced by the order manager.
+    ///
+    /// Every book remembers the sequence number of the last message applied
+    /// to it; a message whose sequence number is not newer than its book's
+    /// was already applied before a snapshot and is rejected, so replaying
+    /// the journal over a snapshot is idempotent.
+    ///
+    /// @param[inout]  reports  reports of the input order
+    /// @param[in]     order    input order or request
+    /// @return        false if the order or request was rejected
+    /// @throws        none
+    //##########################################################################
+    bool process_order(order_ptr& order, report_ring_t& reports);
+
+    //##########################################################################
+    /// Process Orders
+    ///
+    /// Matches a batch of orders and requests in arrival order, exactly as
+    /// calling process_order() for each of them would, and notifies once
+    /// for the whole batch.
+    ///
+    /// @param[inout]  reports  reports of the batch (see report_t)
+    /// @param[in]     orders   first input order or request
+    /// @param[in]     count    number of input orders
     /// @return        none
     /// @throws        none
     //##########################################################################
-    void process_order(order_ptr& order, orders_t& to_notify);
+    void process_orders(order_ptr* orders, size_t count,
+                        report_ring_t& reports);
+
+    //##########################################################################
+    /// Restore
+    ///
+    /// Puts a resting order from a snapshot back into its book and the
+    /// order index without matching it (see order_book_t::restore).
+    ///
+    /// @param[in]  order  resting order with its order id and balance
+    /// @return            false if the book rejected the order
+    /// @throws            none
+    //##########################################################################
+    bool restore(const order_ptr& order);
+
+    //##########################################################################
+    /// Books Accessor
+    ///
+    /// @param   none
+    /// @return  number of books (one past the highest symbol id seen)
+    /// @throws  none
+    //##########################################################################
+    size_t books() const { return books_.size(); }
+
+    //##########################################################################
+    /// Book Accessor
+    ///
+    /// @param[in]  symbol_id  symbol id, grows the book array if needed
+    /// @return                book of the symbol
+    /// @throws                none
+    //##########################################################################
+    order_book_t& book(boost::uint32_t symbol_id);
+
+    //##########################################################################
+    /// Next Id Accessor
+    ///
+    /// @param   none
+    /// @return  id of the next new order
+    /// @throws  none
+    //##########################################################################
+    boost::uint64_t next_id() const { return next_id_; }
+
+    //##########################################################################
+    /// Next Id Mutator
+    ///
+    /// Moves the next id forward to id, never backwards.
+    ///
+    /// @param[in]  id  lowest id the next new order may get
+    /// @return         none
+    /// @throws         none
+    //##########################################################################
+    void next_id(boost::uint64_t id) {
+      if (id > next_id_)
+        next_id_ = id;
+    }
 
   private:
 
     //##########################################################################
     /// Notify
     ///
-    /// Just print the list of updated orders. @todo: in a full application
-    /// must send messages to the client program.
+    /// Just print the reports from first on; the processor thread sends
+    /// them to the clients.
     ///
-    /// @param[inout]  none
-    /// @param[in]     trader
-    /// @return        none
-    /// @throws        none
+    /// @param[in]  reports  report ring
+    /// @param[in]  first    position of the first new report
+    /// @return              none
+    /// @throws              none
     //##########################################################################
-    void notify(const orders_t& orders);
+    void notify(const report_ring_t& reports, size_t first);
 
     //##########################################################################
     /// Operator<< (order_manager_t)
@@ -368,8 +1238,116 @@ namespace trading {
     //##########################################################################
     friend std::ostream& operator<<(std::ostream& os, const order_manager_t& om);
 
-    order_table_t orders_;
-    boost::mutex  mutex_;
+    /// order books indexed by symbol id
+    typedef std::vector<order_book_t> books_t;
+
+    //##########################################################################
+    /// Process Request
+    ///
+    /// Applies a cancel or amend request to the resting order it names.
+    ///
+    /// @param[inout]  reports  report of the updated resting order
+    /// @param[in]     request  cancel or amend request
+    /// @return        false if the request was rejected
+    /// @throws        none
+    //##########################################################################
+    bool process_request(const order_ptr& request, report_ring_t& reports);
+
+    //##########################################################################
+    /// Match
+    ///
+    /// Body of process_order() without tracing and notification.
+    ///
+    /// @param[inout]  reports  reports of the input order
+    /// @param[in]     order    input order or request
+    /// @return        false if the order or request was rejected
+    /// @throws        none
+    //##########################################################################
+    bool match(order_ptr& order, report_ring_t& reports);
+
+    //##########################################################################
+    /// Rest
+    ///
+    /// Indexes an order that rests in its book by id and, when tracking
+    /// sessions, links it at the head of its session's list.
+    ///
+    /// @param[in]  order  resting order
+    /// @return            none
+    /// @throws            none
+    //##########################################################################
+    void rest(const order_ptr& order);
+
+    //##########################################################################
+    /// Retire
+    ///
+    /// Drops an order that left its book from the index and its session
+    /// list.
+    ///
+    /// @param[in]  order  order that no longer rests
+    /// @return            none
+    /// @throws            none
+    //##########################################################################
+    void retire(const order_ptr& order);
+
+    //##########################################################################
+    /// Cancel Session
+    ///
+    /// Cancels and reports every resting order of a session in this shard.
+    ///
+    /// @param[inout]  reports  cancelled reports
+    /// @param[in]     request  disconnect request of the session
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void cancel_session(const order_t& request, report_ring_t& reports);
+
+    //##########################################################################
+    /// Session List
+    ///
+    /// @param[in]  order  order or request
+    /// @return            head of the list of the order's session: by slot
+    ///                    of its session handle, by session id for
+    ///                    recovered orders with handle 0
+    /// @throws            none
+    //##########################################################################
+    order_ptr& session_list(const order_t& order) {
+      boost::uint32_t slot = static_cast<boost::uint32_t>(order.session());
+      return order.session() && slot < sessions_.size() ?
+        sessions_[slot] : recovered_[order.session_id_];
+    }
+
+    //##########################################################################
+    /// Applied
+    ///
+    /// @param[in]  book   book the message applies to
+    /// @param[in]  order  inbound order or request
+    /// @return            true if the message is not newer than the book,
+    ///                    i.e. it was applied before a snapshot was taken
+    /// @throws            none
+    //##########################################################################
+    bool applied(const order_book_t& book, const order_t& order) const;
+
+    ////////
+    /// head of each session's list of resting orders, by slot of the
+    /// session handle; a slot's list is emptied by the disconnect request
+    /// of its session before orders of the slot's next session arrive
+    ////////
+    typedef std::vector<order_ptr> sessions_t;
+
+    ////////
+    /// head of each recovered session's list of resting orders, by session
+    /// id; only used while restoring, the sessions are gone after a restart
+    ////////
+    typedef std::map<boost::uint64_t, order_ptr> recovered_t;
+
+    size_t           nlevels_;    /// price levels per book
+    boost::uint64_t  next_id_;    /// id of the next new order
+    boost::uint64_t  id_stride_;  /// order id increment
+    books_t          books_;      /// books indexed by symbol id
+    order_index_t    index_;      /// resting orders by order id
+    bool             track_sessions_;  /// keep per session order lists
+    sessions_t       sessions_;   /// resting orders by session slot
+    recovered_t      recovered_;  /// resting orders without a session handle
   };
 
 }  /// namespace trading
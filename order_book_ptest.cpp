@@ -0,0 +1,238 @@
+#include <order.hpp>
+#include <tracer.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <time.h>
+#include <stdlib.h>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/composite_key.hpp>
+
+//##############################################################################
+/// Price ladder book vs. multi_index book benchmark.
+///
+/// Feeds the same random limit order flow through order_manager_t (price
+/// ladder books indexed by symbol id) and through a price-time book built
+/// on a boost::multi_index container like the original order_table_t,
+/// keyed by [stock, side, price, sequence]. Reports orders/sec for both
+/// and checks that both produced the same fills.
+//##############################################################################
+
+namespace mti = boost::multi_index;
+
+static const std::string stocks[] =
+{
+  "DEL",
+  "IBM",
+  "SNY",
+  "BBG",
+  "MSN",
+  "AAPL",
+  "MSFT",
+  "GOOG"
+};
+static const size_t nstocks = sizeof(stocks)/sizeof(std::string);
+
+//##############################################################################
+/// STRUCT: Legacy Entry
+///
+/// Open order in the multi_index book. Priority is the price for asks and
+/// the negated price for bids so that the first entry of a [stock, side]
+/// range is always the best price, oldest first.
+//##############################################################################
+struct legacy_entry_t {
+  std::string         stock_;
+  int                 side_;
+  int                 priority_;
+  size_t              seq_;
+  mutable int         balance_;
+  trading::order_ptr  order_;
+};
+
+typedef mti::multi_index_container<
+  legacy_entry_t,
+  mti::indexed_by<
+    mti::ordered_non_unique<
+      mti::composite_key<
+        legacy_entry_t,
+        mti::member<legacy_entry_t, std::string, &legacy_entry_t::stock_>,
+        mti::member<legacy_entry_t, int, &legacy_entry_t::side_>,
+        mti::member<legacy_entry_t, int, &legacy_entry_t::priority_>,
+        mti::member<legacy_entry_t, size_t, &legacy_entry_t::seq_>
+      >
+    >
+  >
+> legacy_table_t;
+
+//##############################################################################
+/// CLASS: Legacy Book
+///
+/// Price-time matching over the multi_index table.
+//##############################################################################
+class legacy_book_t {
+public:
+
+  legacy_book_t() : seq_(0) {}
+
+  void process_order(trading::order_ptr& order, trading::orders_t& to_notify) {
+
+    int contra = order->side() == trading::order_t::buy ? 1 : 0;
+    int balance = order->balance();
+
+    while (balance > 0) {
+      legacy_table_t::iterator i =
+        table_.lower_bound(boost::make_tuple(order->stock(), contra));
+      if (i == table_.end() || i->stock_ != order->stock() ||
+          i->side_ != contra)
+        break;
+
+      /// stop once the best contra price no longer crosses
+      int price = i->order_->price();
+      if (contra == 1 ? price > order->price() : price < order->price())
+        break;
+
+      if (i->balance_ <= balance) {
+        balance -= i->balance_;
+        i->order_->balance(0);
+        to_notify.push_back(i->order_);
+        table_.erase(i);
+      }
+      else {
+        i->balance_ -= balance;
+        i->order_->balance(i->balance_);
+        balance = 0;
+      }
+    }
+    order->balance(balance);
+    if (balance == 0) {
+      to_notify.push_back(order);
+      return;
+    }
+    legacy_entry_t e;
+    e.stock_ = order->stock();
+    e.side_ = order->side();
+    e.priority_ = e.side_ == 0 ? -order->price() : order->price();
+    e.seq_ = seq_++;
+    e.balance_ = balance;
+    e.order_ = order;
+    table_.insert(e);
+  }
+
+private:
+  legacy_table_t table_;
+  size_t         seq_;
+};
+
+//##############################################################################
+/// Order Spec
+//##############################################################################
+struct spec_t {
+  size_t stock_;
+  int    quantity_;
+  int    price_;
+  int    side_;
+};
+
+static double now() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_orders(const std::vector<spec_t>& specs,
+                        std::vector<trading::order_t>& orders) {
+  orders.clear();
+  orders.reserve(specs.size());
+  const trading::conn_info_t* conn = NULL;
+  for (size_t i = 0; i < specs.size(); ++i) {
+    const spec_t& s = specs[i];
+    orders.push_back(trading::order_t(
+      stocks[s.stock_].c_str(), s.stock_, "bench", static_cast<int>(i),
+      s.quantity_, s.price_,
+      static_cast<trading::order_t::side_t>(s.side_), conn));
+  }
+}
+
+static size_t checksum(const trading::orders_t& to_notify, size_t sum) {
+  for (size_t i = 0; i < to_notify.size(); ++i)
+    sum = sum * 31 + to_notify[i]->trader_id();
+  return sum;
+}
+
+/// same checksum over the orders the reports complete; drains the ring
+static size_t checksum(trading::report_ring_t& reports, size_t sum) {
+  for (; ! reports.empty(); reports.pop_front()) {
+    const trading::report_t& r = reports.front();
+    if (r.type_ == trading::report_t::fill && r.balance_ == 0)
+      sum = sum * 31 + r.order_->trader_id();
+  }
+  return sum;
+}
+
+int main(int argc, const char** argv) {
+
+  if (argc < 2 || argc > 3) {
+    std::cout << "Usage: "
+              << argv[0]
+              << " <orders> [price spread in ticks]"
+              << std::endl;
+    return -1;
+  }
+  size_t norders = ::atoi(argv[1]);
+  int spread = argc == 3 ? ::atoi(argv[2]) : 40;
+  if (norders < 1 || norders > 10000000 || spread < 1) {
+    std::cout << "Orders must be between 1 and 10 million and the spread "
+              << "positive" << std::endl;
+    return -1;
+  }
+  trading::tracer_t::instance().disable();
+
+  /// random flow around a common price, same for both books
+  std::vector<spec_t> specs(norders);
+  ::srand(1);
+  for (size_t i = 0; i < norders; ++i) {
+    specs[i].stock_ = ::rand() % nstocks;
+    specs[i].quantity_ = 1 + ::rand() % 200;
+    specs[i].price_ = 1000 + ::rand() % spread - spread / 2;
+    specs[i].side_ = ::rand() % 2;
+  }
+  std::vector<trading::order_t> orders;
+  trading::orders_t to_notify;
+
+  /// price ladder
+  make_orders(specs, orders);
+  trading::order_manager_t om(nstocks);
+  trading::report_ring_t reports;
+  size_t ladder_sum = 0;
+  double start = now();
+  for (size_t i = 0; i < norders; ++i) {
+    trading::order_ptr order = &orders[i];
+    om.process_order(order, reports);
+    ladder_sum = checksum(reports, ladder_sum);
+  }
+  double ladder_secs = now() - start;
+
+  /// multi_index
+  make_orders(specs, orders);
+  legacy_book_t lb;
+  size_t legacy_sum = 0;
+  start = now();
+  for (size_t i = 0; i < norders; ++i) {
+    to_notify.clear();
+    trading::order_ptr order = &orders[i];
+    lb.process_order(order, to_notify);
+    legacy_sum = checksum(to_notify, legacy_sum);
+  }
+  double legacy_secs = now() - start;
+
+  std::cout << std::fixed << std::setprecision(0)
+            << "price ladder: " << norders / ladder_secs << " orders/sec"
+            << std::endl
+            << "multi_index:  " << norders / legacy_secs << " orders/sec"
+            << std::endl
+            << "fills " << (ladder_sum == legacy_sum ? "match" : "DIFFER")
+            << std::endl;
+  return ladder_sum == legacy_sum ? 0 : 1;
+}
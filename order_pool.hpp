@@ -0,0 +1,240 @@
+#ifndef __ORDER_POOL_HPP__
+#define __ORDER_POOL_HPP__
+
+#include <order.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+namespace trading {
+
+  //############################################################################
+  /// CLASS: Order Pool
+  ///
+  /// Fixed capacity, preallocated slab of orders. Reader threads allocate an
+  /// order per inbound message and processor threads release it once it is
+  /// filled or rejected, so steady state order flow does no heap allocation
+  /// and no allocator traffic crosses threads.
+  ///
+  /// Free orders are kept on a lock free stack threaded through a parallel
+  /// array of slab indices. The stack head packs a 32 bit tag next to the
+  /// index of the top order; every pop and push bumps the tag so a stale
+  /// compare-and-swap can't succeed after the same order was popped and
+  /// pushed back (ABA).
+  ///
+  /// The last reserve orders of the pool are kept for requests against
+  /// resting orders and for control requests: allocate() refuses new
+  /// orders once only the reserve is left, allocate_reserved() takes any
+  /// free order. Resting orders filling the pool then still leave room
+  /// for the cancels that drain it.
+  //############################################################################
+  class order_pool_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// Preallocates capacity orders and puts all of them on the free stack.
+    ///
+    /// @param[in]  capacity  number of orders in the pool
+    /// @param[in]  reserve   orders only allocate_reserved() may take
+    /// @return               none
+    /// @throws               std::string if capacity is zero or too large,
+    ///                       or the reserve is not below it
+    //##########################################################################
+    explicit order_pool_t(size_t capacity, size_t reserve = 0);
+
+    //##########################################################################
+    /// Allocate
+    ///
+    /// Allocates a new order, leaving the reserve alone.
+    ///
+    /// @param   none
+    /// @return  free order, NULL if only the reserve is left
+    /// @throws  none
+    //##########################################################################
+    order_ptr allocate() { return allocate(capacity_ - reserve_); }
+
+    //##########################################################################
+    /// Allocate Reserved
+    ///
+    /// Allocates a cancel, amend or control request, from the reserve if
+    /// need be.
+    ///
+    /// @param   none
+    /// @return  free order, NULL if the pool is exhausted
+    /// @throws  none
+    //##########################################################################
+    order_ptr allocate_reserved() { return allocate(capacity_); }
+
+    //##########################################################################
+    /// Release
+    ///
+    /// Returns an order obtained from allocate() to the pool.
+    ///
+    /// @param[in]  order  order to release
+    /// @return            none
+    /// @throws            none
+    //##########################################################################
+    void release(order_ptr order);
+
+    //##########################################################################
+    /// Capacity Accessor
+    ///
+    /// @param   none
+    /// @return  number of orders in the pool
+    /// @throws  none
+    //##########################################################################
+    size_t capacity() const { return capacity_; }
+
+    //##########################################################################
+    /// Reserve Accessor
+    ///
+    /// @param   none
+    /// @return  number of orders kept for allocate_reserved()
+    /// @throws  none
+    //##########################################################################
+    size_t reserve() const { return reserve_; }
+
+    //##########################################################################
+    /// In Use Accessor
+    ///
+    /// @param   none
+    /// @return  number of allocated orders (occupancy)
+    /// @throws  none
+    //##########################################################################
+    size_t in_use() const { return in_use_.load(boost::memory_order_relaxed); }
+
+    //##########################################################################
+    /// High Water Accessor
+    ///
+    /// @param   none
+    /// @return  highest number of orders allocated at the same time
+    /// @throws  none
+    //##########################################################################
+    size_t high_water() const {
+      return high_water_.load(boost::memory_order_relaxed);
+    }
+
+  private:
+
+    typedef boost::uint32_t index_t;
+    enum { npos = 0xffffffff };
+
+    //##########################################################################
+    /// Pack
+    ///
+    /// @param[in]  tag    ABA tag
+    /// @param[in]  index  slab index of the top of the stack
+    /// @return            stack head
+    /// @throws            none
+    //##########################################################################
+    static boost::uint64_t pack(boost::uint64_t tag, index_t index) {
+      return (tag << 32) | index;
+    }
+
+    //##########################################################################
+    /// Allocate
+    ///
+    /// @param[in]  limit  occupancy the allocation may bring the pool to
+    /// @return            free order, NULL if the limit is reached
+    /// @throws            none
+    //##########################################################################
+    order_ptr allocate(size_t limit);
+
+    size_t                                   capacity_;    /// pool size
+    size_t                                   reserve_;     /// for requests
+    boost::scoped_array<order_t>             orders_;      /// order slab
+    boost::scoped_array<boost::atomic<index_t> >
+                                             next_;        /// free stack links
+    boost::atomic<boost::uint64_t>           head_;        /// [tag, index]
+    boost::atomic<size_t>                    in_use_;      /// occupancy
+    boost::atomic<size_t>                    high_water_;  /// max occupancy
+  };
+
+  //############################################################################
+  /// Constructor
+  //############################################################################
+  inline order_pool_t::order_pool_t(size_t capacity, size_t reserve) :
+    capacity_(capacity),
+    reserve_(reserve),
+    in_use_(0),
+    high_water_(0) {
+
+    if (capacity == 0 || capacity >= npos) {
+      throw std::string("Invalid order pool capacity");
+    }
+    if (reserve >= capacity) {
+      throw std::string("Order pool reserve must be below its capacity");
+    }
+    orders_.reset(new order_t[capacity]);
+    next_.reset(new boost::atomic<index_t>[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+      next_[i].store(i + 1 < capacity ? index_t(i + 1) : index_t(npos),
+                     boost::memory_order_relaxed);
+    }
+    head_.store(pack(0, 0), boost::memory_order_release);
+  }
+
+  //############################################################################
+  /// Allocate
+  //############################################################################
+  inline order_ptr order_pool_t::allocate(size_t limit) {
+
+    ////////
+    /// claim the occupancy first, so racing allocations of new orders
+    /// can't take the reserve between them
+    ////////
+    size_t n = in_use_.load(boost::memory_order_relaxed);
+    do {
+      if (n >= limit)
+        return NULL;
+    } while (! in_use_.compare_exchange_weak(n, n + 1,
+                                             boost::memory_order_relaxed));
+    ++n;
+
+    boost::uint64_t head = head_.load(boost::memory_order_acquire);
+    index_t ndx;
+    for (;;) {
+      ndx = static_cast<index_t>(head);
+      if (ndx == npos) {
+        in_use_.fetch_sub(1, boost::memory_order_relaxed);
+        return NULL;
+      }
+      boost::uint64_t next =
+        pack((head >> 32) + 1, next_[ndx].load(boost::memory_order_relaxed));
+      if (head_.compare_exchange_weak(head, next,
+                                      boost::memory_order_acq_rel,
+                                      boost::memory_order_acquire))
+        break;
+    }
+    /// track the high water mark of the occupancy
+    size_t hw = high_water_.load(boost::memory_order_relaxed);
+    while (n > hw &&
+           ! high_water_.compare_exchange_weak(hw, n,
+                                               boost::memory_order_relaxed))
+      ;
+    return &orders_[ndx];
+  }
+
+  //############################################################################
+  /// Release
+  //############################################################################
+  inline void order_pool_t::release(order_ptr order) {
+
+    index_t ndx = static_cast<index_t>(order - &orders_[0]);
+    boost::uint64_t head = head_.load(boost::memory_order_relaxed);
+    for (;;) {
+      next_[ndx].store(static_cast<index_t>(head), boost::memory_order_relaxed);
+      boost::uint64_t top = pack((head >> 32) + 1, ndx);
+      if (head_.compare_exchange_weak(head, top,
+                                      boost::memory_order_acq_rel,
+                                      boost::memory_order_relaxed))
+        break;
+    }
+    in_use_.fetch_sub(1, boost::memory_order_relaxed);
+  }
+
+}  /// namespace trading
+
+#endif
@@ -0,0 +1,70 @@
+#include <order_pool.hpp>
+#include <tracer.hpp>
+#include <iostream>
+
+//##############################################################################
+/// Order pool test.
+///
+/// Fills a small pool with resting orders that don't cross, then checks
+/// that new orders are refused while a cancel still gets an order from the
+/// reserve, and that the cancelled order's slot takes a new order again.
+/// Exits non zero on a failed check.
+//##############################################################################
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  if (! ok) {
+    std::cout << "FAILED: " << what << std::endl;
+    ++failures;
+  }
+}
+
+static void drain(trading::report_ring_t& reports) {
+  while (! reports.empty())
+    reports.pop_front();
+}
+
+int main() {
+
+  trading::tracer_t::instance().disable();
+
+  const size_t capacity = 8;
+  const size_t reserve = 2;
+  trading::order_pool_t pool(capacity, reserve);
+  trading::order_manager_t om(1, 64, capacity);
+  trading::report_ring_t reports;
+  const trading::conn_info_t* conn = NULL;
+
+  /// bids below 100, nothing on the other side
+  size_t resting = 0;
+  trading::order_ptr first = NULL;
+  while (trading::order_ptr order = pool.allocate()) {
+    *order = trading::order_t("IBM", 0, "", 1, 10, 100 - resting,
+                              trading::order_t::buy, conn);
+    check(om.process_order(order, reports), "resting order accepted");
+    first = first ? first : order;
+    ++resting;
+  }
+  drain(reports);
+  check(resting == capacity - reserve, "new orders leave the reserve");
+  check(pool.allocate() == NULL, "new order refused on a full pool");
+
+  trading::order_ptr cancel = pool.allocate_reserved();
+  check(cancel != NULL, "cancel takes the reserve");
+  if (cancel) {
+    *cancel = trading::order_t(trading::order_t::cancel, first->order_id(),
+                               0, conn);
+    check(om.process_order(cancel, reports), "cancel accepted");
+    check(reports.size() == 1 &&
+          reports.front().type_ == trading::report_t::cancelled,
+          "cancel reported");
+    drain(reports);
+    pool.release(cancel);
+    pool.release(first);
+  }
+  check(pool.allocate() != NULL, "cancelled slot takes a new order");
+
+  std::cout << (failures ? "FAILED" : "OK") << std::endl;
+  return failures ? 1 : 0;
+}
@@ -1,53 +1,228 @@
 #include <order.hpp>
+#include <journal.hpp>
+#include <tracer.hpp>
 #include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <stdlib.h>
 
-static const std::string traders[] =
-{
-  "John",
-  "Jim",
-  "Rick",
-  "Alan",
-  "Mike",
-  "Karl",
-  "Fred",
-  "Tim",
-  "Andy",
-  "Jack"
-};
-static const size_t ntraders = sizeof(traders)/sizeof(std::string);
-
-static const std::string stocks[] =
-{
-  "DEL",
-  "IBM",
-  "SNY"
-};
-static const size_t nstocks = sizeof(stocks)/sizeof(std::string);
+//##############################################################################
+/// Journal replay benchmark.
+///
+/// Replays a journal captured by socket_server (--journal DIR, see
+/// journal_t) straight into order_manager_t, without sockets or threads.
+/// New orders keep the order ids they were assigned when captured, so the
+/// replay is deterministic and every request finds its order. Messages are
+/// routed to one order manager per shard the journal was written by, as
+/// recovery routes them (see socket_server_t::restore_shard()), and each
+/// shard's messages are matched in turn, so the execution stream is each
+/// shard's stream as captured, one shard after the other.
+///
+/// Each pass matches the whole journal twice on fresh books:
+/// - in batches, as the processor threads do, for orders/sec
+/// - one order at a time, timing each, for the latency distribution
+/// Both print a checksum of the execution report stream; the checksums
+/// must agree with each other and across passes, and between builds when
+/// the matching code changes without meaning to change behavior.
+//##############################################################################
+
+static const size_t batch_size = 256;
+
+/// replayed orders have no session handle, one slot turns on tracking
+static const size_t session_slots = 1;
+
+static double now() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static boost::uint64_t now_nanos() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//##############################################################################
+/// Make Orders
+///
+/// Rebuilds the journaled messages as orders and requests, with no
+/// connection, in journal order.
+//##############################################################################
+static void make_orders(const std::vector<trading::journal_record_t>& records,
+                        std::vector<trading::order_t>& orders) {
+  orders.clear();
+  orders.reserve(records.size());
+  const trading::conn_info_t* conn = NULL;
+  for (size_t i = 0; i < records.size(); ++i) {
+    const trading::journal_record_t& r = records[i];
+    trading::order_t::type_t type =
+      static_cast<trading::order_t::type_t>(r.type_);
+    if (type == trading::order_t::new_order) {
+      trading::order_t::side_t side =
+        r.side_ == 0 ? trading::order_t::buy : trading::order_t::sell;
+      orders.push_back(trading::order_t(r.stock_, r.symbol_id_, "",
+                                        r.trader_id_, r.quantity_, r.price_,
+                                        side, conn));
+    }
+    else {
+      orders.push_back(trading::order_t(type, r.order_id_, r.quantity_,
+                                        conn));
+    }
+    orders.back().order_id(r.order_id_);
+    orders.back().session_id(r.session_id_);
+  }
+}
+
+//##############################################################################
+/// Shard
+///
+/// Shard a journaled message was matched on: new orders by symbol id,
+/// requests by order id, and disconnect requests by the shard recorded
+/// in their order id.
+//##############################################################################
+static size_t shard(const trading::journal_record_t& r, size_t nshards) {
+  return r.type_ == trading::order_t::new_order ?
+    r.symbol_id_ % nshards : r.order_id_ % nshards;
+}
+
+//##############################################################################
+/// Checksum
+///
+/// FNV-1a over the execution reports; drains the ring.
+//##############################################################################
+static boost::uint64_t mix(boost::uint64_t sum, boost::uint64_t v) {
+  for (int i = 0; i < 8; ++i, v >>= 8)
+    sum = (sum ^ (v & 0xff)) * 1099511628211ULL;
+  return sum;
+}
+
+static boost::uint64_t checksum(trading::report_ring_t& reports,
+                                boost::uint64_t sum) {
+  for (; ! reports.empty(); reports.pop_front()) {
+    const trading::report_t& r = reports.front();
+    sum = mix(sum, r.type_);
+    sum = mix(sum, r.order_id_);
+    sum = mix(sum, r.contra_id_);
+    sum = mix(sum, r.quantity_);
+    sum = mix(sum, r.balance_);
+    sum = mix(sum, r.price_);
+  }
+  return sum;
+}
 
 int main(int argc, const char** argv) {
 
-  if (argc != 2) {
+  if (argc < 2 || argc > 3) {
     std::cout << "Usage: "
               << argv[0]
-              << " <iterations>"
+              << " <journal directory> [passes]"
               << std::endl;
     return -1;
   }
-  size_t iters = ::atoi(argv[1]);
-  if (iters > 10000000) {
-    std::cout << "Iterations must between 1 and 10 million" << std::endl;
+  size_t passes = argc == 3 ? ::atoi(argv[2]) : 1;
+  if (passes < 1) {
+    std::cout << "Passes must be positive" << std::endl;
     return -1;
   }
-  size_t base = 100;
-  trading::order_manager_t om;
-  for (size_t i = 0; i < iters; ++i) {
-    size_t stock_ndx  = i % nstocks;
-    size_t trader_ndx = i % ntraders;
-    int qty = base +  i % 100;
-    trading::order_t::side_t side = i % 2 == 0 ? trading::order_t::buy : trading::order_t::sell;
-    trading::order_ptr order =
-      boost::make_shared<trading::order_t>(
-        stocks[stock_ndx], traders[trader_ndx], qty, side);
-    om.process_order(order);
+  trading::tracer_t::instance().disable();
+
+  std::vector<trading::journal_record_t> records;
+  trading::journal_header_t header;
+  try {
+    header = trading::journal_t::read(argv[1], 0, records);
+  }
+  catch (const std::string& ex) {
+    std::cout << ex << std::endl;
+    return 1;
+  }
+  if (records.empty()) {
+    std::cout << "Empty journal: " << argv[1] << std::endl;
+    return 1;
+  }
+  const size_t nshards = header.nshards_;
+  size_t nsymbols = 0;
+  std::vector<std::vector<trading::journal_record_t> > shards(nshards);
+  for (size_t i = 0; i < records.size(); ++i) {
+    nsymbols = std::max<size_t>(nsymbols, records[i].symbol_id_ + 1);
+    shards[shard(records[i], nshards)].push_back(records[i]);
+  }
+  std::cout << records.size() << " messages, " << nsymbols << " symbols, "
+            << nshards << " shards, " << header.price_levels_
+            << " price levels, " << header.pool_size_ << " pool orders"
+            << std::endl;
+
+  const size_t n = records.size();
+  std::vector<trading::order_t> orders;
+  std::vector<trading::order_ptr> ptrs;
+  std::vector<boost::uint32_t> latency(n);
+  boost::uint64_t expected = 0;
+  bool match = true;
+
+  for (size_t pass = 0; pass < passes; ++pass) {
+
+    /// batches, as the processor threads match them
+    trading::report_ring_t reports;
+    boost::uint64_t batch_sum = 14695981039346656037ULL;
+    double secs = 0;
+    for (size_t k = 0; k < nshards; ++k) {
+      const size_t m = shards[k].size();
+      make_orders(shards[k], orders);
+      ptrs.resize(m);
+      for (size_t i = 0; i < m; ++i) {
+        ptrs[i] = &orders[i];
+      }
+      trading::order_manager_t om(nsymbols, header.price_levels_,
+                                  header.pool_size_, k, nshards,
+                                  session_slots);
+      double start = now();
+      for (size_t i = 0; i < m; i += batch_size) {
+        om.process_orders(&ptrs[i], std::min(batch_size, m - i), reports);
+        batch_sum = checksum(reports, batch_sum);
+      }
+      secs += now() - start;
+    }
+
+    /// one at a time, timed
+    boost::uint64_t single_sum = 14695981039346656037ULL;
+    size_t timed = 0;
+    for (size_t k = 0; k < nshards; ++k) {
+      make_orders(shards[k], orders);
+      trading::order_manager_t om(nsymbols, header.price_levels_,
+                                  header.pool_size_, k, nshards,
+                                  session_slots);
+      for (size_t i = 0; i < shards[k].size(); ++i) {
+        trading::order_ptr order = &orders[i];
+        boost::uint64_t t0 = now_nanos();
+        om.process_order(order, reports);
+        latency[timed++] = now_nanos() - t0;
+        single_sum = checksum(reports, single_sum);
+      }
+    }
+    std::sort(latency.begin(), latency.end());
+
+    if (pass == 0) {
+      expected = batch_sum;
+    }
+    match = match && batch_sum == expected && single_sum == expected;
+
+    std::cout << std::fixed << std::setprecision(0)
+              << "pass " << pass + 1 << ": "
+              << n / secs << " orders/sec, latency ns"
+              << " p50 " << latency[n / 2]
+              << " p90 " << latency[n * 9 / 10]
+              << " p99 " << latency[n * 99 / 100]
+              << " p99.9 " << latency[n * 999 / 1000]
+              << " max " << latency[n - 1]
+              << ", checksum " << std::hex << batch_sum;
+    if (single_sum != batch_sum) {
+      std::cout << " (single " << single_sum << ")";
+    }
+    std::cout << std::dec << std::endl;
   }
+  std::cout << "execution stream " << (match ? "deterministic" : "DIFFERS")
+            << std::endl;
+  return match ? 0 : 1;
 }
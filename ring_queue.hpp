@@ -0,0 +1,459 @@
+#ifndef __RING_QUEUE_HPP__
+#define __RING_QUEUE_HPP__
+
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace concurrent {
+
+  /// Consumers a ring queue is built for
+  enum consumers_t {
+    multi_consumer,    /// MPMC: consumers claim cells by compare-and-swap
+    single_consumer    /// MPSC: the one consumer moves the head alone
+  };
+
+  //############################################################################
+  /// CLASS:  Ring Queue
+  ///
+  /// Bounded lock free queue for any number of producers over a power of
+  /// two ring of cells, and any number of consumers or, built with
+  /// single_consumer, exactly one. Each cell carries a sequence number that
+  /// says whose turn it is: a producer claims the cell at the tail by
+  /// compare-and-swap on the tail position once the cell's sequence equals
+  /// the position, writes the item and publishes it by bumping the cell's
+  /// sequence; consumers do the same at the head, a single consumer without
+  /// the compare-and-swap. Producers and consumers only contend among
+  /// themselves.
+  ///
+  /// try_push() and try_pop() report a full or empty queue. push(),
+  /// pop_front() and pop_batch() wait instead, with the surface of queue_t
+  /// (see work_queue.hpp): they spin a while, then sleep on a condition
+  /// variable. A waiter counts itself before its last look at the ring and
+  /// the other side looks at the count after moving the ring, so the
+  /// mutex and the notification are only paid for while somebody sleeps,
+  /// and each item wakes one sleeper.
+  ///
+  /// Head and tail are kept on separate cache lines from each other and
+  /// from the ring.
+  //############################################################################
+  template <typename T, consumers_t C = multi_consumer>
+  class ring_queue_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// @param[in]  capacity  number of cells, rounded up to a power of two
+    /// @return               none
+    /// @throws               std::string if capacity is zero
+    //##########################################################################
+    explicit ring_queue_t(size_t capacity);
+
+    //##########################################################################
+    /// Try Push
+    ///
+    /// @param[in]  t  item pushed onto the back of the queue
+    /// @return        false if the queue is full
+    /// @throws        none
+    //##########################################################################
+    bool try_push(const T& t);
+
+    //##########################################################################
+    /// Try Pop
+    ///
+    /// @param[in]  t  item removed from the front of the queue
+    /// @return        false if the queue is empty
+    /// @throws        none
+    //##########################################################################
+    bool try_pop(T& t);
+
+    //##########################################################################
+    /// Push
+    ///
+    /// Pushes item onto queue, waiting for room while the queue is full; a
+    /// ring can't grow.
+    ///
+    /// @param[in]  t  item pushed onto the back of the queue
+    /// @return        none
+    /// @throws        can throw exceptions from boost::thread api
+    //##########################################################################
+    void push(const T& t);
+
+    //##########################################################################
+    /// Pop Front
+    ///
+    /// Pops item from front of queue, waiting while the queue is empty.
+    ///
+    /// @param[in]  t  item removed from the front of the queue
+    /// @return        none
+    /// @throws        can throw exceptions from boost::thread api
+    //##########################################################################
+    void pop_front(T& t);
+
+    //##########################################################################
+    /// Pop Front
+    ///
+    /// @param   none
+    /// @return  item removed from the front of the queue
+    /// @throws  can throw exceptions from boost::thread api
+    //##########################################################################
+    T pop_front();
+
+    //##########################################################################
+    /// Pop Batch
+    ///
+    /// Waits until the queue is not empty, then moves up to max items from
+    /// the front of the queue into items.
+    ///
+    /// @param[inout]  items    cleared, then filled with the popped items
+    /// @param[in]     max      maximum number of items to pop
+    /// @param[out]    drained  if given, set when try_push() found the
+    ///                         queue full since the last time it was set and
+    ///                         the queue has drained to half its capacity,
+    ///                         else cleared
+    /// @return        number of items popped
+    /// @throws        can throw exceptions from boost::thread api
+    //##########################################################################
+    size_t pop_batch(std::vector<T>& items, size_t max, bool* drained = NULL);
+
+    //##########################################################################
+    /// Size
+    ///
+    /// @param   none
+    /// @return  items queued, a snapshot while other threads push and pop
+    /// @throws  none
+    //##########################################################################
+    size_t size() const {
+      size_t head = head_.load(boost::memory_order_relaxed);
+      return tail_.load(boost::memory_order_relaxed) - head;
+    }
+
+    //##########################################################################
+    /// Capacity Accessor
+    ///
+    /// @param   none
+    /// @return  number of cells
+    /// @throws  none
+    //##########################################################################
+    size_t capacity() const { return mask_ + 1; }
+
+  private:
+
+    /// keeps the hot positions on their own cache lines
+    enum { cache_line = 64 };
+
+    /// failed tries before a waiter sleeps
+    enum { spins = 256 };
+
+    //##########################################################################
+    /// STRUCT: Cell
+    //##########################################################################
+    struct cell_t {
+      boost::atomic<size_t>  sequence_;
+      T                      item_;
+    };
+
+    //##########################################################################
+    /// Enqueue
+    ///
+    /// @param[in]  t  item pushed onto the back of the queue
+    /// @return        false if the queue is full
+    /// @throws        none
+    //##########################################################################
+    bool enqueue(const T& t);
+
+    //##########################################################################
+    /// Dequeue
+    ///
+    /// @param[in]  t  item removed from the front of the queue
+    /// @return        false if the queue is empty
+    /// @throws        none
+    //##########################################################################
+    bool dequeue(T& t);
+
+    //##########################################################################
+    /// Notify
+    ///
+    /// Wakes sleepers of the other side, if any, once the ring moved.
+    ///
+    /// @param[in]  waiting  sleepers counted on the condition
+    /// @param[in]  cond     condition they sleep on
+    /// @param[in]  all      wake every sleeper, not one
+    /// @return              none
+    /// @throws              none
+    //##########################################################################
+    void notify(const boost::atomic<size_t>& waiting,
+                boost::condition_variable& cond,
+                bool all);
+
+    char                         pad0_[cache_line];
+    size_t                       mask_;   /// capacity - 1
+    boost::scoped_array<cell_t>  ring_;
+    char                         pad1_[cache_line];
+    boost::atomic<size_t>        tail_;   /// next position to push
+    char                         pad2_[cache_line];
+    boost::atomic<size_t>        head_;   /// next position to pop
+    char                         pad3_[cache_line];
+    boost::atomic<size_t>        consumers_waiting_;  /// asleep on empty
+    boost::atomic<size_t>        producers_waiting_;  /// asleep on full
+    boost::atomic<bool>          refused_;  /// try_push() found it full
+    boost::mutex                 mutex_;    /// sleepers only
+    boost::condition_variable    not_empty_;
+    boost::condition_variable    not_full_;
+    char                         pad4_[cache_line];
+  };
+
+  //############################################################################
+  /// Constructor
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline ring_queue_t<T, C>::ring_queue_t(size_t capacity) :
+    tail_(0),
+    head_(0),
+    consumers_waiting_(0),
+    producers_waiting_(0),
+    refused_(false) {
+
+    if (capacity == 0) {
+      throw std::string("Invalid ring queue capacity");
+    }
+    size_t n = 2;
+    while (n < capacity)
+      n <<= 1;
+    mask_ = n - 1;
+    ring_.reset(new cell_t[n]);
+    for (size_t i = 0; i < n; ++i) {
+      ring_[i].sequence_.store(i, boost::memory_order_relaxed);
+    }
+  }
+
+  //############################################################################
+  /// Enqueue
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline bool ring_queue_t<T, C>::enqueue(const T& t) {
+
+    size_t pos = tail_.load(boost::memory_order_relaxed);
+    cell_t* cell;
+    for (;;) {
+      cell = &ring_[pos & mask_];
+      size_t seq = cell->sequence_.load(boost::memory_order_acquire);
+      long diff = static_cast<long>(seq) - static_cast<long>(pos);
+
+      /// the cell is free for this position, try to claim it
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        boost::memory_order_relaxed))
+          break;
+      }
+      /// the cell still holds the item from one lap ago: full
+      else if (diff < 0) {
+        return false;
+      }
+      /// another producer claimed it, catch up
+      else {
+        pos = tail_.load(boost::memory_order_relaxed);
+      }
+    }
+    cell->item_ = t;
+    cell->sequence_.store(pos + 1, boost::memory_order_release);
+    return true;
+  }
+
+  //############################################################################
+  /// Dequeue
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline bool ring_queue_t<T, C>::dequeue(T& t) {
+
+    size_t pos = head_.load(boost::memory_order_relaxed);
+    cell_t* cell;
+
+    /// a single consumer owns the head, and takes the cell as it finds it
+    if (C == single_consumer) {
+      cell = &ring_[pos & mask_];
+      if (cell->sequence_.load(boost::memory_order_acquire) != pos + 1)
+        return false;
+      head_.store(pos + 1, boost::memory_order_relaxed);
+      t = cell->item_;
+      cell->sequence_.store(pos + mask_ + 1, boost::memory_order_release);
+      return true;
+    }
+    for (;;) {
+      cell = &ring_[pos & mask_];
+      size_t seq = cell->sequence_.load(boost::memory_order_acquire);
+      long diff = static_cast<long>(seq) - static_cast<long>(pos + 1);
+
+      /// the cell holds the item for this position, try to claim it
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        boost::memory_order_relaxed))
+          break;
+      }
+      /// nothing published at this position yet: empty
+      else if (diff < 0) {
+        return false;
+      }
+      /// another consumer took it, catch up
+      else {
+        pos = head_.load(boost::memory_order_relaxed);
+      }
+    }
+    t = cell->item_;
+    cell->sequence_.store(pos + mask_ + 1, boost::memory_order_release);
+    return true;
+  }
+
+  //############################################################################
+  /// Notify
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline void ring_queue_t<T, C>::notify(
+    const boost::atomic<size_t>& waiting,
+    boost::condition_variable& cond,
+    bool all) {
+
+    ////////
+    /// the cell sequence stored, then the count loaded; a waiter counts
+    /// itself, then looks at the cells, so one of the two sees the other
+    ////////
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (waiting.load(boost::memory_order_relaxed) == 0)
+      return;
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    if (all)
+      cond.notify_all();
+    else
+      cond.notify_one();
+  }
+
+  //############################################################################
+  /// Try Push
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline bool ring_queue_t<T, C>::try_push(const T& t) {
+
+    if (! enqueue(t)) {
+      refused_.store(true, boost::memory_order_relaxed);
+      return false;
+    }
+    notify(consumers_waiting_, not_empty_, false);
+    return true;
+  }
+
+  //############################################################################
+  /// Try Pop
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline bool ring_queue_t<T, C>::try_pop(T& t) {
+
+    if (! dequeue(t))
+      return false;
+    notify(producers_waiting_, not_full_, false);
+    return true;
+  }
+
+  //############################################################################
+  /// Push
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline void ring_queue_t<T, C>::push(const T& t) {
+
+    ////////
+    /// spin first: a consumer usually makes room within microseconds, far
+    /// sooner than a sleep and a wake up would take
+    ////////
+    for (size_t i = 0; ! enqueue(t); ++i) {
+      if (i < spins)
+        continue;
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      producers_waiting_.fetch_add(1);
+      boost::atomic_thread_fence(boost::memory_order_seq_cst);
+      bool pushed = enqueue(t);
+      if (! pushed) {
+        not_full_.wait(lock);
+      }
+      producers_waiting_.fetch_sub(1);
+      if (pushed)
+        break;
+    }
+    notify(consumers_waiting_, not_empty_, false);
+  }
+
+  //############################################################################
+  /// Pop Front
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline void ring_queue_t<T, C>::pop_front(T& t) {
+
+    for (size_t i = 0; ! dequeue(t); ++i) {
+      if (i < spins)
+        continue;
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      consumers_waiting_.fetch_add(1);
+      boost::atomic_thread_fence(boost::memory_order_seq_cst);
+      bool popped = dequeue(t);
+      if (! popped) {
+        not_empty_.wait(lock);
+      }
+      consumers_waiting_.fetch_sub(1);
+      if (popped)
+        break;
+    }
+    notify(producers_waiting_, not_full_, false);
+  }
+
+  //############################################################################
+  /// Pop Front
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline T ring_queue_t<T, C>::pop_front() {
+    T item;
+    pop_front(item);
+    return item;
+  }
+
+  //############################################################################
+  /// Pop Batch
+  //############################################################################
+  template <typename T, consumers_t C>
+  inline size_t ring_queue_t<T, C>::pop_batch(std::vector<T>& items,
+                                              size_t max,
+                                              bool* drained) {
+
+    items.clear();
+    if (drained)
+      *drained = false;
+    if (max == 0)
+      return 0;
+
+    /// wait for the first item only, then take what is there
+    T item;
+    pop_front(item);
+    items.push_back(item);
+    while (items.size() < max && dequeue(item)) {
+      items.push_back(item);
+    }
+    if (items.size() > 1) {
+      notify(producers_waiting_, not_full_, true);
+    }
+    ////////
+    /// refused producers come back once there is room for a burst, not
+    /// for every item popped
+    ////////
+    if (refused_.load(boost::memory_order_relaxed) &&
+        size() <= capacity() / 2 && refused_.exchange(false)) {
+      if (drained)
+        *drained = true;
+    }
+    return items.size();
+  }
+
+}  /// namespace concurrent
+
+#endif  /// __RING_QUEUE_HPP__
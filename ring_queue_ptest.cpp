@@ -0,0 +1,158 @@
+#include <ring_queue.hpp>
+#include <work_queue.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <time.h>
+#include <stdlib.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+//##############################################################################
+/// Queue benchmark.
+///
+/// Moves the same number of items from P producers to C consumers through
+/// the mutex based queue_t and through ring_queue_t, multi and (for one
+/// consumer) single consumer, with blocking push() and pop_front() on
+/// both (push_wait() on a queue_t limited to the ring's capacity), and
+/// reports items/sec from the first push until every consumer has seen
+/// its end marker. Read the numbers against the number of cores: with
+/// more threads than cores the spinning of ring waiters only costs.
+//##############################################################################
+
+typedef concurrent::queue_t<size_t> mutex_queue_t;
+typedef concurrent::ring_queue_t<size_t> mpmc_queue_t;
+typedef concurrent::ring_queue_t<size_t, concurrent::single_consumer>
+  mpsc_queue_t;
+
+static const size_t counts[] = { 1, 2, 4 };
+static const size_t ncounts = sizeof(counts)/sizeof(size_t);
+
+static double now() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//##############################################################################
+/// Put: waits for room, queue_t only does so in push_wait()
+//##############################################################################
+template <typename Q>
+static void put(Q* queue, size_t item) {
+  queue->push(item);
+}
+
+static void put(mutex_queue_t* queue, size_t item) {
+  queue->push_wait(item);
+}
+
+//##############################################################################
+/// Produce: pushes items first .. first + n - 1, never 0
+//##############################################################################
+template <typename Q>
+static void produce(Q* queue, size_t first, size_t n) {
+  for (size_t i = first; i < first + n; ++i) {
+    put(queue, i);
+  }
+}
+
+//##############################################################################
+/// Consume: pops until the end marker 0, summing what it popped
+//##############################################################################
+template <typename Q>
+static void consume(Q* queue, size_t* sum) {
+  size_t total = 0;
+  for (size_t item; (item = queue->pop_front()) != 0; ) {
+    total += item;
+  }
+  *sum = total;
+}
+
+//##############################################################################
+/// Run: one round of nitems through queue, checked by the sum of items
+//##############################################################################
+template <typename Q>
+static double run(Q& queue, size_t producers, size_t consumers,
+                  size_t nitems) {
+
+  std::vector<size_t> sums(consumers);
+  boost::thread_group consumer_threads;
+  for (size_t c = 0; c < consumers; ++c) {
+    consumer_threads.create_thread(
+      boost::bind(&consume<Q>, &queue, &sums[c]));
+  }
+
+  double start = now();
+  size_t per_producer = nitems / producers;
+  boost::thread_group producer_threads;
+  for (size_t p = 0; p < producers; ++p) {
+    producer_threads.create_thread(
+      boost::bind(&produce<Q>, &queue, 1 + p * per_producer, per_producer));
+  }
+  producer_threads.join_all();
+  for (size_t c = 0; c < consumers; ++c) {
+    queue.push(0);
+  }
+  consumer_threads.join_all();
+  double secs = now() - start;
+
+  size_t n = per_producer * producers, sum = 0;
+  for (size_t c = 0; c < consumers; ++c) {
+    sum += sums[c];
+  }
+  if (sum != n * (n + 1) / 2) {
+    throw std::string("Items lost or duplicated");
+  }
+  return n / secs;
+}
+
+int main(int argc, const char** argv) {
+
+  if (argc != 3) {
+    std::cout << "Usage: "
+              << argv[0]
+              << " <items per run> <queue capacity>"
+              << std::endl;
+    return -1;
+  }
+  size_t nitems = ::atoi(argv[1]);
+  size_t capacity = ::atoi(argv[2]);
+  if (nitems < counts[ncounts - 1] || capacity < 1) {
+    std::cout << "Items and capacity must be positive" << std::endl;
+    return -1;
+  }
+
+  try {
+
+    std::cout << std::setw(10) << "producers" << std::setw(10) << "consumers"
+              << std::setw(14) << "queue_t" << std::setw(14) << "ring mpmc"
+              << std::setw(14) << "ring mpsc" << "  items/sec" << std::endl;
+
+    for (size_t p = 0; p < ncounts; ++p) {
+      for (size_t c = 0; c < ncounts; ++c) {
+
+        /// queue_t bounded like the rings, so producers wait on both
+        mutex_queue_t mutex_queue(capacity, capacity);
+        mpmc_queue_t mpmc_queue(capacity);
+
+        std::cout << std::setw(10) << counts[p] << std::setw(10) << counts[c]
+                  << std::fixed << std::setprecision(0)
+                  << std::setw(14)
+                  << run(mutex_queue, counts[p], counts[c], nitems)
+                  << std::setw(14)
+                  << run(mpmc_queue, counts[p], counts[c], nitems);
+        if (counts[c] == 1) {
+          mpsc_queue_t mpsc_queue(capacity);
+          std::cout << std::setw(14)
+                    << run(mpsc_queue, counts[p], counts[c], nitems);
+        }
+        std::cout << std::endl;
+      }
+    }
+  }
+  catch (const std::string& ex) {
+    std::cout << ex << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,293 @@
+#ifndef __SERVER_CONFIG_HPP__
+#define __SERVER_CONFIG_HPP__
+
+#include <string>
+#include <iostream>
+#include <boost/cstdint.hpp>
+#include <boost/program_options.hpp>
+#include <topology.hpp>
+
+namespace trading {
+
+  namespace po = boost::program_options;
+
+  //############################################################################
+  /// STRUCT: Server Configuration
+  ///
+  /// Startup parameters of the socket server. The port and thread counts
+  /// are positional arguments; everything else is an optional named option
+  /// with a default.
+  //############################################################################
+  struct server_config_t {
+
+    /// What a reader does with a message for a full work queue
+    enum overflow_t {
+      pause,    /// stop reading the connection until the queue drains
+      reject,   /// answer the message with a throttled message
+      block     /// wait for room, stalling the reader's connections
+    };
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// Initializes members to their defaults.
+    ///
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    server_config_t() :
+      port_(0),
+      backlog_(1024),
+      nreaders_(0),
+      nprocessors_(0),
+      max_sessions_(65536),
+      max_symbols_(4096),
+      price_levels_(4096),
+      pool_size_(262144),
+      pool_reserve_(4096),
+      batch_size_(256),
+      queue_limit_(65536),
+      overflow_(pause),
+      flush_micros_(0),
+      io_uring_(false),
+      shm_readers_(1),
+      shm_ring_kb_(256),
+      shm_busy_poll_(false),
+      stats_interval_(10),
+      cancel_on_disconnect_(false),
+      journal_segment_mb_(64),
+      journal_sync_messages_(0),
+      journal_sync_micros_(0),
+      snapshot_interval_(60)
+    {}
+
+    //##########################################################################
+    /// Parse
+    ///
+    /// Parses the command line; prints usage on --help or bad arguments.
+    ///
+    /// @param[in]  argc  argument count
+    /// @param[in]  argv  arguments
+    /// @return           false if the server should not be started
+    /// @throws           none
+    //##########################################################################
+    bool parse(int argc, const char** argv);
+
+    boost::uint16_t  port_;          /// server port
+    int              backlog_;       /// listen backlog of each reader
+    size_t           nreaders_;      /// number of reader (I/O) threads
+    size_t           nprocessors_;   /// number of processor threads (shards)
+    size_t           max_sessions_;  /// sessions open at once
+    std::string      symbols_file_;  /// symbol universe, empty if open
+    size_t           max_symbols_;   /// symbol directory capacity
+    size_t           price_levels_;  /// price ladder levels per book
+    size_t           pool_size_;     /// orders preallocated in the pool
+    size_t           pool_reserve_;  /// of those, kept for requests
+    size_t           batch_size_;    /// max orders matched per batch
+    size_t           queue_limit_;   /// work queue bound per shard, 0 = none
+    overflow_t       overflow_;      /// policy once a work queue is full
+    size_t           flush_micros_;  /// report flush interval, 0 = batch
+    bool             io_uring_;      /// readers on io_uring, not epoll
+    std::string      shm_path_;      /// Unix socket of shared memory
+                                     /// sessions, empty if off
+    size_t           shm_readers_;   /// readers of shared memory sessions
+    size_t           shm_ring_kb_;   /// ring size per session direction
+    bool             shm_busy_poll_; /// shm readers spin, never sleep
+    cpus_t           reader_cpus_;   /// a CPU per reader in turn, empty if
+                                     /// not pinned
+    cpus_t           processor_cpus_;  /// a CPU per processor in turn
+    cpus_t           service_cpus_;  /// journal, snapshot and stats threads
+    size_t           stats_interval_;  /// seconds between stats, 0 = off
+    bool             cancel_on_disconnect_;  /// cancel a session's orders
+    std::string      journal_dir_;   /// inbound journal, empty if off
+    size_t           journal_segment_mb_;     /// journal segment size
+    size_t           journal_sync_messages_;  /// msync every N, 0 = off
+    size_t           journal_sync_micros_;    /// msync every T us, 0 = off
+    std::string      snapshot_dir_;  /// book snapshots, empty if off
+    size_t           snapshot_interval_;  /// seconds between snapshots
+  };
+
+  //############################################################################
+  /// Parse
+  //############################################################################
+  inline bool server_config_t::parse(int argc, const char** argv) {
+
+    std::string overflow;
+    std::string reader_cpus;
+    std::string processor_cpus;
+    std::string service_cpus;
+    po::options_description options("Options");
+    options.add_options()
+      ("help,h", "print this message")
+      ("port", po::value<boost::uint16_t>(&port_)->required(),
+       "server port")
+      ("readers", po::value<size_t>(&nreaders_)->required(),
+       "number of reader (network I/O) threads, each accepting on a "
+       "listening socket of its own (SO_REUSEPORT) and serving any number "
+       "of connections")
+      ("backlog", po::value<int>(&backlog_)->default_value(backlog_),
+       "listen backlog of each reader's listening socket, capped by "
+       "net.core.somaxconn")
+      ("processors", po::value<size_t>(&nprocessors_)->required(),
+       "number of processor threads (order book shards)")
+      ("max-sessions", po::value<size_t>(&max_sessions_)->default_value(
+         max_sessions_), "sessions logged in at once, split evenly between "
+       "the readers, shared memory readers included; a login a reader "
+       "has no session left for is rejected")
+      ("symbols", po::value<std::string>(&symbols_file_),
+       "symbol universe file, one stock per line; if given, stocks not in "
+       "the universe are rejected, otherwise stocks are added on first use")
+      ("max-symbols", po::value<size_t>(&max_symbols_)->default_value(
+         max_symbols_), "symbol directory capacity")
+      ("price-levels", po::value<size_t>(&price_levels_)->default_value(
+         price_levels_), "price ladder levels (ticks) per order book")
+      ("pool-size", po::value<size_t>(&pool_size_)->default_value(
+         pool_size_), "orders preallocated in the order pool; bounds the "
+       "orders resting or in flight at once")
+      ("pool-reserve", po::value<size_t>(&pool_reserve_)->default_value(
+         pool_reserve_), "orders of the pool new orders may not take, kept "
+       "for cancel and amend requests so a pool full of resting orders "
+       "can still be drained")
+      ("batch-size", po::value<size_t>(&batch_size_)->default_value(
+         batch_size_), "maximum orders a processor thread takes from its "
+       "work queue and matches as one batch")
+      ("queue-limit", po::value<size_t>(&queue_limit_)->default_value(
+         queue_limit_), "orders and requests a shard's work queue holds "
+       "before --overflow applies, 0 for no limit")
+      ("overflow", po::value<std::string>(&overflow)->default_value(
+         "pause"), "what a reader does with a message for a full work "
+       "queue: pause (stop reading the client until the queue has drained "
+       "to half its limit, so TCP pushes back), reject (answer it with a "
+       "throttled message) or block (wait for room, stalling every client "
+       "of the reader)")
+      ("flush-micros", po::value<size_t>(&flush_micros_)->default_value(
+         flush_micros_), "microseconds between flushes of buffered "
+       "execution reports to the clients, 0 flushes after every batch")
+      ("io-uring", po::bool_switch(&io_uring_),
+       "run the reader threads on io_uring (multishot accept and receive, "
+       "batched sends) instead of epoll; falls back to epoll if the kernel "
+       "lacks support")
+      ("shm", po::value<std::string>(&shm_path_),
+       "Unix socket path clients on the same host connect to for sessions "
+       "over shared memory rings instead of TCP, served by readers of "
+       "their own on epoll; off unless given")
+      ("shm-readers", po::value<size_t>(&shm_readers_)->default_value(
+         shm_readers_), "number of reader threads serving shared memory "
+       "sessions, in addition to --readers")
+      ("shm-ring-kb", po::value<size_t>(&shm_ring_kb_)->default_value(
+         shm_ring_kb_), "KiB of each of a shared memory session's two "
+       "rings, rounded up to a power of two")
+      ("shm-busy-poll", po::bool_switch(&shm_busy_poll_),
+       "shared memory readers and their clients spin on the rings instead "
+       "of sleeping until the other side rings; takes a core per reader "
+       "and client thread")
+      ("reader-cpus", po::value<std::string>(&reader_cpus),
+       "CPUs to pin the reader threads to, one CPU per reader taken from "
+       "the list in turn, shared memory readers last, e.g. 2-5; readers "
+       "also accept connections and write the reports. Not pinned unless "
+       "given")
+      ("processor-cpus", po::value<std::string>(&processor_cpus),
+       "CPUs to pin the processor threads to, one CPU per processor taken "
+       "from the list in turn; each shard's books and work queue are "
+       "allocated on its processor's NUMA node. Not pinned unless given")
+      ("service-cpus", po::value<std::string>(&service_cpus),
+       "CPUs the journal, snapshot and statistics threads share. Not "
+       "pinned unless given")
+      ("stats-interval", po::value<size_t>(&stats_interval_)->default_value(
+         stats_interval_), "seconds between statistics traces, 0 disables")
+      ("cancel-on-disconnect", po::bool_switch(&cancel_on_disconnect_),
+       "cancel the resting orders of a client when it disconnects")
+      ("journal", po::value<std::string>(&journal_dir_),
+       "directory of the inbound message journal, which doubles as a "
+       "capture of the decoded order flow for order_ptest to replay; "
+       "journaling is off unless given")
+      ("journal-segment-mb", po::value<size_t>(&journal_segment_mb_)
+         ->default_value(journal_segment_mb_),
+       "size of a preallocated journal segment in MiB")
+      ("journal-sync-messages", po::value<size_t>(&journal_sync_messages_)
+         ->default_value(journal_sync_messages_),
+       "msync the journal once N messages are pending, 0 disables")
+      ("journal-sync-micros", po::value<size_t>(&journal_sync_micros_)
+         ->default_value(journal_sync_micros_),
+       "msync the journal once the oldest pending message is T "
+       "microseconds old, 0 disables; without either sync option the "
+       "kernel writes the journal back. Neither option holds execution "
+       "reports back until their message is synced: a client may be "
+       "answered for a message a power loss then erases")
+      ("snapshots", po::value<std::string>(&snapshot_dir_),
+       "directory of order book snapshots, taken periodically and on "
+       "SIGINT or SIGTERM; on startup the books are restored from the "
+       "latest snapshot and the journal after it. Off unless given")
+      ("snapshot-interval", po::value<size_t>(&snapshot_interval_)
+         ->default_value(snapshot_interval_),
+       "seconds between periodic snapshots, 0 snapshots on shutdown only");
+
+    po::positional_options_description positional;
+    positional.add("port", 1).add("readers", 1).add("processors", 1);
+
+    try {
+      po::variables_map vm;
+      po::store(po::command_line_parser(argc, argv).options(options)
+                  .positional(positional).run(), vm);
+      if (vm.count("help")) {
+        throw po::error("help requested");
+      }
+      po::notify(vm);
+      if (nreaders_ == 0) {
+        throw po::error("at least one reader thread is required");
+      }
+      if (backlog_ <= 0) {
+        throw po::error("backlog must be positive");
+      }
+      if (! shm_path_.empty() && shm_readers_ == 0) {
+        throw po::error("at least one shared memory reader is required");
+      }
+      if (max_sessions_ <
+          nreaders_ + (shm_path_.empty() ? 0 : shm_readers_)) {
+        throw po::error("at least one session per reader is required");
+      }
+      if (nprocessors_ == 0) {
+        throw po::error("at least one processor thread is required");
+      }
+      if (pool_reserve_ >= pool_size_) {
+        throw po::error("pool reserve must be below the pool size");
+      }
+      if (batch_size_ == 0) {
+        throw po::error("batch size must be positive");
+      }
+      if (overflow == "pause") {
+        overflow_ = pause;
+      }
+      else if (overflow == "reject") {
+        overflow_ = reject;
+      }
+      else if (overflow == "block") {
+        overflow_ = block;
+      }
+      else {
+        throw po::error("overflow must be pause, reject or block");
+      }
+      try {
+        reader_cpus_ = parse_cpus(reader_cpus);
+        processor_cpus_ = parse_cpus(processor_cpus);
+        service_cpus_ = parse_cpus(service_cpus);
+      }
+      catch (const std::string& ex) {
+        throw po::error(ex);
+      }
+    }
+    catch (const po::error& ex) {
+      std::cout << ex.what() << std::endl
+                << "Usage: <" << argv[0] << "> <server port> "
+                << "<# of reader threads> <# of processor threads> "
+                << "[options]" << std::endl
+                << options << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+}  /// namespace trading
+
+#endif
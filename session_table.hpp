@@ -0,0 +1,227 @@
+#ifndef __SESSION_TABLE_HPP__
+#define __SESSION_TABLE_HPP__
+
+#include <vector>
+#include <string>
+#include <conn_info.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+namespace trading {
+
+  //############################################################################
+  /// CLASS: Session Table
+  ///
+  /// Fixed capacity table of the logged in connections, one preallocated
+  /// conn info per slot. A session is named by a handle packing the slot
+  /// index with the slot's generation; orders carry the handle, and the
+  /// processor threads look a handle up without a lock or a reference
+  /// count.
+  ///
+  /// Each slot's generation is odd while the slot is open and even while
+  /// it is free, and moves on at every open and close, so a handle of a
+  /// closed session no longer matches its slot; handle 0 never matches.
+  /// find() only compares the generation; whoever uses the conn info takes
+  /// its mutex and compares the handle again, since the session may close
+  /// in between, and the slot be opened again, under its feet.
+  ///
+  /// Slots are split evenly between the reader threads, each opening and
+  /// closing its own on a free list nobody else touches, so the slot of a
+  /// handle also names the reader serving the session.
+  //############################################################################
+  class session_table_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// @param[in]  nreaders  number of reader threads
+    /// @param[in]  capacity  sessions open at once, over all readers
+    /// @return               none
+    /// @throws               std::string if capacity is below nreaders or
+    ///                       too large
+    //##########################################################################
+    session_table_t(size_t nreaders, size_t capacity);
+
+    //##########################################################################
+    /// Open
+    ///
+    /// Claims one of the reader's free slots and resets its conn info for
+    /// the session. Reader thread only.
+    ///
+    /// @param[in]  reader      index of the reader serving the session
+    /// @param[in]  socket      socket of the connection
+    /// @param[in]  trader_id   trader id
+    /// @param[in]  session_id  session id
+    /// @param[in]  channel     shared memory channel, NULL on TCP
+    /// @return                 conn info of the session, NULL if the
+    ///                         reader's slots are all open
+    /// @throws                 none
+    //##########################################################################
+    conn_info_t* open(size_t reader,
+                      int socket,
+                      int trader_id,
+                      boost::uint64_t session_id,
+                      shm_channel_t* channel);
+
+    //##########################################################################
+    /// Close
+    ///
+    /// Marks the socket closed, drops unsent reports and frees the slot;
+    /// the session's handle stops matching. Thread of the reader that
+    /// opened it only.
+    ///
+    /// @param[in]  conn  conn info returned by open()
+    /// @return           none
+    /// @throws           none
+    //##########################################################################
+    void close(conn_info_t* conn);
+
+    //##########################################################################
+    /// Find
+    ///
+    /// Wait free; any thread.
+    ///
+    /// @param[in]  handle  session handle
+    /// @return             conn info of the session, NULL if it is closed
+    ///                     or handle is 0
+    /// @throws             none
+    //##########################################################################
+    conn_info_t* find(session_handle_t handle) const {
+      boost::uint32_t index = static_cast<boost::uint32_t>(handle);
+      boost::uint32_t generation = static_cast<boost::uint32_t>(handle >> 32);
+      /// an even generation, handle 0 among them, names no open session
+      if ((generation & 1) == 0 || index >= capacity_ ||
+          slots_[index].generation_.load(boost::memory_order_acquire) !=
+          generation)
+        return NULL;
+      return &slots_[index].conn_;
+    }
+
+    //##########################################################################
+    /// Reader
+    ///
+    /// @param[in]  handle  session handle
+    /// @return             index of the reader serving the session
+    /// @throws             none
+    //##########################################################################
+    size_t reader(session_handle_t handle) const {
+      return static_cast<boost::uint32_t>(handle) / per_reader_;
+    }
+
+    //##########################################################################
+    /// Capacity Accessor
+    ///
+    /// @param   none
+    /// @return  sessions open at once, over all readers
+    /// @throws  none
+    //##########################################################################
+    size_t capacity() const { return capacity_; }
+
+  private:
+
+    //##########################################################################
+    /// STRUCT: Slot
+    //##########################################################################
+    struct slot_t {
+      slot_t() : generation_(0) {}
+
+      boost::atomic<boost::uint32_t>  generation_;  /// odd while open
+      conn_info_t                     conn_;
+    };
+
+    /// free slot indices of one reader, used as a stack
+    typedef std::vector<boost::uint32_t> free_list_t;
+
+    size_t                        capacity_;    /// number of slots
+    size_t                        per_reader_;  /// slots of each reader
+    boost::scoped_array<slot_t>   slots_;
+    std::vector<free_list_t>      free_;        /// by reader
+  };
+
+  //############################################################################
+  /// Constructor
+  //############################################################################
+  inline session_table_t::session_table_t(size_t nreaders, size_t capacity) :
+    capacity_(0),
+    per_reader_(nreaders ? capacity / nreaders : 0) {
+
+    if (per_reader_ == 0 || capacity > 0x7fffffff) {
+      throw std::string("Session table capacity must be between the number "
+                        "of readers and 2^31 - 1");
+    }
+    capacity_ = per_reader_ * nreaders;
+    slots_.reset(new slot_t[capacity_]);
+    free_.resize(nreaders);
+    for (size_t r = 0; r < nreaders; ++r) {
+      free_[r].reserve(per_reader_);
+      /// lowest slot on top
+      for (size_t i = per_reader_; i > 0; --i) {
+        free_[r].push_back(r * per_reader_ + i - 1);
+      }
+    }
+  }
+
+  //############################################################################
+  /// Open
+  //############################################################################
+  inline conn_info_t* session_table_t::open(size_t reader,
+                                            int socket,
+                                            int trader_id,
+                                            boost::uint64_t session_id,
+                                            shm_channel_t* channel) {
+
+    free_list_t& free = free_[reader];
+    if (free.empty())
+      return NULL;
+    boost::uint32_t index = free.back();
+    free.pop_back();
+
+    ////////
+    /// a processor holding a handle of the slot's last session may be
+    /// waiting on the mutex: it sees the new handle and backs off
+    ////////
+    slot_t& slot = slots_[index];
+    boost::uint32_t generation =
+      slot.generation_.load(boost::memory_order_relaxed) + 1;
+    conn_info_t& conn = slot.conn_;
+    {
+      boost::lock_guard<boost::mutex> lock(conn.mutex_);
+      conn.handle_ = static_cast<session_handle_t>(generation) << 32 | index;
+      conn.trader_id_ = trader_id;
+      conn.socket_ = socket;
+      conn.channel_ = channel;
+      conn.session_id_ = session_id;
+      conn.reader_ = reader;
+      conn.sequence_ = 0;
+      conn.send_buffer_.clear();
+      conn.pending_ = false;
+      conn.overflow_ = false;
+    }
+    slot.generation_.store(generation, boost::memory_order_release);
+    return &conn;
+  }
+
+  //############################################################################
+  /// Close
+  //############################################################################
+  inline void session_table_t::close(conn_info_t* conn) {
+
+    boost::uint32_t index = static_cast<boost::uint32_t>(conn->handle_);
+    slot_t& slot = slots_[index];
+    {
+      boost::lock_guard<boost::mutex> lock(conn->mutex_);
+      conn->handle_ = 0;
+      conn->socket_ = -1;
+      conn->channel_ = NULL;
+      conn->send_buffer_.clear();
+    }
+    slot.generation_.store(slot.generation_.load(boost::memory_order_relaxed)
+                           + 1, boost::memory_order_release);
+    free_[index / per_reader_].push_back(index);
+  }
+
+}  /// namespace trading
+
+#endif
@@ -0,0 +1,55 @@
+#include <session_table.hpp>
+#include <iostream>
+
+//##############################################################################
+/// Session table test.
+///
+/// Checks that a handle finds its slot only while the session is open:
+/// handle 0 and the handles of never opened and closed slots find nothing,
+/// also once the slot is opened again. Exits non zero on a failed check.
+//##############################################################################
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  if (! ok) {
+    std::cout << "FAILED: " << what << std::endl;
+    ++failures;
+  }
+}
+
+int main() {
+
+  trading::session_table_t table(2, 4);
+
+  check(table.find(0) == NULL, "handle 0 before any open");
+
+  trading::conn_info_t* conn = table.open(0, 3, 1, 1, NULL);
+  check(conn != NULL, "open");
+  trading::session_handle_t handle = conn->handle_;
+  check(handle != 0, "open handle is not 0");
+  check(table.find(handle) == conn, "open handle finds its slot");
+  check(table.find(0) == NULL, "handle 0 while slot 0 is open");
+  check(table.reader(handle) == 0, "slot names its reader");
+
+  table.close(conn);
+  check(table.find(handle) == NULL, "closed handle");
+  check(table.find(0) == NULL, "handle 0 after close");
+
+  trading::conn_info_t* again = table.open(0, 4, 2, 2, NULL);
+  check(again == conn, "slot reused");
+  check(again->handle_ != handle, "reopened slot has a new handle");
+  check(table.find(handle) == NULL, "stale handle on reopened slot");
+  check(table.find(again->handle_) == again, "new handle finds its slot");
+
+  ////////
+  /// the generation the slot moves to on close, even, names no session
+  ////////
+  trading::session_handle_t free_handle =
+    again->handle_ + (static_cast<trading::session_handle_t>(1) << 32);
+  table.close(again);
+  check(table.find(free_handle) == NULL, "even generation");
+
+  std::cout << (failures ? "FAILED" : "OK") << std::endl;
+  return failures ? 1 : 0;
+}
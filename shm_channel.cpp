@@ -0,0 +1,473 @@
+#include <shm_channel.hpp>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+
+namespace trading {
+
+  /// segment identification, "TRDSHM" and a format version
+  static const boost::uint64_t shm_magic = 0x4d4853445254ULL;
+  static const boost::uint32_t shm_version = 1;
+
+  /// idle polls between looks for a hang up when busy polling
+  static const size_t hang_up_polls = 1024;
+
+  ////////
+  /// the other process reads and writes the shared fields: loads of what
+  /// it writes acquire, stores of what it reads release
+  ////////
+  static boost::uint64_t load_acquire(const boost::uint64_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+  }
+
+  static void store_release(boost::uint64_t* p, boost::uint64_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+  }
+
+  ////////
+  /// a side flags that it sleeps, then looks at the ring once more; the
+  /// other side moves the ring, then looks at the flag. A full fence
+  /// between the store and the load on both sides means at least one of
+  /// them sees the other's store, so no wake up is lost
+  ////////
+  static bool claim(boost::uint32_t* flag) {
+    return __atomic_load_n(flag, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(flag, 0, __ATOMIC_ACQ_REL);
+  }
+
+  //###########################################################################
+  /// Constructor (shm_channel_t, create)
+  //###########################################################################
+  shm_channel_t::
+  shm_channel_t(size_t ring_size, bool busy_poll) :
+    fd_(-1),
+    segment_(NULL),
+    size_(0),
+    mask_(0),
+    busy_poll_(busy_poll),
+    out_head_(0),
+    in_tail_(0),
+    out_tail_(0),
+    in_head_(0),
+    broken_(false) {
+
+    size_t n = ::sysconf(_SC_PAGESIZE);
+    while (n < ring_size)
+      n <<= 1;
+    if (n > 0x80000000UL) {
+      throw std::string("Shared memory ring too large");
+    }
+    fd_ = ::memfd_create("trading-session", MFD_CLOEXEC);
+    if (fd_ == -1) {
+      throw std::string("Shared memory segment creation failed: ") +
+        ::strerror(errno);
+    }
+    size_t size = sizeof(header_t) + 2 * n;
+    if (::ftruncate(fd_, size) == -1) {
+      std::string s = "Shared memory segment sizing failed: " +
+        std::string(::strerror(errno));
+      ::close(fd_);
+      throw s;
+    }
+    /// the segment comes zeroed: positions at 0 and nobody waiting
+    map(size, 1);
+    header_t* header = static_cast<header_t*>(segment_);
+    header->version_ = shm_version;
+    header->ring_size_ = n;
+    header->flags_ = busy_poll_ ? busy_polling : 0;
+    mask_ = n - 1;
+
+    ////////
+    /// the server sleeps until the login arrives, so the client rings for
+    /// it; the magic goes last, the client checks it
+    ////////
+    in_->reader_waiting_ = busy_poll_ ? 0 : 1;
+    __atomic_store_n(&header->magic_, shm_magic, __ATOMIC_RELEASE);
+  }
+
+  //###########################################################################
+  /// Constructor (shm_channel_t, attach)
+  //###########################################################################
+  shm_channel_t::
+  shm_channel_t(int fd) :
+    fd_(fd),
+    segment_(NULL),
+    size_(0),
+    mask_(0),
+    busy_poll_(false),
+    out_head_(0),
+    in_tail_(0),
+    out_tail_(0),
+    in_head_(0),
+    broken_(false) {
+
+    struct stat st;
+    if (::fstat(fd_, &st) == -1 ||
+        static_cast<size_t>(st.st_size) < sizeof(header_t)) {
+      ::close(fd_);
+      throw std::string("Shared memory segment has no header");
+    }
+    map(st.st_size, 0);
+    const header_t* header = static_cast<const header_t*>(segment_);
+    size_t n = header->ring_size_;
+    if (__atomic_load_n(&header->magic_, __ATOMIC_ACQUIRE) != shm_magic ||
+        header->version_ != shm_version || n == 0 || (n & (n - 1)) ||
+        sizeof(header_t) + 2 * n > size_) {
+      ::munmap(segment_, size_);
+      ::close(fd_);
+      throw std::string("Shared memory segment is no session channel");
+    }
+    mask_ = n - 1;
+    busy_poll_ = header->flags_ & busy_polling;
+    out_bytes_ = static_cast<char*>(segment_) + sizeof(header_t);
+    in_bytes_ = out_bytes_ + n;
+  }
+
+  //###########################################################################
+  /// Map (shm_channel_t)
+  //###########################################################################
+  void
+  shm_channel_t::
+  map(size_t size, size_t out) {
+
+    segment_ = ::mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, 0);
+    if (segment_ == MAP_FAILED) {
+      segment_ = NULL;
+      ::close(fd_);
+      throw std::string("Shared memory segment mapping failed: ") +
+        ::strerror(errno);
+    }
+    size_ = size;
+    header_t* header = static_cast<header_t*>(segment_);
+    char* bytes = static_cast<char*>(segment_) + sizeof(header_t);
+    size_t n = (size - sizeof(header_t)) / 2;
+    out_ = &header->rings_[out];
+    in_ = &header->rings_[1 - out];
+    out_bytes_ = bytes + out * n;
+    in_bytes_ = bytes + (1 - out) * n;
+  }
+
+  //###########################################################################
+  /// Destructor (shm_channel_t)
+  //###########################################################################
+  shm_channel_t::
+  ~shm_channel_t() {
+    if (segment_) {
+      ::munmap(segment_, size_);
+    }
+    if (fd_ != -1) {
+      ::close(fd_);
+    }
+  }
+
+  //###########################################################################
+  /// Offer (shm_channel_t)
+  //###########################################################################
+  void
+  shm_channel_t::
+  offer(int socket) const {
+
+    ////////
+    /// one byte of data carries the descriptor; a fresh socket always
+    /// has room for it
+    ////////
+    char byte = 0;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    union {
+      struct cmsghdr  header;
+      char            buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    ::memset(&control, 0, sizeof(control));
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    ::memcpy(CMSG_DATA(cmsg), &fd_, sizeof(int));
+    if (::sendmsg(socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) != 1) {
+      throw std::string("Shared memory segment offer failed: ") +
+        ::strerror(errno);
+    }
+  }
+
+  //###########################################################################
+  /// Write (shm_channel_t)
+  //###########################################################################
+  size_t
+  shm_channel_t::
+  write(const char* buf, size_t size) {
+
+    size_t capacity = mask_ + 1;
+    if (capacity - (out_tail_ - out_head_) < size) {
+      out_head_ = load_acquire(&out_->head_);
+    }
+    ////////
+    /// the other process may store any head: one past the tail, or more
+    /// than a ring behind it, breaks the channel rather than the mapping
+    ////////
+    if (broken_ || out_tail_ - out_head_ > capacity) {
+      broken_ = true;
+      return 0;
+    }
+    size_t n = std::min<size_t>(size, capacity - (out_tail_ - out_head_));
+    if (n == 0)
+      return 0;
+    size_t at = out_tail_ & mask_;
+    size_t first = std::min(n, capacity - at);
+    ::memcpy(out_bytes_ + at, buf, first);
+    ::memcpy(out_bytes_, buf + first, n - first);
+    out_tail_ += n;
+    store_release(&out_->tail_, out_tail_);
+    return n;
+  }
+
+  //###########################################################################
+  /// Read (shm_channel_t)
+  //###########################################################################
+  size_t
+  shm_channel_t::
+  read(char* buf, size_t size) {
+
+    size_t capacity = mask_ + 1;
+    if (in_tail_ - in_head_ < size) {
+      in_tail_ = load_acquire(&in_->tail_);
+    }
+    /// nor may a tail be behind the head or more than a ring ahead of it
+    if (broken_ || in_tail_ - in_head_ > capacity) {
+      broken_ = true;
+      return 0;
+    }
+    size_t n = std::min<size_t>(size, in_tail_ - in_head_);
+    if (n == 0)
+      return 0;
+    size_t at = in_head_ & mask_;
+    size_t first = std::min(n, capacity - at);
+    ::memcpy(buf, in_bytes_ + at, first);
+    ::memcpy(buf + first, in_bytes_, n - first);
+    in_head_ += n;
+    store_release(&in_->head_, in_head_);
+    return n;
+  }
+
+  //###########################################################################
+  /// Readable (shm_channel_t)
+  //###########################################################################
+  bool
+  shm_channel_t::
+  readable() {
+
+    if (in_tail_ == in_head_) {
+      in_tail_ = load_acquire(&in_->tail_);
+    }
+    return in_tail_ != in_head_;
+  }
+
+  //###########################################################################
+  /// Wait Readable (shm_channel_t)
+  //###########################################################################
+  bool
+  shm_channel_t::
+  wait_readable() {
+
+    __atomic_store_n(&in_->reader_waiting_, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    in_tail_ = load_acquire(&in_->tail_);
+    if (in_tail_ != in_head_) {
+      __atomic_store_n(&in_->reader_waiting_, 0, __ATOMIC_RELAXED);
+      return false;
+    }
+    return true;
+  }
+
+  //###########################################################################
+  /// Wait Writable (shm_channel_t)
+  //###########################################################################
+  bool
+  shm_channel_t::
+  wait_writable() {
+
+    __atomic_store_n(&out_->writer_waiting_, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    out_head_ = load_acquire(&out_->head_);
+    if (out_tail_ - out_head_ <= mask_) {
+      __atomic_store_n(&out_->writer_waiting_, 0, __ATOMIC_RELAXED);
+      return false;
+    }
+    return true;
+  }
+
+  //###########################################################################
+  /// Wake (shm_channel_t)
+  //###########################################################################
+  bool
+  shm_channel_t::
+  wake() {
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bool reader = claim(&out_->reader_waiting_);
+    bool writer = claim(&in_->writer_waiting_);
+    return reader || writer;
+  }
+
+  //###########################################################################
+  /// Notify (shm_channel_t)
+  //###########################################################################
+  void
+  shm_channel_t::
+  notify(int socket) {
+    char byte = 0;
+    while (::send(socket, &byte, 1, MSG_NOSIGNAL | MSG_DONTWAIT) == -1 &&
+           errno == EINTR)
+      ;
+  }
+
+  //###########################################################################
+  /// Shm Connect
+  //###########################################################################
+  shm_channel_ptr shm_connect(const std::string& path, int& socket) {
+
+    struct sockaddr_un addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      throw std::string("Unix socket path too long: ") + path;
+    }
+    ::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket == -1) {
+      throw std::string("Unix socket creation failed: ") + ::strerror(errno);
+    }
+    if (::connect(socket, reinterpret_cast<struct sockaddr*>(&addr),
+                  sizeof(addr)) == -1) {
+      std::string s = "Unix socket connect to " + path + " failed: " +
+        ::strerror(errno);
+      ::close(socket);
+      throw s;
+    }
+    /// the server offers the segment straight after accepting
+    char byte;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    union {
+      struct cmsghdr  header;
+      char            buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n;
+    while ((n = ::recvmsg(socket, &msg, MSG_CMSG_CLOEXEC)) == -1 &&
+           errno == EINTR)
+      ;
+    struct cmsghdr* cmsg = n == 1 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (! cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+      ::close(socket);
+      throw std::string("No shared memory segment offered on ") + path;
+    }
+    int fd;
+    ::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    try {
+      return boost::make_shared<shm_channel_t>(fd);
+    }
+    catch (const std::string&) {
+      ::close(socket);
+      throw;
+    }
+  }
+
+  //###########################################################################
+  /// Shm Write
+  //###########################################################################
+  void shm_write(shm_channel_t& channel,
+                 int socket,
+                 const char* buf,
+                 size_t size) {
+
+    ////////
+    /// a full ring is rare and short, the server reads it as it frames;
+    /// the doorbell goes out as soon as a part is in, so a sleeping
+    /// server starts on it
+    ////////
+    while (size && ! channel.broken()) {
+      size_t n = channel.write(buf, size);
+      if (n == 0) {
+        boost::this_thread::yield();
+        continue;
+      }
+      buf += n;
+      size -= n;
+      if (channel.wake()) {
+        shm_channel_t::notify(socket);
+      }
+    }
+  }
+
+  //###########################################################################
+  /// Shm Read
+  //###########################################################################
+  ssize_t shm_read(shm_channel_t& channel,
+                   int socket,
+                   char* buf,
+                   size_t size) {
+
+    char bell[64];
+    size_t polls = 0;
+    for (;;) {
+      size_t n = channel.read(buf, size);
+      if (n) {
+        if (channel.wake()) {
+          shm_channel_t::notify(socket);
+        }
+        return n;
+      }
+      if (channel.broken())
+        return -1;
+      ////////
+      /// busy polling: spin on the ring, and only now and then look for a
+      /// hang up, which is all the socket carries
+      ////////
+      if (channel.busy_poll()) {
+        if (++polls % hang_up_polls)
+          continue;
+        ssize_t r = ::recv(socket, bell, sizeof(bell), MSG_DONTWAIT);
+        if (r == 0)
+          return channel.read(buf, size);
+        if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+            errno != EINTR)
+          return -1;
+        continue;
+      }
+      /// sleep on the doorbell, unless bytes arrived meanwhile
+      if (! channel.wait_readable())
+        continue;
+      ssize_t r = ::recv(socket, bell, sizeof(bell), 0);
+      if (r == 0)
+        return channel.read(buf, size);
+      if (r == -1 && errno != EINTR)
+        return -1;
+    }
+  }
+
+}  /// namespace trading
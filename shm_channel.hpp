@@ -0,0 +1,319 @@
+#ifndef __SHM_CHANNEL_HPP__
+#define __SHM_CHANNEL_HPP__
+
+#include <string>
+#include <sys/types.h>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace trading {
+
+  //############################################################################
+  /// CLASS: Shared Memory Channel
+  ///
+  /// Transport of one session with a client on the same host: two single
+  /// producer, single consumer byte rings in a memfd segment mapped by both
+  /// processes, one per direction, carrying the same byte stream as a TCP
+  /// connection (see the wire protocol in xmit_order.hpp). Messages may
+  /// straddle the end of a ring and may be read in pieces, as from a
+  /// socket.
+  ///
+  /// The server creates the segment and passes its descriptor over the
+  /// Unix socket the client connected to (see offer() and shm_connect());
+  /// from then on the socket is only a doorbell, and its hang up the end
+  /// of the session. A side going to sleep on an empty ring, or on a full
+  /// one, flags it in the segment first (see wait_readable() and
+  /// wait_writable()); the other side rings the doorbell, one byte on the
+  /// socket, only when it finds the flag set after a write or read (see
+  /// wake()). While both sides are busy no system call is made at all;
+  /// with busy polling nobody sleeps on an empty ring, and the doorbell
+  /// only rings for a server waiting on a full one.
+  ///
+  /// Positions run freely and are masked into the ring; each side keeps
+  /// its own positions and the last position of the other it saw, and only
+  /// loads the shared one when that is not enough. A position of the other
+  /// side more than a ring away from this side's breaks the channel (see
+  /// broken()); nothing is copied out of the ring's bounds. Shared fields are on cache lines of their
+  /// own, and accessed with the compiler's atomic builtins, as memory
+  /// shared with another process.
+  //############################################################################
+  class shm_channel_t {
+  public:
+
+    //##########################################################################
+    /// Constructor (create)
+    ///
+    /// Server side: creates and maps a segment with two rings.
+    ///
+    /// @param[in]  ring_size  bytes per ring, rounded up to a power of two
+    ///                        of at least a page
+    /// @param[in]  busy_poll  both sides poll instead of sleeping
+    /// @return                none
+    /// @throws                std::string if any step fails
+    //##########################################################################
+    shm_channel_t(size_t ring_size, bool busy_poll);
+
+    //##########################################################################
+    /// Constructor (attach)
+    ///
+    /// Client side: maps the segment the server offered.
+    ///
+    /// @param[in]  fd  segment descriptor, closed by the channel
+    /// @return         none
+    /// @throws         std::string if the segment is no channel
+    //##########################################################################
+    explicit shm_channel_t(int fd);
+
+    //##########################################################################
+    /// Destructor
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    ~shm_channel_t();
+
+    //##########################################################################
+    /// Offer
+    ///
+    /// Server side: passes the segment descriptor to the client.
+    ///
+    /// @param[in]  socket  client's Unix socket
+    /// @return             none
+    /// @throws             std::string if the descriptor can't be sent
+    //##########################################################################
+    void offer(int socket) const;
+
+    //##########################################################################
+    /// Write
+    ///
+    /// Appends as much of the bytes as the outbound ring has room for.
+    ///
+    /// @param[in]  buf   bytes to write
+    /// @param[in]  size  number of bytes
+    /// @return           bytes written, 0 if the ring is full or the
+    ///                   channel is broken
+    /// @throws           none
+    //##########################################################################
+    size_t write(const char* buf, size_t size);
+
+    //##########################################################################
+    /// Read
+    ///
+    /// Takes as many bytes from the inbound ring as it holds and fit.
+    ///
+    /// @param[out]  buf   bytes read
+    /// @param[in]   size  room in buf
+    /// @return            bytes read, 0 if the ring is empty or the
+    ///                    channel is broken
+    /// @throws            none
+    //##########################################################################
+    size_t read(char* buf, size_t size);
+
+    //##########################################################################
+    /// Readable
+    ///
+    /// @param   none
+    /// @return  true if the inbound ring holds bytes
+    /// @throws  none
+    //##########################################################################
+    bool readable();
+
+    //##########################################################################
+    /// Wait Readable
+    ///
+    /// Flags that this side sleeps until the doorbell rings, unless bytes
+    /// arrived in the meantime.
+    ///
+    /// @param   none
+    /// @return  false if the inbound ring holds bytes, and there is no
+    ///          sleeping
+    /// @throws  none
+    //##########################################################################
+    bool wait_readable();
+
+    //##########################################################################
+    /// Wait Writable
+    ///
+    /// Flags that this side sleeps until the doorbell rings, unless the
+    /// outbound ring has room by now.
+    ///
+    /// @param   none
+    /// @return  false if the outbound ring has room, and there is no
+    ///          sleeping
+    /// @throws  none
+    //##########################################################################
+    bool wait_writable();
+
+    //##########################################################################
+    /// Wake
+    ///
+    /// After a write or read, claims the wake up of the other side if it
+    /// sleeps on what this side just did.
+    ///
+    /// @param   none
+    /// @return  true if the caller must ring the doorbell (see notify())
+    /// @throws  none
+    //##########################################################################
+    bool wake();
+
+    //##########################################################################
+    /// Notify
+    ///
+    /// Rings the doorbell: one byte on the Unix socket, never blocking; a
+    /// full socket already holds a ring the other side has yet to see.
+    ///
+    /// @param[in]  socket  Unix socket of the session
+    /// @return             none
+    /// @throws             none
+    //##########################################################################
+    static void notify(int socket);
+
+    //##########################################################################
+    /// Busy Poll Accessor
+    ///
+    /// @param   none
+    /// @return  true if both sides poll instead of sleeping
+    /// @throws  none
+    //##########################################################################
+    bool busy_poll() const { return busy_poll_; }
+
+    //##########################################################################
+    /// Broken Accessor
+    ///
+    /// @param   none
+    /// @return  true once the other side was found to have stored ring
+    ///          positions that are inconsistent with this side's; the
+    ///          session must be closed
+    /// @throws  none
+    //##########################################################################
+    bool broken() const { return broken_; }
+
+  private:
+
+    /// not copyable, owns the mapping
+    shm_channel_t(const shm_channel_t&);
+    shm_channel_t& operator=(const shm_channel_t&);
+
+    enum { cache_line = 64 };
+
+    //##########################################################################
+    /// STRUCT: Ring Control
+    ///
+    /// Shared state of one ring: positions and sleep flags, each written
+    /// mostly by one side, on cache lines of their own.
+    //##########################################################################
+    struct control_t {
+      boost::uint64_t  tail_;            /// next position written
+      char             pad0_[cache_line - 8];
+      boost::uint32_t  reader_waiting_;  /// consumer sleeps on empty
+      char             pad1_[cache_line - 4];
+      boost::uint64_t  head_;            /// next position read
+      char             pad2_[cache_line - 8];
+      boost::uint32_t  writer_waiting_;  /// producer sleeps on full
+      char             pad3_[cache_line - 4];
+    };
+
+    //##########################################################################
+    /// STRUCT: Segment Header
+    ///
+    /// At the start of the segment, followed by the ring controls and then
+    /// the two rings' bytes, client to server first.
+    //##########################################################################
+    struct header_t {
+      boost::uint64_t  magic_;
+      boost::uint32_t  version_;
+      boost::uint32_t  ring_size_;       /// bytes per ring
+      boost::uint32_t  flags_;           /// flags_t
+      char             pad_[cache_line - 20];
+      control_t        rings_[2];        /// client to server, server to
+                                         /// client
+    };
+
+    /// Segment Flags
+    enum flags_t {
+      busy_polling = 1
+    };
+
+    //##########################################################################
+    /// Map
+    ///
+    /// Maps the segment and points the rings at it, outbound ring_[out].
+    ///
+    /// @param[in]  size  segment size
+    /// @param[in]  out   index of the outbound ring
+    /// @return           none
+    /// @throws           std::string if the mapping fails
+    //##########################################################################
+    void map(size_t size, size_t out);
+
+    int                fd_;
+    void*              segment_;
+    size_t             size_;         /// of the mapping
+    size_t             mask_;         /// ring size - 1
+    bool               busy_poll_;
+    control_t*         out_;          /// ring this side writes
+    char*              out_bytes_;
+    control_t*         in_;           /// ring this side reads
+    char*              in_bytes_;
+    boost::uint64_t    out_head_;     /// last head of out_ seen
+    boost::uint64_t    in_tail_;      /// last tail of in_ seen
+    boost::uint64_t    out_tail_;     /// tail of out_, as written
+    boost::uint64_t    in_head_;      /// head of in_, as written
+    bool               broken_;       /// positions found inconsistent
+  };
+
+  typedef boost::shared_ptr<shm_channel_t> shm_channel_ptr;
+
+  //############################################################################
+  /// Shm Connect
+  ///
+  /// Client side set up of a session: connects to the server's Unix
+  /// socket and maps the segment the server offers on it. The session then
+  /// starts with a login, written to the channel.
+  ///
+  /// @param[in]   path    server's Unix socket
+  /// @param[out]  socket  connected Unix socket, the session's doorbell
+  /// @return              channel of the session
+  /// @throws              std::string if any step fails
+  //############################################################################
+  shm_channel_ptr shm_connect(const std::string& path, int& socket);
+
+  //############################################################################
+  /// Shm Write
+  ///
+  /// Client side blocking write: writes every byte, yielding while the
+  /// ring is full, and rings the doorbell if the server sleeps. Producers
+  /// on the channel must be serialized by the caller.
+  ///
+  /// @param[inout]  channel  session's channel
+  /// @param[in]     socket   session's Unix socket
+  /// @param[in]     buf      bytes to write
+  /// @param[in]     size     number of bytes
+  /// @return                 none
+  /// @throws                 none
+  //############################################################################
+  void shm_write(shm_channel_t& channel,
+                 int socket,
+                 const char* buf,
+                 size_t size);
+
+  //############################################################################
+  /// Shm Read
+  ///
+  /// Client side blocking read, as ::read() on a socket: waits for bytes,
+  /// polling or sleeping on the doorbell as the channel says.
+  ///
+  /// @param[inout]  channel  session's channel
+  /// @param[in]     socket   session's Unix socket
+  /// @param[out]    buf      bytes read
+  /// @param[in]     size     room in buf
+  /// @return                 bytes read, 0 once the server has closed the
+  ///                         session and every byte is read, -1 on error
+  /// @throws                 none
+  //############################################################################
+  ssize_t shm_read(shm_channel_t& channel, int socket, char* buf, size_t size);
+
+}  /// namespace trading
+
+#endif
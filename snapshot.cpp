@@ -0,0 +1,270 @@
+#include <snapshot.hpp>
+#include <tracer.hpp>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+namespace trading {
+
+  static const char      snapshot_magic[8] = "OBSNAP1";
+  static const unsigned  snapshot_version = 2;
+
+  //###########################################################################
+  /// List Snapshots
+  ///
+  /// Sequence numbers of the snapshot.<sequence> files in dir, ascending.
+  //###########################################################################
+  static void list(const std::string& dir,
+                   std::vector<unsigned long long>& sequences) {
+
+    DIR* d = ::opendir(dir.c_str());
+    if (! d) {
+      throw "Failed to open snapshot directory: " + dir;
+    }
+    while (struct dirent* e = ::readdir(d)) {
+      unsigned long long n;
+      char c;
+      if (::sscanf(e->d_name, "snapshot.%llu%c", &n, &c) == 1) {
+        sequences.push_back(n);
+      }
+    }
+    ::closedir(d);
+    std::sort(sequences.begin(), sequences.end());
+  }
+
+  //###########################################################################
+  /// Snapshot Path
+  ///
+  /// Zero padded so the names sort like the sequence numbers.
+  //###########################################################################
+  static std::string snapshot_path(const std::string& dir,
+                                   unsigned long long sequence) {
+    char name[40];
+    ::snprintf(name, sizeof(name), "snapshot.%020llu", sequence);
+    return dir + "/" + name;
+  }
+
+  //###########################################################################
+  /// Constructor (snapshot_t)
+  //###########################################################################
+  snapshot_t::
+  snapshot_t(size_t nshards,
+             boost::uint64_t sequence,
+             unsigned journal_segment) :
+    sequence_(sequence),
+    journal_segment_(journal_segment),
+    shards_(nshards),
+    done_(0)
+  {}
+
+  //###########################################################################
+  /// Copy (snapshot_t)
+  //###########################################################################
+  bool
+  snapshot_t::
+  copy(size_t shard,
+       boost::uint32_t symbol_id,
+       const order_book_t& book) {
+
+    shard_t& s = shards_[shard];
+    s.resting_.clear();
+    book.orders(s.resting_);
+    if (s.resting_.empty() && book.sequence() == 0)
+      return false;
+
+    snapshot_book_t b;
+    b.sequence_ = book.sequence();
+    b.first_ = s.orders_.size();
+    b.symbol_id_ = symbol_id;
+    b.norders_ = s.resting_.size();
+    b.base_ = book.base();
+    b.reference_ = book.reference();
+    s.books_.push_back(b);
+
+    for (size_t i = 0; i < s.resting_.size(); ++i) {
+      const order_t& order = *s.resting_[i];
+      snapshot_order_t o;
+      o.order_id_ = order.order_id();
+      o.session_id_ = order.session_id();
+      o.trader_id_ = order.trader_id();
+      o.quantity_ = order.quantity();
+      o.balance_ = order.balance();
+      o.price_ = order.price();
+      o.side_ = order.side();
+      o.reserved_ = 0;
+      s.orders_.push_back(o);
+    }
+    return true;
+  }
+
+  //###########################################################################
+  /// Done (snapshot_t)
+  //###########################################################################
+  void
+  snapshot_t::
+  done(size_t shard, boost::uint64_t next_id) {
+
+    shards_[shard].next_id_ = next_id;
+    shards_[shard].resting_ = orders_t();
+    done_.fetch_add(1, boost::memory_order_release);
+  }
+
+  //###########################################################################
+  /// Write (snapshot_t)
+  //###########################################################################
+  std::string
+  snapshot_t::
+  write(const std::string& dir,
+        const symbol_directory_t& symbols) const {
+
+    snapshot_header_t header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic_, snapshot_magic, sizeof(header.magic_));
+    header.version_ = snapshot_version;
+    header.nshards_ = shards_.size();
+    header.sequence_ = sequence_;
+    header.journal_segment_ = journal_segment_;
+    header.nsymbols_ = symbols.size();
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      header.nbooks_ += shards_[i].books_.size();
+      header.norders_ += shards_[i].orders_.size();
+    }
+
+    std::string tmp = dir + "/snapshot.tmp";
+    FILE* f = ::fopen(tmp.c_str(), "wb");
+    if (! f) {
+      throw "Failed to create snapshot: " + tmp + ": " + ::strerror(errno);
+    }
+    ::fwrite(&header, sizeof(header), 1, f);
+
+    for (boost::uint32_t id = 0; id < header.nsymbols_; ++id) {
+      ::fwrite(symbols.name(id), order_t::stock_size, 1, f);
+    }
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      ::fwrite(&shards_[i].next_id_, sizeof(boost::uint64_t), 1, f);
+    }
+    /// book order indices are per shard until here
+    boost::uint64_t first = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      const shard_t& s = shards_[i];
+      for (size_t j = 0; j < s.books_.size(); ++j) {
+        snapshot_book_t b = s.books_[j];
+        b.first_ += first;
+        ::fwrite(&b, sizeof(b), 1, f);
+      }
+      first += s.orders_.size();
+    }
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      const shard_t& s = shards_[i];
+      if (! s.orders_.empty()) {
+        ::fwrite(&s.orders_[0], sizeof(snapshot_order_t), s.orders_.size(),
+                 f);
+      }
+    }
+
+    bool failed =
+      ::fflush(f) != 0 || ::ferror(f) || ::fsync(::fileno(f)) != 0;
+    int error = errno;
+    ::fclose(f);
+    if (failed) {
+      ::unlink(tmp.c_str());
+      throw "Failed to write snapshot: " + tmp + ": " + ::strerror(error);
+    }
+
+    /// publish it, make the rename durable, then drop the older snapshots
+    std::string file = snapshot_path(dir, sequence_);
+    if (::rename(tmp.c_str(), file.c_str()) == -1) {
+      throw "Failed to rename snapshot: " + file + ": " + ::strerror(errno);
+    }
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd != -1) {
+      ::fsync(fd);
+      ::close(fd);
+    }
+    std::vector<unsigned long long> sequences;
+    list(dir, sequences);
+    for (size_t i = 0; i < sequences.size(); ++i) {
+      if (sequences[i] < sequence_) {
+        ::unlink(snapshot_path(dir, sequences[i]).c_str());
+      }
+    }
+    return file;
+  }
+
+  //###########################################################################
+  /// Latest (snapshot_t)
+  //###########################################################################
+  std::string
+  snapshot_t::
+  latest(const std::string& dir) {
+
+    std::vector<unsigned long long> sequences;
+    list(dir, sequences);
+    if (sequences.empty())
+      return std::string();
+    return snapshot_path(dir, sequences.back());
+  }
+
+  //###########################################################################
+  /// Constructor (snapshot_file_t)
+  //###########################################################################
+  snapshot_file_t::
+  snapshot_file_t(const std::string& path) :
+    base_(NULL),
+    size_(0) {
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw "Failed to open snapshot: " + path + ": " + ::strerror(errno);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == -1 ||
+        static_cast<size_t>(st.st_size) < sizeof(snapshot_header_t)) {
+      ::close(fd);
+      throw "Truncated snapshot: " + path;
+    }
+    size_ = st.st_size;
+    base_ = ::mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base_ == MAP_FAILED) {
+      base_ = NULL;
+      throw "Failed to map snapshot: " + path + ": " + ::strerror(errno);
+    }
+
+    const char* p = static_cast<const char*>(base_);
+    header_ = reinterpret_cast<const snapshot_header_t*>(p);
+    if (::memcmp(header_->magic_, snapshot_magic, sizeof(snapshot_magic)) ||
+        header_->version_ != snapshot_version) {
+      ::munmap(base_, size_);
+      throw "Not a snapshot: " + path;
+    }
+    p += sizeof(snapshot_header_t);
+    names_ = p;
+    p += header_->nsymbols_ * order_t::stock_size;
+    next_ids_ = reinterpret_cast<const boost::uint64_t*>(p);
+    p += header_->nshards_ * sizeof(boost::uint64_t);
+    books_ = reinterpret_cast<const snapshot_book_t*>(p);
+    p += header_->nbooks_ * sizeof(snapshot_book_t);
+    orders_ = reinterpret_cast<const snapshot_order_t*>(p);
+    p += header_->norders_ * sizeof(snapshot_order_t);
+
+    if (p != static_cast<const char*>(base_) + size_) {
+      ::munmap(base_, size_);
+      throw "Truncated snapshot: " + path;
+    }
+  }
+
+  //###########################################################################
+  /// Destructor (snapshot_file_t)
+  //###########################################################################
+  snapshot_file_t::
+  ~snapshot_file_t() {
+    ::munmap(base_, size_);
+  }
+
+}  /// namespace trading
@@ -0,0 +1,275 @@
+#ifndef __SNAPSHOT_HPP__
+#define __SNAPSHOT_HPP__
+
+#include <string>
+#include <vector>
+#include <order.hpp>
+#include <symbol_directory.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+
+namespace trading {
+
+  //############################################################################
+  /// Snapshot File Layout
+  ///
+  /// A snapshot is one flat file of fixed size records, read back through a
+  /// read only mapping without parsing:
+  /// - snapshot_header_t
+  /// - nsymbols_ stock names of order_t::stock_size bytes, by symbol id
+  ///   (empty for ids not in use)
+  /// - nshards_ next order ids (boost::uint64_t), by shard
+  /// - nbooks_ snapshot_book_t, grouped by shard
+  /// - norders_ snapshot_order_t, each book's orders in price-time order
+  /// Every record is a multiple of 8 bytes, so every section is aligned.
+  //############################################################################
+
+  //############################################################################
+  /// STRUCT: Snapshot Header
+  //############################################################################
+  struct snapshot_header_t {
+    char             magic_[8];         /// "OBSNAP1"
+    boost::uint32_t  version_;
+    boost::uint32_t  nshards_;          /// processor count it was taken with
+    boost::uint64_t  sequence_;         /// inbound sequence when started
+    boost::uint32_t  journal_segment_;  /// first journal segment to replay
+    boost::uint32_t  nsymbols_;
+    boost::uint64_t  nbooks_;
+    boost::uint64_t  norders_;
+  };
+
+  //############################################################################
+  /// STRUCT: Snapshot Book
+  //############################################################################
+  struct snapshot_book_t {
+    boost::uint64_t  sequence_;   /// last message applied to the book
+    boost::uint64_t  first_;      /// index of the book's first order
+    boost::uint32_t  symbol_id_;
+    boost::uint32_t  norders_;    /// resting orders of the book
+    boost::int32_t   base_;       /// price of the ladder's level 0
+    boost::int32_t   reference_;  /// last trade price, 0 if none
+  };
+
+  //############################################################################
+  /// STRUCT: Snapshot Order
+  //############################################################################
+  struct snapshot_order_t {
+    boost::uint64_t  order_id_;
+    boost::uint64_t  session_id_;
+    boost::int32_t   trader_id_;
+    boost::int32_t   quantity_;
+    boost::int32_t   balance_;    /// open balance
+    boost::int32_t   price_;
+    boost::int32_t   side_;       /// order_t::side_t
+    boost::int32_t   reserved_;
+  };
+
+  //############################################################################
+  /// CLASS: Snapshot
+  ///
+  /// Snapshot being taken. Each processor thread copies the books of its
+  /// shard into the snapshot one book at a time, in between batches, so
+  /// matching is never paused for longer than one book copy; once every
+  /// shard is done the snapshot is written to a file.
+  ///
+  /// Books are copied at different times, so the snapshot is not a single
+  /// point in time: every book carries the sequence number of the last
+  /// message applied to it, and the journal is replayed from the segment
+  /// in use when the snapshot started, skipping messages a book has seen.
+  //############################################################################
+  class snapshot_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// @param[in]  nshards          number of shards
+    /// @param[in]  sequence         inbound sequence number when started
+    /// @param[in]  journal_segment  journal segment in use when started
+    /// @return                      none
+    /// @throws                      none
+    //##########################################################################
+    snapshot_t(size_t nshards,
+               boost::uint64_t sequence,
+               unsigned journal_segment);
+
+    //##########################################################################
+    /// Copy
+    ///
+    /// Copies the resting orders and sequence number of one book. Books no
+    /// message was applied to are left out; emptied books are kept, their
+    /// sequence number stops the journal replaying orders into them.
+    /// Called by the processor thread of the shard.
+    ///
+    /// @param[in]  shard      shard of the book
+    /// @param[in]  symbol_id  symbol id of the book
+    /// @param[in]  book       book to copy
+    /// @return                false if the book was left out
+    /// @throws                none
+    //##########################################################################
+    bool copy(size_t shard,
+              boost::uint32_t symbol_id,
+              const order_book_t& book);
+
+    //##########################################################################
+    /// Done
+    ///
+    /// Marks a shard as completely copied.
+    ///
+    /// @param[in]  shard    shard index
+    /// @param[in]  next_id  id of the shard's next new order
+    /// @return              none
+    /// @throws              none
+    //##########################################################################
+    void done(size_t shard, boost::uint64_t next_id);
+
+    //##########################################################################
+    /// Complete Accessor
+    ///
+    /// @param   none
+    /// @return  true once every shard is done
+    /// @throws  none
+    //##########################################################################
+    bool complete() const {
+      return done_.load(boost::memory_order_acquire) == shards_.size();
+    }
+
+    //##########################################################################
+    /// Write
+    ///
+    /// Writes the complete snapshot to a temporary file, syncs it and
+    /// renames it to snapshot.<sequence> in dir, then removes the older
+    /// snapshots; a crash while writing leaves the previous one in place.
+    ///
+    /// @param[in]  dir      snapshot directory, must exist
+    /// @param[in]  symbols  symbol directory, for the stock names
+    /// @return              path of the snapshot
+    /// @throws              std::string on failure
+    //##########################################################################
+    std::string write(const std::string& dir,
+                      const symbol_directory_t& symbols) const;
+
+    //##########################################################################
+    /// Latest
+    ///
+    /// @param[in]  dir  snapshot directory
+    /// @return          path of the latest snapshot, empty if none
+    /// @throws          std::string if the directory can't be read
+    //##########################################################################
+    static std::string latest(const std::string& dir);
+
+  private:
+
+    //##########################################################################
+    /// STRUCT: Shard
+    ///
+    /// Books and orders copied from one shard; only its processor thread
+    /// touches them until the shard is done.
+    //##########################################################################
+    struct shard_t {
+      std::vector<snapshot_book_t>   books_;
+      std::vector<snapshot_order_t>  orders_;
+      boost::uint64_t                next_id_;
+      orders_t                       resting_;  /// scratch for copy()
+    };
+
+    boost::uint64_t       sequence_;         /// inbound sequence
+    unsigned              journal_segment_;  /// first segment to replay
+    std::vector<shard_t>  shards_;           /// copies by shard
+    boost::atomic<size_t> done_;             /// shards done
+  };
+
+  //############################################################################
+  /// CLASS: Snapshot File
+  ///
+  /// Read only mapping of a snapshot file; see the layout above.
+  //############################################################################
+  class snapshot_file_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// Maps the file and checks its header and size.
+    ///
+    /// @param[in]  path  snapshot file
+    /// @return           none
+    /// @throws           std::string if the file can't be mapped or is not
+    ///                   a snapshot
+    //##########################################################################
+    explicit snapshot_file_t(const std::string& path);
+
+    //##########################################################################
+    /// Destructor
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    ~snapshot_file_t();
+
+    //##########################################################################
+    /// Header Accessor
+    ///
+    /// @param   none
+    /// @return  snapshot header
+    /// @throws  none
+    //##########################################################################
+    const snapshot_header_t& header() const { return *header_; }
+
+    //##########################################################################
+    /// Name Accessor
+    ///
+    /// @param[in]  symbol_id  symbol id < header().nsymbols_
+    /// @return                stock name, empty if the id was not in use
+    /// @throws                none
+    //##########################################################################
+    const char* name(boost::uint32_t symbol_id) const {
+      return names_ + symbol_id * order_t::stock_size;
+    }
+
+    //##########################################################################
+    /// Next Id Accessor
+    ///
+    /// @param[in]  shard  shard < header().nshards_
+    /// @return            id of the shard's next new order
+    /// @throws            none
+    //##########################################################################
+    boost::uint64_t next_id(size_t shard) const { return next_ids_[shard]; }
+
+    //##########################################################################
+    /// Book Accessor
+    ///
+    /// @param[in]  i  book index < header().nbooks_
+    /// @return        book
+    /// @throws        none
+    //##########################################################################
+    const snapshot_book_t& book(size_t i) const { return books_[i]; }
+
+    //##########################################################################
+    /// Order Accessor
+    ///
+    /// @param[in]  i  order index < header().norders_
+    /// @return        order
+    /// @throws        none
+    //##########################################################################
+    const snapshot_order_t& order(size_t i) const { return orders_[i]; }
+
+  private:
+
+    /// not copyable, owns the mapping
+    snapshot_file_t(const snapshot_file_t&);
+    snapshot_file_t& operator=(const snapshot_file_t&);
+
+    void*                     base_;      /// mapping
+    size_t                    size_;      /// mapped bytes
+    const snapshot_header_t*  header_;
+    const char*               names_;
+    const boost::uint64_t*    next_ids_;
+    const snapshot_book_t*    books_;
+    const snapshot_order_t*   orders_;
+  };
+
+}  /// namespace trading
+
+#endif
@@ -2,34 +2,296 @@
 #include <socket_server.hpp>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <xmit_order.hpp>
 #include <tracer.hpp>
 
 namespace trading {
 
+  /// connections a reader accepts per listener wake up, at most
+  static const size_t accept_batch = 256;
+
+#ifdef TRADING_HAVE_IO_URING
+  ////////
+  /// io_uring reader: completions name their operation and socket in the
+  /// user data, so a completion never points at a freed connection
+  ////////
+  enum uring_op_t {
+    op_accept, op_recv, op_send, op_event, op_timer, op_cancel
+  };
+
+  static const unsigned ring_entries = 256;        /// submission queue
+  static const unsigned ring_buffers = 256;        /// provided buffers
+  static const unsigned ring_buffer_size = 16384;  /// bytes per buffer
+
+  static boost::uint64_t user_data(uring_op_t op, int fd) {
+    return static_cast<boost::uint64_t>(op) << 32 |
+      static_cast<boost::uint32_t>(fd);
+  }
+
+  static void prep_accept(uring_t& ring, int socket) {
+    struct io_uring_sqe* sqe = ring.sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data(op_accept, socket);
+  }
+
+  static void prep_recv(uring_t& ring, int socket) {
+    struct io_uring_sqe* sqe = ring.sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = ring.buffer_group();
+    sqe->user_data = user_data(op_recv, socket);
+  }
+
+  static void prep_cancel(uring_t& ring, int socket) {
+    struct io_uring_sqe* sqe = ring.sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = user_data(op_recv, socket);
+    sqe->user_data = user_data(op_cancel, socket);
+  }
+
+  static void prep_read(uring_t& ring, uring_op_t op, int fd,
+                        boost::uint64_t* count) {
+    struct io_uring_sqe* sqe = ring.sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<unsigned long>(count);
+    sqe->len = sizeof(*count);
+    sqe->user_data = user_data(op, fd);
+  }
+
+  static void prep_send(uring_t& ring, int socket, const char* buf,
+                        size_t size) {
+    struct io_uring_sqe* sqe = ring.sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = socket;
+    sqe->addr = reinterpret_cast<unsigned long>(buf);
+    sqe->len = size;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data(op_send, socket);
+  }
+#endif
+
   //############################################################################
   /// Initialize
   //############################################################################
   void
   socket_server_t::
-  init(uint16_t port,
-       size_t nreaders,
-       size_t nprocessors) {
+  init(const server_config_t& config) {
+
+    ////////
+    /// create thread pool for # of readers and processors; readers of
+    /// shared memory sessions follow the TCP readers
+    ////////
+    nreaders_ = config.nreaders_ +
+      (config.shm_path_.empty() ? 0 : config.shm_readers_);
+    nprocessors_ = config.nprocessors_;
+    batch_size_ = config.batch_size_;
+    max_price_ = INT_MAX - static_cast<int>(
+      std::min<size_t>(config.price_levels_, INT_MAX));
+    flush_micros_ = config.flush_micros_;
+    overflow_ = config.overflow_;
+    stats_interval_ = config.stats_interval_;
+    cancel_on_disconnect_ = config.cancel_on_disconnect_;
+    next_session_ = 0;
+    sequence_ = 0;
+    snapshot_dir_ = config.snapshot_dir_;
+    snapshot_interval_ = config.snapshot_interval_;
+    shm_ring_size_ = config.shm_ring_kb_ << 10;
+    shm_busy_poll_ = config.shm_busy_poll_;
+    reader_cpus_ = config.reader_cpus_;
+    processor_cpus_ = config.processor_cpus_;
+    service_cpus_ = config.service_cpus_;
+    check_cpus(reader_cpus_);
+    check_cpus(processor_cpus_);
+    check_cpus(service_cpus_);
+
+    ////////
+    /// shutdown signals are taken by the snapshot thread; blocked before
+    /// any thread is created so every thread inherits the mask
+    ////////
+    handle_signals_ = ! snapshot_dir_.empty() || ! config.journal_dir_.empty();
+    if (handle_signals_) {
+      sigemptyset(&signals_);
+      sigaddset(&signals_, SIGINT);
+      sigaddset(&signals_, SIGTERM);
+      ::pthread_sigmask(SIG_BLOCK, &signals_, NULL);
+    }
+
+    /// inbound journal, written by its own thread
+    if (! config.journal_dir_.empty()) {
+      journal_ = boost::make_shared<journal_t>(
+        config.journal_dir_, nprocessors_, config.price_levels_,
+        config.pool_size_, config.journal_segment_mb_ << 20,
+        config.journal_sync_messages_, config.journal_sync_micros_);
+    }
+    concurrent::thread_pool_t::instance().expand(
+      nreaders_ + nprocessors_ + (stats_interval_ ? 1 : 0) +
+      (journal_ ? 1 : 0) + (handle_signals_ ? 1 : 0));
+
+    /// preallocate every order the server can hold at once
+    order_pool_ = boost::make_shared<order_pool_t>(config.pool_size_,
+                                                   config.pool_reserve_);
+
+    /// and every session, split between the readers
+    sessions_ = boost::make_shared<session_table_t>(nreaders_,
+                                                    config.max_sessions_);
+
+    /// symbol universe; without one stocks are interned on first use
+    symbols_ = boost::make_shared<symbol_directory_t>(config.max_symbols_);
+    if (! config.symbols_file_.empty()) {
+      symbols_->load(config.symbols_file_);
+      TRACE_BEGIN << "loaded " << symbols_->size() << " symbols from: "
+                  << config.symbols_file_ << std::endl; TRACE_END
+    }
+    ////////
+    /// one work queue and order manager per processor (shard), built on
+    /// the processor's CPU when pinned so its books live on its node
+    ////////
+    work_queues_.resize(nprocessors_);
+    order_managers_.resize(nprocessors_);
+    for (size_t i = 0; i < nprocessors_; ++i) {
+      if (processor_cpus_.empty()) {
+        build_shard(i, config);
+        continue;
+      }
+      boost::thread builder(boost::bind(&socket_server_t::build_shard,
+                                        this, i, boost::cref(config)));
+      builder.join();
+    }
+    if (handle_signals_) {
+      recover(config);
+    }
+    ////////
+    /// the snapshot requests are taken once and reused, so a pool full
+    /// of resting orders can't hold a snapshot up
+    ////////
+    for (size_t i = 0; ! snapshot_dir_.empty() && i < nprocessors_; ++i) {
+      order_ptr request = order_pool_->allocate_reserved();
+      if (! request) {
+        throw std::string("Order pool exhausted taking snapshot requests");
+      }
+      snapshot_requests_.push_back(request);
+    }
+
+    ////////
+    /// processor threads wake a reader through its event once they have
+    /// buffered reports for it, or the reader flushes on its own timer
+    ////////
+    for (size_t i = 0; i < nreaders_; ++i) {
+      reader_ptr reader = boost::make_shared<reader_t>();
+      reader->event_ = ::eventfd(0, EFD_NONBLOCK);
+      if (reader->event_ == -1) {
+        throw std::string("Reader event creation failed: ") +
+          ::strerror(errno);
+      }
+      if (flush_micros_) {
+        reader->timer_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        struct itimerspec interval;
+        interval.it_interval.tv_sec = flush_micros_ / 1000000;
+        interval.it_interval.tv_nsec = flush_micros_ % 1000000 * 1000;
+        interval.it_value = interval.it_interval;
+        if (reader->timer_ == -1 ||
+            ::timerfd_settime(reader->timer_, 0, &interval, NULL) == -1) {
+          throw std::string("Reader flush timer creation failed: ") +
+            ::strerror(errno);
+        }
+      }
+      reader->npaused_.resize(nprocessors_);
+      reader->staged_.resize(nprocessors_);
+      reader->shm_ = i >= config.nreaders_;
+      readers_.push_back(reader);
+    }
+    ////////
+    /// io_uring readers, if asked for; any reader failing to set up its
+    /// ring means the kernel lacks support, and every reader uses epoll.
+    /// io_uring waits on blocking descriptors itself, where non-blocking
+    /// ones would complete with EAGAIN
+    ////////
+    int nonblock = SOCK_NONBLOCK;
+    if (config.io_uring_) {
+#ifdef TRADING_HAVE_IO_URING
+      try {
+        for (size_t i = 0; i < config.nreaders_; ++i) {
+          readers_[i]->ring_ = boost::make_shared<uring_t>(
+            ring_entries, ring_buffers, ring_buffer_size);
+        }
+        for (size_t i = 0; i < config.nreaders_; ++i) {
+          ::fcntl(readers_[i]->event_, F_SETFL, 0);
+          if (readers_[i]->timer_ != -1) {
+            ::fcntl(readers_[i]->timer_, F_SETFL, 0);
+          }
+        }
+        nonblock = 0;
+        TRACE_BEGIN << "readers use io_uring" << std::endl; TRACE_END
+      }
+      catch (const std::string& ex) {
+        for (size_t i = 0; i < nreaders_; ++i) {
+          readers_[i]->ring_.reset();
+        }
+        TRACE_BEGIN << ex << ", readers use epoll" << std::endl; TRACE_END
+      }
+#else
+      TRACE_BEGIN << "built without io_uring, readers use epoll"
+                  << std::endl; TRACE_END
+#endif
+    }
+
+    ////////
+    /// one listening socket per reader, all bound to the port; the kernel
+    /// spreads incoming connections over them. Unix sockets have no such
+    /// balancing, the shared memory readers take turns on one instead
+    ////////
+    for (size_t i = 0; i < config.nreaders_; ++i) {
+      readers_[i]->listener_ = listen(config.port_, config.backlog_, nonblock);
+    }
+    if (nreaders_ > config.nreaders_) {
+      int listener = listen_unix(config.shm_path_, config.backlog_);
+      for (size_t i = config.nreaders_; i < nreaders_; ++i) {
+        readers_[i]->listener_ = listener;
+      }
+      TRACE_BEGIN << "shared memory sessions on: " << config.shm_path_
+                  << std::endl; TRACE_END
+    }
+  }
 
-    /// create thread pool for # of readers and processors
-    nreaders_ = nreaders;
-    nprocessors_ = nprocessors;
-    concurrent::thread_pool_t::instance().expand(nreaders + nprocessors);
+  //############################################################################
+  /// Listen
+  //############################################################################
+  int
+  socket_server_t::
+  listen(boost::uint16_t port, int backlog, int flags) {
 
     /// create server socket
-    socket_ = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_ == -1) {
+    int socket = ::socket(AF_INET, SOCK_STREAM | flags, 0);
+    if (socket == -1) {
       perror(NULL);
       std::string s = "Socket creation failed: ";
       s += ::strerror(errno);
       throw s;
     }
+    int one = 1;
+    if (::setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &one,
+                     sizeof(one)) == -1 ||
+        ::setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &one,
+                     sizeof(one)) == -1) {
+      std::string s = "Socket option failed: " + std::string(::strerror(errno));
+      ::close(socket);
+      throw s;
+    }
     /// bind to socket
     struct sockaddr_in addr;
     bzero((char *) &addr, sizeof(addr));
@@ -38,13 +300,51 @@ namespace trading {
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port = htons(port);
 
-    if (::bind(socket_, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+    if (::bind(socket, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
       perror(NULL);
       std::string s = "Socket bind failed: " + std::string(::strerror(errno));
+      ::close(socket);
       throw s;
     }
     /// listen on socket
-    ::listen(socket_, 5);
+    if (::listen(socket, backlog) == -1) {
+      std::string s = "Socket listen failed: " +
+        std::string(::strerror(errno));
+      ::close(socket);
+      throw s;
+    }
+    return socket;
+  }
+
+  //############################################################################
+  /// Listen Unix
+  //############################################################################
+  int
+  socket_server_t::
+  listen_unix(const std::string& path, int backlog) {
+
+    struct sockaddr_un addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      throw std::string("Unix socket path too long: ") + path;
+    }
+    ::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (socket == -1) {
+      throw std::string("Unix socket creation failed: ") + ::strerror(errno);
+    }
+    /// the socket file outlives the server, a new one takes its place
+    ::unlink(path.c_str());
+    if (::bind(socket, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+        ::listen(socket, backlog) == -1) {
+      std::string s = "Unix socket " + path + " failed: " +
+        std::string(::strerror(errno));
+      ::close(socket);
+      throw s;
+    }
+    return socket;
   }
 
   //############################################################################
@@ -57,179 +357,1745 @@ namespace trading {
     /// launch socket reader threads
     concurrent::thread_pool_t& pool = concurrent::thread_pool_t::instance();
     for (size_t i = 0; i < nreaders_; ++i) {
-      pool.post(boost::bind(&socket_server_t::reader_thread, this));
+#ifdef TRADING_HAVE_IO_URING
+      if (readers_[i]->ring_) {
+        pool.post(boost::bind(&socket_server_t::uring_thread, this, i));
+        continue;
+      }
+#endif
+      pool.post(boost::bind(&socket_server_t::reader_thread, this, i));
     }
-    /// launch order processor threads
+    /// launch order processor threads, one per shard
     for (size_t i = 0; i < nprocessors_; ++i) {
-      pool.post(boost::bind(&socket_server_t::processor_thread, this));
+      pool.post(boost::bind(&socket_server_t::processor_thread, this, i));
+    }
+    /// launch journal thread
+    if (journal_) {
+      pool.post(boost::bind(&socket_server_t::journal_thread, this));
+    }
+    /// launch snapshot thread, which also handles shutdown
+    if (handle_signals_) {
+      pool.post(boost::bind(&socket_server_t::snapshot_thread, this));
+    }
+    /// launch statistics thread
+    if (stats_interval_) {
+      pool.post(boost::bind(&socket_server_t::stats_thread, this));
+    }
+    /// readers accept and serve the connections from here on
+    pool.wait();
+  }
+
+  //############################################################################
+  /// Reader Thread
+  //############################################################################
+  void
+  socket_server_t::
+  reader_thread(size_t ndx) {
+
+    pin("reader", ndx, nth_cpu(reader_cpus_, ndx));
+    reader_t& reader = *readers_[ndx];
+    int epoll = ::epoll_create1(0);
+    if (epoll == -1) {
+      TRACE_BEGIN << "epoll create failed: " << ::strerror(errno)
+                  << std::endl; TRACE_END
+      return;
+    }
+    ////////
+    /// the reader's own listening socket stays level triggered, so
+    /// connections left pending wake the reader again; events carry the
+    /// descriptor. A connection on the shared Unix socket wakes one reader
+    ////////
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    if (reader.shm_) {
+      ev.events |= EPOLLEXCLUSIVE;
     }
-    /// in loop start accepting client connections
+    ev.data.fd = reader.listener_;
+    if (::epoll_ctl(epoll, EPOLL_CTL_ADD, reader.listener_, &ev) == -1) {
+      TRACE_BEGIN << "epoll add of listening socket failed: "
+                  << ::strerror(errno) << std::endl; TRACE_END
+      ::close(epoll);
+      return;
+    }
+    /// the event and the timer both flush
+    ev.events = EPOLLIN;
+    ev.data.fd = reader.event_;
+    bool added = ::epoll_ctl(epoll, EPOLL_CTL_ADD, reader.event_, &ev) == 0;
+    if (added && reader.timer_ != -1) {
+      ev.data.fd = reader.timer_;
+      added = ::epoll_ctl(epoll, EPOLL_CTL_ADD, reader.timer_, &ev) == 0;
+    }
+    if (! added) {
+      TRACE_BEGIN << "epoll add of reader event failed: "
+                  << ::strerror(errno) << std::endl; TRACE_END
+      ::close(epoll);
+      return;
+    }
+    connections_t connections;
+    handles_t pending;
+    std::vector<struct epoll_event> events(256);
+
+    /// busy polling, only looks at what the epoll instance has
+    int timeout = reader.shm_ && shm_busy_poll_ ? 0 : -1;
+
     while (true) {
 
-      socklen_t len = 0;
-      struct sockaddr_in addr;
-      bzero((char *) &addr, sizeof(addr));
+      int n = ::epoll_wait(epoll, &events[0], events.size(), timeout);
+      if (n == -1) {
+        if (errno == EINTR)
+          continue;
+        TRACE_BEGIN << "epoll wait failed: " << ::strerror(errno)
+                    << std::endl; TRACE_END
+        break;
+      }
+      for (int i = 0; i < n; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == reader.listener_) {
+          accept(ndx, epoll, connections);
+          continue;
+        }
+        if (fd == reader.event_ || fd == reader.timer_) {
+          flush(epoll, connections, reader, pending);
+          resume(epoll, connections, reader);
+          continue;
+        }
+        /// a flush earlier in this round may have closed the connection
+        connections_t::iterator c = connections.find(fd);
+        if (c == connections.end())
+          continue;
+        connection_t& connection = *c->second;
 
-      int socket = ::accept(socket_, (struct sockaddr *) &addr, &len);
-      TRACE_BEGIN << "client connected socket: " << socket << std::endl;
-      TRACE_END
-      if (socket == -1) {
-        perror(NULL);
-        std::string s = "Socket accept failed: ";
-        s += ::strerror(errno);
-        throw s;
+        ////////
+        /// a shared memory session's socket rings when the client wrote
+        /// to its ring or made room in ours, or hangs up
+        ////////
+        bool ok = true;
+        if (connection.channel_) {
+          ok = doorbell(connection) &&
+            (! connection.conn_info_ || send(*connection.conn_info_));
+        }
+        else if ((events[i].events & EPOLLOUT) && connection.conn_info_) {
+          ok = send(*connection.conn_info_);
+        }
+        if (! ok) {
+          close(epoll, connections, fd);
+          continue;
+        }
+        /// a paused connection is read once resumed
+        if ((events[i].events & ~EPOLLOUT) && ! connection.paused_) {
+          if (! receive(connection)) {
+            close(epoll, connections, fd);
+          }
+          else if (connection.paused_) {
+            reader.paused_.push_back(c->second);
+          }
+        }
+      }
+      if (timeout == 0) {
+        poll(epoll, connections, reader);
       }
-      /// reader thread will pick up this socket connection
-      sockets_.push(socket);
     }
+    ::close(epoll);
   }
- 
+
   //############################################################################
-  /// Reader Thread
+  /// Accept
   //############################################################################
   void
   socket_server_t::
-  reader_thread() {
-
-    while (true) {
+  accept(size_t ndx, int epoll, connections_t& connections) {
 
-      /// get next socket from sockets queue
-      int socket = sockets_.pop_front();
+    ////////
+    /// take the whole backlog at once, so a burst of logins is served in
+    /// one wake up; connections beyond the batch wake the reader again
+    ////////
+    int listener = readers_[ndx]->listener_;
+    for (size_t i = 0; i < accept_batch; ++i) {
 
-      /// read the connecting client's trader id
-      TRACE_BEGIN << "waiting to read trader_id" << std::endl; TRACE_END
+      int socket = ::accept4(listener, NULL, NULL, SOCK_NONBLOCK);
+      if (socket == -1) {
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          TRACE_BEGIN << "Socket accept failed: " << ::strerror(errno)
+                      << std::endl; TRACE_END
+        }
+        return;
+      }
+      TRACE_BEGIN << "client connected socket: " << socket << std::endl;
+      TRACE_END
 
-      char trader_id_buf[8] = {0};
-      ssize_t n = ::read(socket, &trader_id_buf, 8);
-      if (n != sizeof(trader_id_buf)) {
-        TRACE_BEGIN << "Bad protocol, expected trader_id after connect"
-                    << std::endl; TRACE_END
+      ////////
+      /// writable edges let the reader finish writing a send buffer the
+      /// socket could not take at once. A shared memory session gets its
+      /// segment straight away; its socket then only rings, and needs none
+      ////////
+      connection_ptr connection =
+        boost::make_shared<connection_t>(socket, ndx);
+      struct epoll_event ev;
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      if (readers_[ndx]->shm_) {
+        try {
+          connection->channel_ = boost::make_shared<shm_channel_t>(
+            shm_ring_size_, shm_busy_poll_);
+          connection->channel_->offer(socket);
+        }
+        catch (const std::string& ex) {
+          TRACE_BEGIN << ex << ", closing socket: " << socket << std::endl;
+          TRACE_END
+          ::close(socket);
+          continue;
+        }
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+      }
+      ev.data.fd = socket;
+      if (::epoll_ctl(epoll, EPOLL_CTL_ADD, socket, &ev) == -1) {
+        TRACE_BEGIN << "epoll add of socket " << socket << " failed: "
+                    << ::strerror(errno) << std::endl; TRACE_END
+        ::close(socket);
         continue;
       }
-      int trader_id = ::atoi(trader_id_buf);
-      TRACE_BEGIN << "received trader id: " << trader_id
-                  << std::endl; TRACE_END
+      connections[socket] = connection;
+    }
+  }
+
+  //############################################################################
+  /// Receive
+  //############################################################################
+  bool
+  socket_server_t::
+  receive(connection_t& connection) {
+
+    if (connection.channel_)
+      return shm_receive(connection);
+
+    while (! connection.paused_) {
 
+      ssize_t n = ::recv(connection.socket_, &connection.buf_[connection.have_],
+                         connection.buf_.size() - connection.have_, 0);
       ////////
-      /// connection complete - create conn_info with socket and trader id
-      /// and it to the conn_info_table.
+      /// if zero bytes read, the client is done; the caller closes the
+      /// socket and removes it from the connection info table
       ////////
-      conn_info_ptr cip = boost::make_shared<conn_info_t>();
-      cip->socket_ = socket;
-      cip->trader_id_ = trader_id;
-      {
-        boost::lock_guard<boost::mutex>  lock(mutex_);
-        conn_info_table_.insert(cip);
+      if (n == 0) {
+        TRACE_BEGIN << "client closed connection on socket: "
+                    << connection.socket_ << std::endl; TRACE_END
+        return false;
       }
-      for (;;) {
+      if (n == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          return true;
+        if (errno == EINTR)
+          continue;
+        TRACE_BEGIN << "read failed on socket: " << connection.socket_
+                    << ": " << ::strerror(errno) << std::endl; TRACE_END
+        return false;
+      }
+      /// frame what is complete, keep the partial tail for the next read
+      connection.have_ += n;
+      if (! frame(connection))
+        return false;
+    }
+    /// the socket is read on once the connection resumes
+    return true;
+  }
 
-        /// read from socket into order tmp strucuture
-        transmission::order_t ord;
-        ssize_t n = ::read(socket, &ord, sizeof(ord));
+  //############################################################################
+  /// Shm Receive
+  //############################################################################
+  bool
+  socket_server_t::
+  shm_receive(connection_t& connection) {
 
-        ////////
-        /// if zero bytes read, close socket since client is done
-        /// remove entry from connection info table; if a pending
-        /// is processed after this, then the processing thread
-        /// won't attempt to send a message on a closed socket
-        /// stop the read loop and get the next socket to handle
-        ////////
-        if (n == 0) {
-          TRACE_BEGIN << "client closed connection on socket: "
-                      << socket << std::endl; TRACE_END
-          boost::lock_guard<boost::mutex>  lock(mutex_);
-          conn_info_table_.erase(cip->socket_);
-          ::close(socket);
-          break;
-        }
-        /// partial read
-        else if (n != sizeof(ord)) {
-          TRACE_BEGIN << "Bad protocol client writes don't appear to be "
-                     << "of fixed size. Read: " << n << ", should be: "
-                     << sizeof(ord) << std::endl; TRACE_END
-          break;
+    shm_channel_t& channel = *connection.channel_;
+    while (! connection.paused_) {
+
+      size_t n = channel.read(&connection.buf_[connection.have_],
+                              connection.buf_.size() - connection.have_);
+      ////////
+      /// empty: the client rings for what it writes next, unless it
+      /// wrote meanwhile; polled sessions are read again next round
+      ////////
+      if (n == 0) {
+        if (channel.broken()) {
+          TRACE_BEGIN << "inconsistent shared memory ring on socket: "
+                      << connection.socket_ << std::endl; TRACE_END
+          return false;
         }
-        TRACE_BEGIN << "received order: " << ord << std::endl; TRACE_END
+        if (channel.busy_poll() || channel.wait_readable())
+          return true;
+        continue;
+      }
+      /// the client may wait for the room just made
+      connection.have_ += n;
+      if (channel.wake()) {
+        shm_channel_t::notify(connection.socket_);
+      }
+      if (! frame(connection))
+        return false;
+    }
+    /// the ring is read on once the connection resumes
+    return true;
+  }
 
-        /// read full data, create the real order
-        order_t::side_t side = ord.side_ == 0 ? order_t::buy : order_t::sell;
-        order_ptr order = boost::make_shared<order_t>(
-          ord.stock_, ord.trader_, ord.trader_id_, ord.quantity_, side, cip);
+  //############################################################################
+  /// Doorbell
+  //############################################################################
+  bool
+  socket_server_t::
+  doorbell(connection_t& connection) {
 
-        /// add to the work queue
-        work_queue_.push(order);
+    char bell[64];
+    while (true) {
+      ssize_t n = ::recv(connection.socket_, bell, sizeof(bell), 0);
+      if (n > 0)
+        continue;
+      if (n == 0) {
+        TRACE_BEGIN << "client closed connection on socket: "
+                    << connection.socket_ << std::endl; TRACE_END
+        return false;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return true;
+      if (errno != EINTR) {
+        TRACE_BEGIN << "read failed on socket: " << connection.socket_
+                    << ": " << ::strerror(errno) << std::endl; TRACE_END
+        return false;
       }
     }
   }
 
   //############################################################################
-  /// Processor Thread
+  /// Poll
   //############################################################################
   void
   socket_server_t::
-  processor_thread() {
+  poll(int epoll, connections_t& connections, reader_t& reader) {
 
-    while (true) {
+    /// closed after the walk, which closing would break
+    std::vector<int> failed;
+    for (connections_t::iterator c = connections.begin();
+         c != connections.end(); ++c) {
+      connection_t& connection = *c->second;
+      if (connection.paused_ || ! connection.channel_->readable())
+        continue;
+      if (! shm_receive(connection)) {
+        failed.push_back(c->first);
+      }
+      else if (connection.paused_) {
+        reader.paused_.push_back(c->second);
+      }
+    }
+    for (size_t i = 0; i < failed.size(); ++i) {
+      close(epoll, connections, failed[i]);
+    }
+  }
+
+  //############################################################################
+  /// Resume
+  //############################################################################
+  void
+  socket_server_t::
+  resume(int epoll, connections_t& connections, reader_t& reader) {
 
-      /// pop next order from front of work queue
-      order_ptr order = work_queue_.pop_front();
+    if (! reader.resume_.load() || ! reader.resume_.exchange(false))
+      return;
 
-      /// give order to order manager to process
-      orders_t to_notify;
-      {
-        boost::lock_guard<boost::mutex> lock(mutex_);
-        order_manager_.process_order(order, to_notify);
+    ////////
+    /// in the order paused, so the longest held back goes first; those
+    /// pausing again keep their place for the next resume
+    ////////
+    std::vector<connection_ptr> paused;
+    paused.swap(reader.paused_);
+    std::fill(reader.npaused_.begin(), reader.npaused_.end(), 0);
+    for (size_t i = 0; i < paused.size(); ++i) {
+      connection_t& connection = *paused[i];
+      connections_t::iterator c = connections.find(connection.socket_);
+      if (c == connections.end() || c->second != paused[i])
+        continue;
+      connection.paused_ = false;
+      if (! frame(connection) || ! receive(connection)) {
+        close(epoll, connections, connection.socket_);
+      }
+      else if (connection.paused_) {
+        reader.paused_.push_back(paused[i]);
       }
-      /// for each affected order, notify client
-      for (size_t i = 0; i < to_notify.size(); ++i) {
+    }
+  }
 
-        ////////
-        /// get shared ptr to conn_info's weak_ptr; if shared ptr doesn't
-        /// exist, socket was closed by client
-        ////////
-        order_ptr& order = to_notify[i];
-        conn_info_ptr conn = order->conn_info();
-        if (! conn) {
-          TRACE_BEGIN << "cannot respond to client - socket has been closed. "
-                      << "order: " << order << std::endl; TRACE_END
-          continue;
-        }
-        /// create order tmp for transmission
-        transmission::order_t ord(order);
+  //############################################################################
+  /// Frame
+  //############################################################################
+  bool
+  socket_server_t::
+  frame(connection_t& connection) {
 
-        /// write thread-safe to client socket 
-        boost::lock_guard<boost::mutex> lock(conn->mutex_);
-        ssize_t n = ::write(conn->socket_, &ord, sizeof(ord));
-        if (n != sizeof(ord)) {
-          TRACE_BEGIN << "write to socket failed. wrote: " << n << " vs "
-                      << sizeof(ord) << " for order: " << order
-                      << std::endl; TRACE_END
-        }
+    const char* buf = &connection.buf_[0];
+    size_t framed = 0;
+    bool ok = true;
+
+    /// messages sit at any offset, decoded field by field
+    transmission::message_t msg;
+    while (ok && ! connection.paused_) {
+      int n = transmission::decode(buf + framed, connection.have_ - framed,
+                                   msg);
+      if (n == 0)
+        break;
+      if (n < 0) {
+        TRACE_BEGIN << "Bad protocol, malformed message on socket: "
+                    << connection.socket_ << std::endl; TRACE_END
+        ok = false;
+        break;
+      }
+      framed += n;
+      TRACE_BEGIN << "received: " << msg << std::endl; TRACE_END
+
+      if (msg.sequence_ != ++connection.sequence_) {
+        TRACE_BEGIN << "Bad protocol, expected sequence "
+                    << connection.sequence_ << ": " << msg << std::endl;
+        TRACE_END
+        ok = false;
+      }
+      else if (! connection.conn_info_) {
+        ok = login(connection, msg);
+      }
+      else if ((ok = dispatch(connection, msg)) && connection.paused_) {
+        /// not queued: framed again once the connection resumes
+        --connection.sequence_;
+        framed -= n;
+      }
+    }
+    ////////
+    /// blocking producers queue what was framed a shard at a time, one
+    /// lock and one wake up per shard, before the connection may close
+    ////////
+    if (overflow_ == server_config_t::block) {
+      reader_t& reader = *readers_[connection.reader_];
+      for (size_t i = 0; i < nprocessors_; ++i) {
+        work_queues_[i].push_batch_wait(reader.staged_[i]);
       }
     }
+    /// keep the partial message at the end for the next read
+    connection.have_ -= framed;
+    ::memmove(&connection.buf_[0], &connection.buf_[framed],
+              connection.have_);
+    return ok;
   }
 
-}  /// namespace trading
+  //############################################################################
+  /// Login
+  //############################################################################
+  bool
+  socket_server_t::
+  login(connection_t& connection, const transmission::message_t& msg) {
 
-//##############################################################################
-/// Main
-//##############################################################################
-int main(int argc, const char** argv) {
+    if (msg.type_ != transmission::message_t::login) {
+      TRACE_BEGIN << "Bad protocol, expected login: " << msg << std::endl;
+      TRACE_END
+      return false;
+    }
+    transmission::message_t reply;
 
-  if (argc != 4) {
-    std::cout << "Usage: <" << argv[0] << "> <server port> "
-              << "<# of reader threads> <# of processor threads>"
-              << std::endl;
-    return -1;
+    ////////
+    /// connection complete - open a session with socket and trader id,
+    /// unless the trader is logged in or the reader's slots are taken
+    ////////
+    conn_info_t* conn = NULL;
+    if (msg.version_ < transmission::min_version) {
+      reply.reason_ = transmission::message_t::bad_version;
+    }
+    else if (! claim(msg.trader_id_)) {
+      reply.reason_ = transmission::message_t::duplicate_login;
+    }
+    else if (! (conn = sessions_->open(connection.reader_, connection.socket_,
+                                       msg.trader_id_, ++next_session_,
+                                       connection.channel_.get()))) {
+      release(msg.trader_id_);
+      reply.reason_ = transmission::message_t::session_limit;
+    }
+    else if (cancel_on_disconnect_ && ! reserve_disconnects(*conn)) {
+      sessions_->close(conn);
+      conn = NULL;
+      release(msg.trader_id_);
+      reply.reason_ = transmission::message_t::session_limit;
+    }
+
+    ////////
+    /// a rejected login is answered straight away, best effort, since
+    /// the connection is closed right after
+    ////////
+    if (! conn) {
+      reply.type_ = transmission::message_t::login_reject;
+      reply.sequence_ = 1;
+      reply.version_ = transmission::max_version;
+      TRACE_BEGIN << "login rejected: " << msg << std::endl; TRACE_END
+      char buf[transmission::max_size];
+      size_t n = transmission::encode(reply, buf);
+
+      /// the hang up that follows wakes a shared memory client
+      if (connection.channel_) {
+        connection.channel_->write(buf, n);
+      }
+      else if (::send(connection.socket_, buf, n,
+                      MSG_NOSIGNAL | MSG_DONTWAIT) !=
+               static_cast<ssize_t>(n)) {
+        TRACE_BEGIN << "login reject failed on socket: "
+                    << connection.socket_ << std::endl; TRACE_END
+      }
+      return false;
+    }
+    TRACE_BEGIN << "logged in trader id: " << conn->trader_id_
+                << ", session: " << conn->session_id_ << std::endl; TRACE_END
+    connection.conn_info_ = conn;
+
+    /// the ack goes out like a report, flushed by this reader
+    reply.type_ = transmission::message_t::login_ack;
+    reply.version_ = std::min<int>(msg.version_, transmission::max_version);
+    reply.flags_ = cancel_on_disconnect_ ?
+      transmission::message_t::cancel_on_disconnect : 0;
+    reply.session_id_ = conn->session_id_;
+    handles_t pending;
+    buffer(*conn, conn->handle_, reply, pending);
+    schedule(pending);
+    return true;
+  }
+
+  //############################################################################
+  /// Claim
+  //############################################################################
+  bool
+  socket_server_t::
+  claim(int trader_id) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return traders_.insert(trader_id).second;
+  }
+
+  //############################################################################
+  /// Release
+  //############################################################################
+  void
+  socket_server_t::
+  release(int trader_id) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    traders_.erase(trader_id);
+  }
+
+  //############################################################################
+  /// Dispatch
+  //############################################################################
+  bool
+  socket_server_t::
+  dispatch(connection_t& connection, const transmission::message_t& msg) {
+
+    conn_info_t* conn = connection.conn_info_;
+
+    ////////
+    /// map the stock of a new order onto its symbol id once, at the
+    /// network edge; cancel and amend requests name an order id instead
+    ////////
+    symbol_directory_t::id_t symbol_id = symbol_directory_t::npos;
+    if (msg.type_ == transmission::message_t::new_order) {
+      if (msg.price_ <= 0 || msg.price_ > max_price_) {
+        TRACE_BEGIN << "rejected order priced out of range: " << msg
+                    << std::endl; TRACE_END
+        refuse(*conn, msg, transmission::message_t::rejected);
+        return true;
+      }
+      symbol_id = symbols_->intern(msg.stock_);
+      if (symbol_id == symbol_directory_t::npos) {
+        TRACE_BEGIN << "rejected order for unknown stock: " << msg
+                    << std::endl; TRACE_END
+        refuse(*conn, msg, transmission::message_t::rejected);
+        return true;
+      }
+    }
+    else if (msg.type_ != transmission::message_t::cancel &&
+             msg.type_ != transmission::message_t::amend) {
+      TRACE_BEGIN << "Bad protocol, unexpected message type: " << msg
+                  << std::endl; TRACE_END
+      return false;
+    }
+    ////////
+    /// read full data, create the real order in a pooled order; with the
+    /// pool exhausted the client is told to send again later. Requests
+    /// may take the pool's reserve, so resting orders can always be
+    /// cancelled
+    ////////
+    order_ptr order = symbol_id != symbol_directory_t::npos ?
+      order_pool_->allocate() : order_pool_->allocate_reserved();
+    if (! order) {
+      TRACE_BEGIN << "order pool exhausted, throttled order: " << msg
+                  << std::endl; TRACE_END
+      refuse(*conn, msg, transmission::message_t::throttled);
+      return true;
+    }
+    ////////
+    /// new orders go to the shard owning the symbol, requests to the
+    /// shard that assigned the order id
+    ////////
+    size_t ndx;
+    if (symbol_id != symbol_directory_t::npos) {
+      order_t::side_t side =
+        msg.side_ == 0 ? order_t::buy : order_t::sell;
+      *order = order_t(msg.stock_, symbol_id, "", conn->trader_id_,
+                       msg.quantity_, msg.price_, side, conn);
+      ndx = shard(symbol_id);
+    }
+    else {
+      order_t::type_t type =
+        msg.type_ == transmission::message_t::cancel ?
+          order_t::cancel : order_t::amend;
+      *order = order_t(type, msg.order_id_, msg.quantity_, conn);
+      ndx = msg.order_id_ % nprocessors_;
+    }
+    order->client_sequence(msg.sequence_);
+    reader_t& reader = *readers_[connection.reader_];
+    if (overflow_ == server_config_t::block) {
+      reader.staged_[ndx].push_back(order);
+      return true;
+    }
+    ////////
+    /// clients the reader paused on the shard go first, so the others
+    /// wait behind them
+    ////////
+    if (reader.npaused_[ndx] == 0 && work_queues_[ndx].try_push(order))
+      return true;
+
+    ////////
+    /// the shard is behind: hold the client back, or tell it to send
+    /// again later; the shard tells the readers once it has caught up
+    ////////
+    order_pool_->release(order);
+    if (overflow_ == server_config_t::pause) {
+      connection.paused_ = true;
+      ++reader.npaused_[ndx];
+      return true;
+    }
+    refuse(*conn, msg, transmission::message_t::throttled);
+    return true;
+  }
+
+  //############################################################################
+  /// Refuse
+  //############################################################################
+  void
+  socket_server_t::
+  refuse(conn_info_t& conn, const transmission::message_t& msg, int type) {
+
+    transmission::message_t reply;
+    reply.type_ = type;
+    reply.order_id_ = msg.order_id_;
+    reply.ref_ = msg.sequence_;
+    reply.quantity_ = msg.quantity_;
+    reply.price_ = msg.price_;
+    handles_t pending;
+    buffer(conn, conn.handle_, reply, pending);
+    schedule(pending);
   }
-  uint16_t port = ::atoi(argv[1]);
-  int nreaders = ::atoi(argv[2]);
-  int nprocessors = ::atoi(argv[3]);
 
+  //############################################################################
+  /// Close
+  //############################################################################
+  void
+  socket_server_t::
+  close(int epoll, connections_t& connections, int socket) {
+
+    connections_t::iterator i = connections.find(socket);
+    if (i == connections.end())
+      return;
+    connection_ptr connection = i->second;
+    connections.erase(i);
+
+    ::epoll_ctl(epoll, EPOLL_CTL_DEL, socket, NULL);
+    if (connection->conn_info_) {
+      hang_up(connection->conn_info_);
+    }
+    ::close(socket);
+  }
+
+  //############################################################################
+  /// Hang Up
+  //############################################################################
+  void
+  socket_server_t::
+  hang_up(conn_info_t* conn) {
+
+    if (cancel_on_disconnect_) {
+      disconnect(conn);
+    }
+    release(conn->trader_id_);
+
+    ////////
+    /// close the session before the socket; if a pending order is
+    /// processed after this, then the processing thread won't buffer
+    /// reports for a closed socket, nor for another connection reusing
+    /// the descriptor or the slot
+    ////////
+    sessions_->close(conn);
+  }
+
+  //############################################################################
+  /// Disconnect
+  //############################################################################
+  void
+  socket_server_t::
+  disconnect(conn_info_t* conn) {
+
+    ////////
+    /// queue a disconnect request behind the session's last orders on
+    /// every shard, with the requests taken at login: the pool may be
+    /// full by now. The request carries its shard as order id, so each
+    /// journaled copy is replayed on the shard that processed it (see
+    /// restore_shard())
+    ////////
+    for (size_t i = 0; i < conn->disconnects_.size(); ++i) {
+      order_ptr request = conn->disconnects_[i];
+      *request = order_t(order_t::disconnect, i, 0, conn);
+      work_queues_[i].push(request);
+    }
+    conn->disconnects_.clear();
+  }
+
+  //############################################################################
+  /// Reserve Disconnects
+  //############################################################################
+  bool
+  socket_server_t::
+  reserve_disconnects(conn_info_t& conn) {
+
+    conn.disconnects_.clear();
+    for (size_t i = 0; i < nprocessors_; ++i) {
+      order_ptr request = order_pool_->allocate_reserved();
+      if (! request) {
+        TRACE_BEGIN << "order pool exhausted, no disconnect requests for "
+                    << "trader id: " << conn.trader_id_ << std::endl;
+        TRACE_END
+        for (size_t j = 0; j < conn.disconnects_.size(); ++j) {
+          order_pool_->release(conn.disconnects_[j]);
+        }
+        conn.disconnects_.clear();
+        return false;
+      }
+      conn.disconnects_.push_back(request);
+    }
+    return true;
+  }
+
+  //############################################################################
+  /// Processor Thread
+  //############################################################################
+  void
+  socket_server_t::
+  processor_thread(size_t shard) {
+
+    pin("processor", shard, nth_cpu(processor_cpus_, shard));
+    work_queue_t& work_queue = work_queues_[shard];
+    order_manager_t& order_manager = order_managers_[shard];
+    orders_t batch;
+    orders_t requests;
+    orders_t snapshots;
+    handles_t pending;
+    report_ring_t reports;
+    batch.reserve(batch_size_);
+    requests.reserve(batch_size_);
+
+    bool drained;
+
+    while (true) {
+
+      /// take everything queued for this shard, up to the batch size
+      size_t n = work_queue.pop_batch(batch, batch_size_, &drained);
+
+      ////////
+      /// number the batch; sequence numbers are unique and increase within
+      /// a shard, books remember the last one applied to them
+      ////////
+      boost::uint64_t sequence = sequence_.fetch_add(n) + 1;
+      for (size_t i = 0; i < n; ++i) {
+        batch[i]->sequence(sequence + i);
+      }
+
+      /// give the batch to the shard's order manager to match
+      order_manager.process_orders(&batch[0], n, reports);
+
+      ////////
+      /// hand the batch to the journal thread once matched, so new orders
+      /// are journaled with their order ids
+      ////////
+      if (journal_) {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+        boost::uint64_t timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        for (size_t i = 0; i < n; ++i) {
+          if (batch[i]->type() != order_t::snapshot) {
+            journal_->append(journal_record_t(batch[i]->sequence(),
+                                              timestamp, *batch[i]));
+          }
+        }
+      }
+
+      ////////
+      /// note the requests first: new orders of the batch may be released
+      /// while the reports are sent, and reallocated by a reader
+      ////////
+      requests.clear();
+      snapshots.clear();
+      for (size_t i = 0; i < n; ++i) {
+        if (batch[i]->type() == order_t::snapshot) {
+          snapshots.push_back(batch[i]);
+        }
+        else if (batch[i]->type() != order_t::new_order) {
+          requests.push_back(batch[i]);
+        }
+      }
+
+      ////////
+      /// buffer the reports in sequence, then have the readers write them,
+      /// a few writes per client for the whole batch
+      ////////
+      drain(reports, &pending);
+      schedule(pending);
+
+      /// requests are no longer referenced once reported
+      for (size_t i = 0; i < requests.size(); ++i) {
+        order_pool_->release(requests[i]);
+      }
+      /// one book per snapshot request, between batches
+      for (size_t i = 0; i < snapshots.size(); ++i) {
+        copy_books(shard, snapshots[i]);
+      }
+      /// the queue has room again for clients paused on it
+      if (drained) {
+        resume_readers();
+      }
+    }
+  }
+
+  //############################################################################
+  /// Resume Readers
+  //############################################################################
+  void
+  socket_server_t::
+  resume_readers() {
+
+    ////////
+    /// any reader may have paused on the queue, and the wake up goes out
+    /// whether or not readers flush on a timer
+    ////////
+    for (size_t r = 0; r < readers_.size(); ++r) {
+      reader_t& reader = *readers_[r];
+      reader.resume_ = true;
+      boost::uint64_t one = 1;
+      if (::write(reader.event_, &one, sizeof(one)) != sizeof(one)) {
+        TRACE_BEGIN << "reader wake up failed: " << ::strerror(errno)
+                    << std::endl; TRACE_END
+      }
+    }
+  }
+
+  //############################################################################
+  /// Drain
+  //############################################################################
+  void
+  socket_server_t::
+  drain(report_ring_t& reports, handles_t* pending) {
+
+    while (! reports.empty()) {
+
+      const report_t& r = reports.front();
+      if (pending) {
+        respond(r, *pending);
+      }
+      if (r.order_->type() == order_t::new_order &&
+          (r.type_ == report_t::rejected ||
+           (r.balance_ == 0 && r.type_ != report_t::ack))) {
+        order_pool_->release(r.order_);
+      }
+      reports.pop_front();
+    }
+  }
+
+  //############################################################################
+  /// Copy Books
+  //############################################################################
+  void
+  socket_server_t::
+  copy_books(size_t shard, order_ptr request) {
+
+    ////////
+    /// the shard owns symbol ids shard, shard + n, ...; books left out of
+    /// the snapshot are skipped without giving up the thread
+    ////////
+    order_manager_t& order_manager = order_managers_[shard];
+    boost::uint64_t symbol_id = request->order_id();
+    bool copied = false;
+    while (! copied && symbol_id < order_manager.books()) {
+      copied = snapshot_->copy(shard, symbol_id,
+                               order_manager.book(symbol_id));
+      symbol_id += nprocessors_;
+    }
+    if (symbol_id < order_manager.books()) {
+      request->order_id(symbol_id);
+      work_queues_[shard].push(request);
+    }
+    else {
+      snapshot_->done(shard, order_manager.next_id());
+    }
+  }
+
+  //############################################################################
+  /// Snapshot Thread
+  //############################################################################
+  void
+  socket_server_t::
+  snapshot_thread() {
+
+    pin("snapshot", -1, service_cpus_);
+    while (true) {
+
+      /// without periodic snapshots only wait for a signal
+      struct timespec timeout;
+      timeout.tv_sec = snapshot_interval_ ? snapshot_interval_ : 3600;
+      timeout.tv_nsec = 0;
+      int signal = ::sigtimedwait(&signals_, NULL, &timeout);
+      if (signal == -1) {
+        if (errno == EAGAIN && snapshot_interval_ && ! snapshot_dir_.empty()) {
+          snapshot();
+        }
+        continue;
+      }
+      TRACE_BEGIN << "shutting down on signal: " << signal << std::endl;
+      TRACE_END
+
+      if (! snapshot_dir_.empty()) {
+        snapshot();
+      }
+      if (journal_) {
+        journal_->stop();
+        while (! journal_->stopped()) {
+          boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+        }
+      }
+      ////////
+      /// leave without running static destructors under the feet of the
+      /// reader and processor threads
+      ////////
+      std::cout.flush();
+      ::_exit(0);
+    }
+  }
+
+  //############################################################################
+  /// Snapshot
+  //############################################################################
+  void
+  socket_server_t::
+  snapshot() {
+
+    ////////
+    /// every message of an earlier journal segment was matched before the
+    /// snapshot started; the queues publish snapshot_ to the processors
+    ////////
+    snapshot_ = boost::make_shared<snapshot_t>(
+      nprocessors_, sequence_.load(), journal_ ? journal_->segment() : 0);
+
+    for (size_t i = 0; i < nprocessors_; ++i) {
+      order_ptr request = snapshot_requests_[i];
+      *request = order_t(order_t::snapshot, i, 0, NULL);
+      work_queues_[i].push(request);
+    }
+    while (! snapshot_->complete()) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+    try {
+      std::string path = snapshot_->write(snapshot_dir_, *symbols_);
+      TRACE_BEGIN << "snapshot written: " << path << std::endl; TRACE_END
+    }
+    catch (const std::string& ex) {
+      TRACE_BEGIN << ex << std::endl; TRACE_END
+    }
+  }
+
+  //############################################################################
+  /// Recover
+  //############################################################################
+  void
+  socket_server_t::
+  recover(const server_config_t& config) {
+
+    boost::shared_ptr<snapshot_file_t> file;
+    if (! snapshot_dir_.empty()) {
+      std::string path = snapshot_t::latest(snapshot_dir_);
+      if (! path.empty()) {
+        file = boost::make_shared<snapshot_file_t>(path);
+        if (file->header().nshards_ != nprocessors_) {
+          throw "Snapshot was taken with a different number of processors: "
+            + path;
+        }
+        TRACE_BEGIN << "restoring snapshot: " << path << std::endl; TRACE_END
+      }
+    }
+    std::vector<journal_record_t> records;
+    if (! config.journal_dir_.empty()) {
+      journal_header_t header = journal_t::read(
+        config.journal_dir_, file ? file->header().journal_segment_ : 0,
+        records);
+      if (header.nshards_ && header.nshards_ != nprocessors_) {
+        throw "Journal was written with a different number of processors: "
+          + config.journal_dir_;
+      }
+      if (header.nshards_ && header.price_levels_ != config.price_levels_) {
+        throw "Journal was written with a different number of price levels: "
+          + config.journal_dir_;
+      }
+    }
+
+    ////////
+    /// symbol ids first, every shard looks stocks up by id; and the
+    /// highest sequence number and session id to continue after
+    ////////
+    boost::uint64_t sequence = 0;
+    boost::uint64_t session = 0;
+    if (file) {
+      const snapshot_header_t& header = file->header();
+      sequence = header.sequence_;
+      for (boost::uint32_t id = 0; id < header.nsymbols_; ++id) {
+        const char* name = file->name(id);
+        if (*name && ! symbols_->restore(name, id)) {
+          throw "Snapshot symbol conflicts with the symbol directory: " +
+            std::string(name);
+        }
+      }
+      for (size_t i = 0; i < header.nbooks_; ++i) {
+        const snapshot_book_t& book = file->book(i);
+        if (book.first_ + book.norders_ > header.norders_ ||
+            book.symbol_id_ >= header.nsymbols_) {
+          throw std::string("Corrupt snapshot, book out of range");
+        }
+        sequence = std::max(sequence, book.sequence_);
+      }
+      for (size_t i = 0; i < header.norders_; ++i) {
+        session = std::max(session, file->order(i).session_id_);
+      }
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+      const journal_record_t& r = records[i];
+      if (r.type_ == order_t::new_order &&
+          ! symbols_->restore(r.stock_, r.symbol_id_)) {
+        throw "Journaled symbol conflicts with the symbol directory: " +
+          std::string(r.stock_, ::strnlen(r.stock_, sizeof(r.stock_)));
+      }
+      sequence = std::max(sequence, r.sequence_);
+      session = std::max(session, r.session_id_);
+    }
+
+    ////////
+    /// a shard that can't be restored completely fails the startup rather
+    /// than leave the server with part of its books
+    ////////
+    std::vector<std::string> errors(nprocessors_);
+    boost::thread_group threads;
+    for (size_t i = 0; i < nprocessors_; ++i) {
+      threads.create_thread(boost::bind(&socket_server_t::restore_shard, this,
+                                        i, file.get(), boost::cref(records),
+                                        boost::ref(errors[i])));
+    }
+    threads.join_all();
+    for (size_t i = 0; i < nprocessors_; ++i) {
+      if (! errors[i].empty()) {
+        throw errors[i];
+      }
+    }
+
+    sequence_ = sequence;
+    next_session_ = session;
+    TRACE_BEGIN << "recovered to sequence " << sequence << ", "
+                << order_pool_->in_use() << " resting orders, "
+                << records.size() << " journal records" << std::endl;
+    TRACE_END
+  }
+
+  //############################################################################
+  /// Restore Shard
+  //############################################################################
+  void
+  socket_server_t::
+  restore_shard(size_t shard,
+                const snapshot_file_t* file,
+                const std::vector<journal_record_t>& records,
+                std::string& error) {
+
+    order_manager_t& order_manager = order_managers_[shard];
+
+    /// resting orders, already in price-time order
+    for (size_t i = 0; file && i < file->header().nbooks_; ++i) {
+      const snapshot_book_t& b = file->book(i);
+      if (this->shard(b.symbol_id_) != shard)
+        continue;
+
+      /// the ladder where it was, so the orders land on their levels
+      order_manager.book(b.symbol_id_).anchor(b.base_, b.reference_);
+
+      for (size_t j = 0; j < b.norders_; ++j) {
+        const snapshot_order_t& o = file->order(b.first_ + j);
+        order_ptr order = order_pool_->allocate();
+        if (! order) {
+          error = "Order pool exhausted restoring snapshot";
+          return;
+        }
+        order_t::side_t side = o.side_ == 0 ? order_t::buy : order_t::sell;
+        *order = order_t(file->name(b.symbol_id_), b.symbol_id_, "",
+                         o.trader_id_, o.quantity_, o.price_, side,
+                         NULL);
+        order->order_id(o.order_id_);
+        order->session_id(o.session_id_);
+        order->balance(o.balance_);
+        if (! order_manager.restore(order)) {
+          order_pool_->release(order);
+          std::ostringstream os;
+          os << "Snapshot order off the price ladder: " << o.order_id_;
+          error = os.str();
+          return;
+        }
+      }
+      order_manager.book(b.symbol_id_).sequence(b.sequence_);
+    }
+    if (file) {
+      order_manager.next_id(file->next_id(shard));
+    }
+
+    /// journal tail, routed as the readers route messages
+    report_ring_t reports;
+    for (size_t i = 0; i < records.size(); ++i) {
+      const journal_record_t& r = records[i];
+      size_t ndx;
+      if (r.type_ == order_t::new_order) {
+        ndx = this->shard(r.symbol_id_);
+      }
+      else {
+        /// requests by order id, disconnects by the shard that took them
+        ndx = r.order_id_ % nprocessors_;
+      }
+      if (ndx != shard)
+        continue;
+
+      order_ptr order = r.type_ == order_t::new_order ?
+        order_pool_->allocate() : order_pool_->allocate_reserved();
+      if (! order) {
+        error = "Order pool exhausted replaying journal";
+        return;
+      }
+      order_t::type_t type = static_cast<order_t::type_t>(r.type_);
+      if (type == order_t::new_order) {
+        order_t::side_t side = r.side_ == 0 ? order_t::buy : order_t::sell;
+        *order = order_t(r.stock_, r.symbol_id_, "", r.trader_id_,
+                         r.quantity_, r.price_, side, NULL);
+      }
+      else {
+        *order = order_t(type, r.order_id_, r.quantity_, NULL);
+      }
+      order->order_id(r.order_id_);
+      order->session_id(r.session_id_);
+      order->sequence(r.sequence_);
+
+      order_manager.process_orders(&order, 1, reports);
+      drain(reports, NULL);
+      if (type != order_t::new_order) {
+        order_pool_->release(order);
+      }
+    }
+  }
+
+  //############################################################################
+  /// Respond
+  //############################################################################
+  void
+  socket_server_t::
+  respond(const report_t& report, handles_t& pending) {
+
+    ////////
+    /// a handle of a closed session no longer finds its slot, or finds
+    /// it opened again for another session (see buffer())
+    ////////
+    session_handle_t handle = report.order_->session();
+    conn_info_t* conn = sessions_->find(handle);
+    if (! conn) {
+      TRACE_BEGIN << "cannot respond to client - socket has been closed. "
+                  << "report: " << report << std::endl; TRACE_END
+      return;
+    }
+    transmission::message_t msg(report);
+    buffer(*conn, handle, msg, pending);
+  }
+
+  //############################################################################
+  /// Buffer
+  //############################################################################
+  void
+  socket_server_t::
+  buffer(conn_info_t& conn,
+         session_handle_t handle,
+         const transmission::message_t& msg,
+         handles_t& pending) {
+
+    char buf[transmission::max_size];
+    size_t n = transmission::encode(msg, buf);
+
+    ////////
+    /// append thread-safe to the client's send buffer, numbered in the
+    /// order appended; a client too far behind gets no more and is closed
+    /// by its reader
+    ////////
+    boost::lock_guard<boost::mutex> lock(conn.mutex_);
+    if (conn.handle_ != handle || conn.overflow_)
+      return;
+    if (conn.send_buffer_.size() + n > conn_info_t::max_send_buffer) {
+      TRACE_BEGIN << "send buffer overflow on socket: " << conn.socket_
+                  << ", dropped: " << msg << std::endl; TRACE_END
+      conn.overflow_ = true;
+    }
+    else {
+      transmission::put32(buf + 4, ++conn.sequence_);
+      conn.send_buffer_.insert(conn.send_buffer_.end(), buf, buf + n);
+    }
+    if (! conn.pending_) {
+      conn.pending_ = true;
+      pending.push_back(handle);
+    }
+  }
+
+  //############################################################################
+  /// Schedule
+  //############################################################################
+  void
+  socket_server_t::
+  schedule(handles_t& pending) {
+
+    if (pending.empty())
+      return;
+
+    for (size_t r = 0; r < readers_.size(); ++r) {
+      reader_t& reader = *readers_[r];
+      bool woken = false;
+      for (size_t i = 0; i < pending.size(); ++i) {
+        if (sessions_->reader(pending[i]) != r)
+          continue;
+        if (! woken) {
+          reader.mutex_.lock();
+          woken = true;
+        }
+        reader.pending_.push_back(pending[i]);
+      }
+      if (! woken)
+        continue;
+      reader.mutex_.unlock();
+
+      /// on an interval the reader's timer flushes, without a syscall here
+      if (! flush_micros_) {
+        boost::uint64_t one = 1;
+        if (::write(reader.event_, &one, sizeof(one)) != sizeof(one)) {
+          TRACE_BEGIN << "reader wake up failed: " << ::strerror(errno)
+                      << std::endl; TRACE_END
+        }
+      }
+    }
+    pending.clear();
+  }
+
+  //############################################################################
+  /// Flush
+  //############################################################################
+  void
+  socket_server_t::
+  flush(int epoll,
+        connections_t& connections,
+        reader_t& reader,
+        handles_t& pending) {
+
+    /// reset the event and the timer, whichever fired
+    boost::uint64_t count;
+    while (::read(reader.event_, &count, sizeof(count)) > 0)
+      ;
+    if (reader.timer_ != -1) {
+      while (::read(reader.timer_, &count, sizeof(count)) > 0)
+        ;
+    }
+    {
+      boost::lock_guard<boost::mutex> lock(reader.mutex_);
+      pending.swap(reader.pending_);
+    }
+    ////////
+    /// the reader closes its own sessions only, so a session found open
+    /// stays open, and its socket valid, while the reader uses it
+    ////////
+    for (size_t i = 0; i < pending.size(); ++i) {
+      conn_info_t* conn = sessions_->find(pending[i]);
+      if (conn && ! send(*conn)) {
+        close(epoll, connections, conn->socket_);
+      }
+    }
+    pending.clear();
+  }
+
+  //############################################################################
+  /// Send
+  //############################################################################
+  bool
+  socket_server_t::
+  send(conn_info_t& conn) {
+
+    ////////
+    /// swap buffers, as uring_send() does: processors append to the empty
+    /// one while the reader writes this one without holding the mutex.
+    /// Only the reader closes the session, so the socket stays open
+    ////////
+    std::vector<char>& buffer = readers_[conn.reader_]->sending_;
+    {
+      boost::lock_guard<boost::mutex> lock(conn.mutex_);
+      conn.pending_ = false;
+      if (conn.socket_ == -1)
+        return true;
+      buffer.swap(conn.send_buffer_);
+    }
+    size_t sent = 0;
+    bool ok = true;
+    if (conn.channel_) {
+
+      /// the rest goes out once the client has made room, and rung
+      shm_channel_t& channel = *conn.channel_;
+      while (sent < buffer.size()) {
+        size_t n = channel.write(&buffer[sent], buffer.size() - sent);
+        sent += n;
+        if (n == 0 && (channel.broken() || channel.wait_writable()))
+          break;
+      }
+      if (channel.broken()) {
+        TRACE_BEGIN << "inconsistent shared memory ring on socket: "
+                    << conn.socket_ << std::endl; TRACE_END
+        ok = false;
+      }
+      else if (sent && channel.wake()) {
+        shm_channel_t::notify(conn.socket_);
+      }
+    }
+    else {
+      while (sent < buffer.size()) {
+        ssize_t n = ::send(conn.socket_, &buffer[sent], buffer.size() - sent,
+                           MSG_NOSIGNAL);
+        if (n > 0) {
+          sent += n;
+          continue;
+        }
+        /// the rest goes out on the next writable edge
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+          break;
+        if (n == -1 && errno == EINTR)
+          continue;
+        TRACE_BEGIN << "write to socket " << conn.socket_ << " failed: "
+                    << ::strerror(errno) << std::endl; TRACE_END
+        ok = false;
+        break;
+      }
+    }
+    if (! ok) {
+      buffer.clear();
+      return false;
+    }
+
+    ////////
+    /// the unsent rest goes back in front of what was appended meanwhile;
+    /// it is moved up before taking the mutex, and the appends are copied
+    /// behind it only if there are any
+    ////////
+    buffer.erase(buffer.begin(), buffer.begin() + sent);
+    boost::lock_guard<boost::mutex> lock(conn.mutex_);
+    if (! buffer.empty()) {
+      buffer.insert(buffer.end(), conn.send_buffer_.begin(),
+                    conn.send_buffer_.end());
+      buffer.swap(conn.send_buffer_);
+    }
+    buffer.clear();
+    if (conn.overflow_) {
+      TRACE_BEGIN << "closing slow client on socket: " << conn.socket_
+                  << std::endl; TRACE_END
+      return false;
+    }
+    return true;
+  }
+
+#ifdef TRADING_HAVE_IO_URING
+  //############################################################################
+  /// Uring Thread
+  //############################################################################
+  void
+  socket_server_t::
+  uring_thread(size_t ndx) {
+
+    pin("reader", ndx, nth_cpu(reader_cpus_, ndx));
+    reader_t& reader = *readers_[ndx];
+    uring_t& ring = *reader.ring_;
+    connections_t connections;
+    handles_t pending;
+    boost::uint64_t event_count;
+    boost::uint64_t timer_count;
+
+    try {
+      prep_accept(ring, reader.listener_);
+      prep_read(ring, op_event, reader.event_, &event_count);
+      if (reader.timer_ != -1) {
+        prep_read(ring, op_timer, reader.timer_, &timer_count);
+      }
+      while (true) {
+
+        /// submit what the last round queued and wait for a completion
+        ring.submit(1);
+
+        while (const struct io_uring_cqe* cqe = ring.peek()) {
+
+          uring_op_t op = static_cast<uring_op_t>(cqe->user_data >> 32);
+          int fd = static_cast<boost::uint32_t>(cqe->user_data);
+          int res = cqe->res;
+          unsigned flags = cqe->flags;
+          ring.seen();
+          bool more = flags & IORING_CQE_F_MORE;
+
+          if (op == op_accept) {
+            if (res >= 0) {
+              TRACE_BEGIN << "client connected socket: " << res
+                          << std::endl; TRACE_END
+              connection_ptr connection =
+                boost::make_shared<connection_t>(res, ndx);
+              connections[res] = connection;
+              prep_recv(ring, res);
+              ++connection->ops_;
+              connection->receiving_ = true;
+            }
+            else {
+              TRACE_BEGIN << "Socket accept failed: " << ::strerror(-res)
+                          << std::endl; TRACE_END
+            }
+            if (! more) {
+              prep_accept(ring, reader.listener_);
+            }
+            continue;
+          }
+          if (op == op_event || op == op_timer) {
+            {
+              boost::lock_guard<boost::mutex> lock(reader.mutex_);
+              pending.swap(reader.pending_);
+            }
+            for (size_t i = 0; i < pending.size(); ++i) {
+              conn_info_t* conn = sessions_->find(pending[i]);
+              if (! conn)
+                continue;
+              connections_t::iterator c = connections.find(conn->socket_);
+              if (c == connections.end())
+                continue;
+              connection_ptr connection = c->second;
+              if (! uring_send(ring, *connection)) {
+                uring_close(connections, *connection);
+              }
+            }
+            pending.clear();
+            uring_resume(ring, connections, reader);
+            prep_read(ring, op, fd,
+                      op == op_event ? &event_count : &timer_count);
+            continue;
+          }
+
+          /// a connection stays until its last operation completes
+          connections_t::iterator c = connections.find(fd);
+          if (c == connections.end())
+            continue;
+          connection_ptr connection = c->second;
+          if (op == op_recv) {
+            if (! more) {
+              --connection->ops_;
+              connection->receiving_ = false;
+            }
+            if (res > 0) {
+              ////////
+              /// a provided buffer fits behind a partial message, unless
+              /// it arrived after a pause; the buffer goes back to the
+              /// kernel once copied
+              ////////
+              unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+              bool ok = true;
+              if (! connection->closing_) {
+                std::vector<char>& buf = connection->buf_;
+                if (connection->have_ + res > buf.size()) {
+                  buf.resize(connection->have_ + res);
+                }
+                ::memcpy(&buf[connection->have_], ring.buffer(id), res);
+                connection->have_ += res;
+                if (! connection->paused_) {
+                  ok = frame(*connection);
+                  if (ok && connection->paused_) {
+                    reader.paused_.push_back(connection);
+                    prep_cancel(ring, fd);
+                    ++connection->ops_;
+                  }
+                }
+              }
+              ring.recycle(id);
+              if (! ok) {
+                uring_close(connections, *connection);
+              }
+            }
+            else if (res == -ENOBUFS || res == -ECANCELED) {
+              /// every buffer was taken, or paused; received again below
+            }
+            else if (! connection->closing_) {
+              if (res == 0) {
+                TRACE_BEGIN << "client closed connection on socket: " << fd
+                            << std::endl; TRACE_END
+              }
+              else {
+                TRACE_BEGIN << "read failed on socket: " << fd << ": "
+                            << ::strerror(-res) << std::endl; TRACE_END
+              }
+              uring_close(connections, *connection);
+            }
+            if (! connection->receiving_ && ! connection->paused_ &&
+                ! connection->closing_) {
+              prep_recv(ring, fd);
+              ++connection->ops_;
+              connection->receiving_ = true;
+            }
+          }
+          else if (op == op_cancel) {
+            --connection->ops_;
+          }
+          else if (op == op_send) {
+            --connection->ops_;
+            if (res < 0 && ! connection->closing_) {
+              TRACE_BEGIN << "write to socket " << fd << " failed: "
+                          << ::strerror(-res) << std::endl; TRACE_END
+              uring_close(connections, *connection);
+            }
+            else if (! connection->closing_) {
+              /// the rest of a short send, else the next send buffer
+              connection->sent_ += res;
+              if (connection->sent_ < connection->sending_.size()) {
+                prep_send(ring, fd,
+                          &connection->sending_[connection->sent_],
+                          connection->sending_.size() - connection->sent_);
+                ++connection->ops_;
+              }
+              else {
+                connection->sending_.clear();
+                if (! uring_send(ring, *connection)) {
+                  uring_close(connections, *connection);
+                }
+              }
+            }
+          }
+          if (connection->closing_ && connection->ops_ == 0 &&
+              connections.erase(fd)) {
+            ::close(fd);
+          }
+        }
+      }
+    }
+    catch (const std::string& ex) {
+      TRACE_BEGIN << "io_uring reader " << ndx << " failed: " << ex
+                  << std::endl; TRACE_END
+    }
+  }
+
+  //############################################################################
+  /// Uring Send
+  //############################################################################
+  bool
+  socket_server_t::
+  uring_send(uring_t& ring, connection_t& connection) {
+
+    conn_info_t* conn = connection.conn_info_;
+    if (! conn || connection.closing_ || ! connection.sending_.empty())
+      return true;
+
+    ////////
+    /// swap buffers: processors fill the one the last send emptied while
+    /// the kernel sends this one
+    ////////
+    {
+      boost::lock_guard<boost::mutex> lock(conn->mutex_);
+      conn->pending_ = false;
+      if (conn->overflow_) {
+        TRACE_BEGIN << "closing slow client on socket: " << conn->socket_
+                    << std::endl; TRACE_END
+        return false;
+      }
+      connection.sending_.swap(conn->send_buffer_);
+    }
+    connection.sent_ = 0;
+    if (! connection.sending_.empty()) {
+      prep_send(ring, connection.socket_, &connection.sending_[0],
+                connection.sending_.size());
+      ++connection.ops_;
+    }
+    return true;
+  }
+
+  //############################################################################
+  /// Uring Resume
+  //############################################################################
+  void
+  socket_server_t::
+  uring_resume(uring_t& ring, connections_t& connections, reader_t& reader) {
+
+    if (! reader.resume_.load() || ! reader.resume_.exchange(false))
+      return;
+
+    ////////
+    /// in the order paused, as resume() does; a receive still in flight
+    /// ends with its cancel, and is made again by its completion
+    ////////
+    std::vector<connection_ptr> paused;
+    paused.swap(reader.paused_);
+    std::fill(reader.npaused_.begin(), reader.npaused_.end(), 0);
+    for (size_t i = 0; i < paused.size(); ++i) {
+      connection_t& connection = *paused[i];
+      if (connection.closing_)
+        continue;
+      connection.paused_ = false;
+      if (! frame(connection)) {
+        uring_close(connections, connection);
+      }
+      else if (connection.paused_) {
+        reader.paused_.push_back(paused[i]);
+      }
+      else if (! connection.receiving_) {
+        prep_recv(ring, connection.socket_);
+        ++connection.ops_;
+        connection.receiving_ = true;
+      }
+    }
+  }
+
+  //############################################################################
+  /// Uring Close
+  //############################################################################
+  void
+  socket_server_t::
+  uring_close(connections_t& connections, connection_t& connection) {
+
+    if (connection.closing_)
+      return;
+    connection.closing_ = true;
+    if (connection.conn_info_) {
+      hang_up(connection.conn_info_);
+      connection.conn_info_ = NULL;
+    }
+    ::shutdown(connection.socket_, SHUT_RDWR);
+    int socket = connection.socket_;
+    if (connection.ops_ == 0 && connections.erase(socket)) {
+      ::close(socket);
+    }
+  }
+#endif
+
+  //############################################################################
+  /// Journal Thread
+  //############################################################################
+  void
+  socket_server_t::
+  journal_thread() {
+
+    pin("journal", -1, service_cpus_);
+    try {
+      journal_->run();
+    }
+    catch (const std::string& error) {
+      ////////
+      /// the server doesn't go on unjournaled: shut down as on SIGTERM,
+      /// which the snapshot thread handles
+      ////////
+      TRACE_BEGIN << "journal failed, shutting down: " << error << std::endl;
+      TRACE_END
+      ::kill(::getpid(), SIGTERM);
+    }
+  }
+
+  //############################################################################
+  /// Build Shard
+  //############################################################################
+  void
+  socket_server_t::
+  build_shard(size_t shard, const server_config_t& config) {
+
+    pin("shard builder", shard, nth_cpu(processor_cpus_, shard));
+
+    /// assigned from a fresh queue, as copies of a queue share its mutex
+    work_queues_[shard] = work_queue_t(1024, config.queue_limit_);
+
+    ////////
+    /// shard i assigns order ids i + n, i + 2n, ... for n shards, so a
+    /// cancel or amend request is routed by order id modulo n
+    ////////
+    order_managers_[shard] = order_manager_t(
+      config.max_symbols_, config.price_levels_, config.pool_size_,
+      shard, nprocessors_,
+      cancel_on_disconnect_ ? sessions_->capacity() : 0);
+  }
+
+  //############################################################################
+  /// Pin
+  //############################################################################
+  void
+  socket_server_t::
+  pin(const char* role, int index, const cpus_t& cpus) {
+
+    /// one trace per thread: the tracer prefixes every insertion
+    bool pinned = pin_thread(cpus);
+    std::ostringstream os;
+    os << role;
+    if (index >= 0)
+      os << " " << index;
+    os << (pinned ? " on cpus " : " failed to pin to cpus ")
+       << format_cpus(cpus) << ", running on " << placement();
+    TRACE_BEGIN << os.str() << std::endl; TRACE_END
+  }
+
+  //############################################################################
+  /// Statistics Thread
+  //############################################################################
+  void
+  socket_server_t::
+  stats_thread() {
+
+    pin("stats", -1, service_cpus_);
+    while (true) {
+
+      boost::this_thread::sleep(boost::posix_time::seconds(stats_interval_));
+
+      TRACE_BEGIN << "order pool: " << order_pool_->in_use() << " in use, "
+                  << order_pool_->high_water() << " high water, "
+                  << order_pool_->capacity() << " capacity, "
+                  << order_pool_->reserve() << " reserved" << std::endl;
+      TRACE_END
+      if (journal_) {
+        TRACE_BEGIN << "journal: " << journal_->written() << " written, "
+                    << journal_->syncs() << " syncs" << std::endl; TRACE_END
+      }
+    }
+  }
+
+}  /// namespace trading
+
+//##############################################################################
+/// Main
+//##############################################################################
+int main(int argc, const char** argv) {
+
+  trading::server_config_t config;
+  if (! config.parse(argc, argv)) {
+    return -1;
+  }
   trading::socket_server_t server;
   try {
     /// trading::tracer_t::instance().disable();
-    server.init(port, nreaders, nprocessors);
+    server.init(config);
     server.run();
   } 
   catch (const std::string& ex) {
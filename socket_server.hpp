@@ -1,23 +1,27 @@
 #ifndef __SOCKET_SERVER_HPP__
 #define __SOCKET_SERVER_HPP__
 
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/composite_key.hpp>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <signal.h>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <work_queue.hpp>
 #include <thread_pool.hpp>
 #include <order.hpp>
+#include <order_pool.hpp>
+#include <journal.hpp>
+#include <snapshot.hpp>
+#include <uring.hpp>
+#include <xmit_order.hpp>
 #include <conn_info.hpp>
+#include <session_table.hpp>
+#include <shm_channel.hpp>
+#include <symbol_directory.hpp>
+#include <server_config.hpp>
 
 namespace trading {
 
-  namespace mti = boost::multi_index;
-
   //############################################################################
   /// CLASS: Socket Server
   //############################################################################
@@ -27,26 +31,36 @@ namespace trading {
     //##########################################################################
     /// Initialize
     ///
+    /// - Block SIGINT and SIGTERM for the snapshot thread, if snapshots or
+    ///   the journal are configured.
     /// - Initialize thread pool to number of threads.
-    /// - Create server socket.
-    /// - Bind server socket.
-    /// - Listen on server socket.
+    /// - Load the symbol universe, if configured.
+    /// - Recover the books from the latest snapshot and the journal after
+    ///   it, if configured (see recover()).
+    /// - Take the snapshot requests from the order pool, if snapshots are
+    ///   configured.
+    /// - Create a listening socket per reader (see listen()), and the Unix
+    ///   socket of shared memory sessions if configured (see
+    ///   listen_unix()).
     ///
-    /// @param[in] port         server port
-    /// @param[in] nreaders     number of reader threads
-    /// @param[in] nprocessors  number of processor threads
-    /// @return                 none
-    /// @throws                 std::string if any step fails
+    /// @param[in] config  server configuration
+    /// @return            none
+    /// @throws            std::string if any step fails
     //##########################################################################
-    void init(uint16_t port, size_t nreaders, size_t nprocessors);
+    void init(const server_config_t& config);
 
     //##########################################################################
     /// Run
     ///
-    /// - Launch reader threads.
-    /// - Launch processor threads.
-    /// - In loop accept socket.
-    /// - Put on client socket queue.
+    /// - Launch reader threads, each running an event loop that accepts
+    ///   connections and reads every connection it accepted; the loop is
+    ///   io_uring based if configured and supported, epoll based if not.
+    ///   Readers of shared memory sessions always run on epoll.
+    /// - Launch one processor thread per shard.
+    /// - Launch journal thread, if enabled.
+    /// - Launch snapshot thread, if snapshots or the journal are enabled.
+    /// - Launch statistics thread, if enabled.
+    /// - Wait on the thread pool.
     ///
     /// @param[in]     none
     /// @param[inout]  none
@@ -57,93 +71,824 @@ namespace trading {
 
   private:
 
+    //##########################################################################
+    /// STRUCT: Connection
+    ///
+    /// Reader thread's state of one client socket: the conn info, once the
+    /// client has logged in, and a receive buffer holding what
+    /// was read but not yet framed, at most a partial message between
+    /// reads. A connection is paused, and not read, while the message at
+    /// the front of its buffer waits for room in a full work queue.
+    ///
+    /// A shared memory session reads from and writes to the rings of its
+    /// channel instead; its socket, a Unix socket, is only the doorbell.
+    ///
+    /// With io_uring the socket also has operations in flight: a send
+    /// buffer given to the kernel while processors fill the next one, and
+    /// a count of the operations that still refer to the socket, which is
+    /// closed once the count drops to zero.
+    //##########################################################################
+    struct connection_t {
+
+      /// receive buffer size, hundreds of messages per read
+      enum { buffer_size = 64 * 1024 };
+
+      connection_t(int socket, size_t reader) :
+        socket_(socket), reader_(reader), conn_info_(NULL), sequence_(0),
+        have_(0),
+        buf_(buffer_size), paused_(false), ops_(0), receiving_(false),
+        sent_(0), closing_(false) {}
+
+      int                socket_;
+      size_t             reader_;     /// reader thread serving it
+      conn_info_t*       conn_info_;  /// NULL until logged in
+      boost::uint32_t    sequence_;   /// last inbound sequence number
+      size_t             have_;       /// bytes in buf_
+      std::vector<char>  buf_;        /// receive buffer
+      bool               paused_;     /// waits for a work queue to drain
+      size_t             ops_;        /// io_uring operations in flight
+      bool               receiving_;  /// io_uring receive in flight
+      std::vector<char>  sending_;    /// io_uring send in flight
+      size_t             sent_;       /// bytes of sending_ sent
+      bool               closing_;    /// shut down, closed once ops_ is 0
+      shm_channel_ptr    channel_;    /// shared memory, NULL on TCP
+    };
+    typedef boost::shared_ptr<connection_t> connection_ptr;
+
+    /// connections of a reader thread by socket
+    typedef boost::unordered_map<int, connection_ptr> connections_t;
+
+    /// sessions with reports to flush
+    typedef std::vector<session_handle_t> handles_t;
+
+    //##########################################################################
+    /// STRUCT: Reader
+    ///
+    /// What processor threads share with a reader thread: the sessions
+    /// they buffered reports for, an event to wake the reader up, and
+    /// whether to resume its paused connections when woken. Each
+    /// reader accepts from a listening socket of its own, but readers of
+    /// shared memory sessions share the Unix socket. The
+    /// reader's io_uring instance, if it runs on io_uring, is set up with
+    /// the reader so an unsupported kernel is found before serving.
+    //##########################################################################
+    struct reader_t {
+      reader_t() :
+        listener_(-1), event_(-1), timer_(-1), shm_(false), resume_(false) {}
+
+      int           listener_; /// listening socket of its own
+      int           event_;    /// eventfd, written after each batch
+      int           timer_;    /// timerfd of the flush interval, -1 if none
+      bool          shm_;      /// serves shared memory sessions
+      boost::mutex  mutex_;    /// guards pending_
+      handles_t     pending_;  /// sessions with reports to flush
+      boost::atomic<bool>
+                    resume_;   /// a work queue drained, resume connections
+      std::vector<connection_ptr>
+                    paused_;   /// in the order paused, reader thread only
+      std::vector<size_t>
+                    npaused_;  /// of paused_ by shard, reader thread only
+      std::vector<orders_t>
+                    staged_;   /// by shard, queued once framed (block)
+      std::vector<char>
+                    sending_;  /// send buffer being written, reader
+                               /// thread only (see send())
+#ifdef TRADING_HAVE_IO_URING
+      boost::shared_ptr<uring_t>
+                    ring_;     /// NULL if the reader runs on epoll
+#endif
+    };
+    typedef boost::shared_ptr<reader_t> reader_ptr;
+
+    //##########################################################################
+    /// Listen
+    ///
+    /// Creates a listening socket bound to the port with SO_REUSEPORT, so
+    /// every reader listens on the same port and the kernel balances new
+    /// connections across the readers.
+    ///
+    /// @param[in]     port     server port
+    /// @param[in]     backlog  pending connections the socket holds
+    /// @param[in]     flags    socket type flags, e.g. SOCK_NONBLOCK
+    /// @return        listening socket
+    /// @throws        std::string if any step fails
+    //##########################################################################
+    int listen(boost::uint16_t port, int backlog, int flags);
+
+    //##########################################################################
+    /// Listen Unix
+    ///
+    /// Creates the non-blocking Unix listening socket clients on the same
+    /// host set shared memory sessions up through, replacing a socket
+    /// file left behind by an earlier run.
+    ///
+    /// @param[in]     path     socket path
+    /// @param[in]     backlog  pending connections the socket holds
+    /// @return        listening socket
+    /// @throws        std::string if any step fails
+    //##########################################################################
+    int listen_unix(const std::string& path, int backlog);
+
     //##########################################################################
     /// Reader Thread
     ///
-    /// - Get next socket from socket queue.
-    /// - Read trader id from socket.
-    /// - Create conn info w/ trader id and socket.
-    /// - Add conn info instance to conn info table.
-    /// - In a loop:
-    /// - Read from socket into order struct.
-    /// - Zero byte read indicates client closed connection.
-    /// - Remove entry from conn info table keyed by socket.
-    /// - Break out of inner loop and get next socket connection.
-    /// - For a good read, create order ptr from order structure.
-    /// - Add order ptr to work queue.
+    /// Event loop over an edge triggered epoll instance of its own. Every
+    /// reader thread also waits on its own listening socket; the thread
+    /// that accepts a connection serves it until it closes, in both
+    /// directions.
     ///
-    /// @param[in]     none
+    /// - Wait for events.
+    /// - On the listening socket, accept connections (see accept()).
+    /// - On its event or flush timer, write the send buffers processor
+    ///   threads filled (see flush()), and resume paused connections once
+    ///   a work queue has drained (see resume()).
+    /// - On a writable client socket, write what is left of its send
+    ///   buffer (see send()).
+    /// - On a readable client socket, read it until it would block (see
+    ///   receive()).
+    /// - Close a socket if the client closed it, broke the protocol or
+    ///   fell too far behind (see close()).
+    ///
+    /// Readers of shared memory sessions share the Unix listening socket,
+    /// and are woken by the doorbell of a session instead of its data (see
+    /// doorbell()). Busy polling, they never sleep in epoll and read the
+    /// rings of their sessions on every round (see poll()).
+    ///
+    /// @param[in]     ndx  index of the reader
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void reader_thread(size_t ndx);
+
+#ifdef TRADING_HAVE_IO_URING
+    //##########################################################################
+    /// Uring Thread
+    ///
+    /// Reader thread on the reader's io_uring instance instead of epoll;
+    /// connections are framed, dispatched and flushed as by reader_thread,
+    /// but the kernel does the socket I/O and the thread makes one system
+    /// call per loop, submitting and waiting at once.
+    ///
+    /// - A multishot accept on the reader's listening socket completes
+    ///   once per connection; each connection gets a multishot receive.
+    /// - Multishot receives complete into provided buffers, which are
+    ///   copied into the connection's receive buffer, framed and handed
+    ///   back to the kernel.
+    /// - Reads of the event and flush timer complete when processors have
+    ///   buffered reports; each pending connection's send buffer is sent
+    ///   (see uring_send()), the sends of a flush submitted together.
+    ///   Paused connections are resumed once a work queue has drained
+    ///   (see uring_resume()).
+    /// - A connection's receive is cancelled when it pauses; what arrived
+    ///   before the cancel took effect is kept in its receive buffer.
+    /// - A connection is shut down when the client closes it, breaks the
+    ///   protocol or falls too far behind, and closed once its last
+    ///   operation completes (see uring_close()).
+    ///
+    /// @param[in]     ndx  index of the reader
     /// @param[inout]  none
     /// @return        none
     /// @throws        none
     //##########################################################################
-    void reader_thread();
+    void uring_thread(size_t ndx);
+
+    //##########################################################################
+    /// Uring Send
+    ///
+    /// Unless a send is in flight, takes the connection's send buffer and
+    /// queues a send of it; a send in flight takes the next buffer when it
+    /// completes.
+    ///
+    /// @param[inout]  ring        reader's io_uring instance
+    /// @param[inout]  connection  connection to send to
+    /// @return        false if the send buffer had overflowed, and the
+    ///                connection must be closed
+    /// @throws        std::string if the submission queue fails
+    //##########################################################################
+    bool uring_send(uring_t& ring, connection_t& connection);
+
+    //##########################################################################
+    /// Uring Resume
+    ///
+    /// Once a work queue has drained, frames what the reader's paused
+    /// connections hold (see frame()) and receives again on those no
+    /// longer paused.
+    ///
+    /// @param[inout]  ring         reader's io_uring instance
+    /// @param[inout]  connections  reader thread's connections
+    /// @param[inout]  reader       reader
+    /// @return        none
+    /// @throws        std::string if the submission queue fails
+    //##########################################################################
+    void uring_resume(uring_t& ring,
+                      connections_t& connections,
+                      reader_t& reader);
+
+    //##########################################################################
+    /// Uring Close
+    ///
+    /// Hangs up the connection (see hang_up()) and shuts the socket down,
+    /// which ends its operations in flight; the socket is closed and the
+    /// connection dropped once the last one completes, so no completion
+    /// can name a descriptor reused by a newer connection.
+    ///
+    /// @param[inout]  connections  reader thread's connections
+    /// @param[inout]  connection   connection to close
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void uring_close(connections_t& connections, connection_t& connection);
+#endif
+
+    //##########################################################################
+    /// Accept
+    ///
+    /// Accepts the connections pending on the reader's listening socket,
+    /// up to a batch, makes them non-blocking and adds them to the reader
+    /// thread's epoll instance, edge triggered. A shared memory session is
+    /// given the segment of a new channel straight away.
+    ///
+    /// @param[in]     ndx          index of the reader
+    /// @param[in]     epoll        reader thread's epoll instance
+    /// @param[inout]  connections  reader thread's connections
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void accept(size_t ndx, int epoll, connections_t& connections);
+
+    //##########################################################################
+    /// Receive
+    ///
+    /// Reads a connection until the socket would block, as an edge
+    /// triggered event requires, or until the connection pauses. Each
+    /// read fills as much of the receive buffer as the socket has, and
+    /// every complete message in it is framed (see frame()). A shared
+    /// memory session is read from its ring (see shm_receive()).
+    ///
+    /// @param[inout]  connection  connection with data to read
+    /// @return        false if the client closed the connection, the read
+    ///                failed or framing failed
+    /// @throws        none
+    //##########################################################################
+    bool receive(connection_t& connection);
+
+    //##########################################################################
+    /// Shm Receive
+    ///
+    /// Reads a shared memory session's inbound ring until it is empty, or
+    /// until the connection pauses, framing as receive() does. Once the
+    /// ring is empty the client is asked to ring for what it writes next,
+    /// unless busy polling.
+    ///
+    /// @param[inout]  connection  shared memory session
+    /// @return        false if framing failed
+    /// @throws        none
+    //##########################################################################
+    bool shm_receive(connection_t& connection);
+
+    //##########################################################################
+    /// Doorbell
+    ///
+    /// Takes what was rung on a shared memory session's socket; a ring
+    /// only says to look at the channel again.
+    ///
+    /// @param[inout]  connection  shared memory session
+    /// @return        false if the client hung up
+    /// @throws        none
+    //##########################################################################
+    bool doorbell(connection_t& connection);
+
+    //##########################################################################
+    /// Poll
+    ///
+    /// Busy polling: reads every shared memory session of the reader that
+    /// is not paused and has bytes in its ring (see shm_receive()).
+    ///
+    /// @param[in]     epoll        reader thread's epoll instance
+    /// @param[inout]  connections  reader thread's connections
+    /// @param[inout]  reader       reader
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void poll(int epoll, connections_t& connections, reader_t& reader);
+
+    //##########################################################################
+    /// Resume
+    ///
+    /// Once a work queue has drained, frames what the reader's paused
+    /// connections hold and reads them on (see receive()), in the order
+    /// they paused; a connection whose work queue is still full pauses
+    /// again, keeping its place. Data left in a socket raises no new edge,
+    /// so the connection is read here.
+    ///
+    /// @param[in]     epoll        reader thread's epoll instance
+    /// @param[inout]  connections  reader thread's connections
+    /// @param[inout]  reader       reader
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void resume(int epoll, connections_t& connections, reader_t& reader);
+
+    //##########################################################################
+    /// Flush
+    ///
+    /// Takes the reader's pending sessions and writes the send buffers of
+    /// those still open (see send()), closing connections that fail.
+    ///
+    /// @param[in]     epoll        reader thread's epoll instance
+    /// @param[inout]  connections  reader thread's connections
+    /// @param[inout]  reader       reader
+    /// @param[inout]  pending      scratch list of sessions
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void flush(int epoll,
+               connections_t& connections,
+               reader_t& reader,
+               handles_t& pending);
+
+    //##########################################################################
+    /// Send
+    ///
+    /// Writes as much of a connection's send buffer as the socket takes in
+    /// one call; the rest goes out once the socket is writable again. A
+    /// shared memory session's buffer goes to its ring, and the rest once
+    /// the client has made room and rung. The buffer is written outside
+    /// the conn info's mutex, swapped for the reader's empty one, so
+    /// processors appending reports never wait on the write.
+    ///
+    /// @param[inout]  conn  conn info of the connection
+    /// @return        false if the write failed or the send buffer had
+    ///                overflowed, and the connection must be closed
+    /// @throws        none
+    //##########################################################################
+    bool send(conn_info_t& conn);
+
+    //##########################################################################
+    /// Frame
+    ///
+    /// Decodes the complete messages at the front of the receive buffer
+    /// and moves the partial message after them, if any, to the front.
+    ///
+    /// - Every message must carry the session's next inbound sequence
+    ///   number.
+    /// - The first message is the login (see login()).
+    /// - Every other message is an order or request (see dispatch()).
+    /// - A message dispatch() could not queue stays at the front of the
+    ///   buffer, unframed, and framing stops while the connection is
+    ///   paused.
+    /// - Under the block policy, the orders and requests dispatch() staged
+    ///   are queued last, a batch per shard.
+    ///
+    /// @param[inout]  connection  connection with data received
+    /// @return        false if the client broke the protocol or its login
+    ///                was rejected, and the connection must be closed
+    /// @throws        none
+    //##########################################################################
+    bool frame(connection_t& connection);
+
+    //##########################################################################
+    /// Login
+    ///
+    /// - Reject a version below the lowest the server speaks, a trader id
+    ///   already logged in, or a login the reader has no session slot
+    ///   left for, with a login reject.
+    /// - Otherwise open a session in the session table with socket, trader
+    ///   id and a new session id, and answer with a login ack carrying the
+    ///   agreed version (the lower of the two highest versions), the
+    ///   session id and the session flags.
+    ///
+    /// @param[inout]  connection  connection logging in
+    /// @param[in]     msg         first message of the connection
+    /// @return        false if the login was rejected or msg is no login
+    /// @throws        none
+    //##########################################################################
+    bool login(connection_t& connection, const transmission::message_t& msg);
+
+    //##########################################################################
+    /// Claim
+    ///
+    /// @param[in]  trader_id  trader id logging in
+    /// @return                false if the trader id is logged in already
+    /// @throws                none
+    //##########################################################################
+    bool claim(int trader_id);
+
+    //##########################################################################
+    /// Release
+    ///
+    /// @param[in]  trader_id  trader id logging out
+    /// @return                none
+    /// @throws                none
+    //##########################################################################
+    void release(int trader_id);
+
+    //##########################################################################
+    /// Dispatch
+    ///
+    /// - For a new order, intern the stock into a symbol id; orders for
+    ///   stocks rejected by the symbol directory, and orders priced
+    ///   outside [1, INT_MAX - price levels], are answered with a
+    ///   rejected message.
+    /// - Allocate an order from the order pool and fill it from the
+    ///   message, with the trader id and handle of the session; cancel and
+    ///   amend requests may take the pool's reserve. If the pool is
+    ///   exhausted answer with a throttled message.
+    /// - Add a new order to the work queue of the shard owning its symbol,
+    ///   a cancel or amend request to the shard that assigned its order id.
+    /// - If the work queue is full, pause the connection or answer with a
+    ///   throttled message, as overflow_ says. While the reader has
+    ///   connections paused on the shard, further connections pause
+    ///   behind them.
+    /// - Under the block policy, stage the order for the shard instead;
+    ///   frame() queues the staged orders, waiting for room.
+    ///
+    /// @param[inout]  connection  logged in connection
+    /// @param[in]     msg         message read from the connection
+    /// @return        false if msg is no order or request
+    /// @throws        none
+    //##########################################################################
+    bool dispatch(connection_t& connection,
+                  const transmission::message_t& msg);
+
+    //##########################################################################
+    /// Refuse
+    ///
+    /// Buffer a rejected or throttled message for a message the server did
+    /// not take, naming it by its sequence number, and schedule the flush.
+    ///
+    /// @param[in]     conn  conn info of the connection
+    /// @param[in]     msg   message not taken
+    /// @param[in]     type  rejected or throttled
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void refuse(conn_info_t& conn, const transmission::message_t& msg,
+                int type);
+
+    //##########################################################################
+    /// Close
+    ///
+    /// - Remove the connection from the epoll instance.
+    /// - Hang up the connection (see hang_up()).
+    /// - Close the socket.
+    ///
+    /// @param[in]     epoll        reader thread's epoll instance
+    /// @param[inout]  connections  reader thread's connections
+    /// @param[in]     socket       socket of the connection
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void close(int epoll, connections_t& connections, int socket);
+
+    //##########################################################################
+    /// Hang Up
+    ///
+    /// - Queue disconnect requests, when cancelling on disconnect.
+    /// - Let the trader id log in again.
+    /// - Close the session in the session table; processor threads holding
+    ///   its handle no longer find it, and buffer no reports for it.
+    ///
+    /// @param[in]     conn  conn info of the connection
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void hang_up(conn_info_t* conn);
 
     //##########################################################################
     /// Processor Thread
     ///
-    /// - Get next work item from work queue.
-    /// - Use order manager to process the order.
-    /// - For each processed order:
-    /// - Get the conn info shared ptr from order
-    /// - If the conn info shared ptr is null, the connection has been closed.
-    /// - Otherwise respond to client using the socket in the conn info.
+    /// Each processor thread owns one shard: a work queue and the order
+    /// manager holding the books of every stock routed to that shard. No
+    /// other thread touches the shard's books, so matching takes no lock.
+    ///
+    /// - Drain up to batch_size_ work items from the shard's work queue.
+    /// - Assign the batch inbound sequence numbers.
+    /// - Use the shard's order manager to match the batch into the
+    ///   thread's execution report ring.
+    /// - Journal the batch, with the order ids assigned by matching.
+    /// - Drain the ring, buffering every report for the client of its
+    ///   order, and hand the clients' send buffers to their readers.
+    /// - Release requests, rejected and completed orders to the order pool.
+    /// - Have the readers resume paused connections if the work queue has
+    ///   drained since refusing a message.
+    /// - Copy one book per snapshot request of the batch into the snapshot
+    ///   being taken, and queue the request again for the next book.
+    ///
+    /// @param[in]     shard  index of the shard owned by this thread
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void processor_thread(size_t shard);
+
+    //##########################################################################
+    /// Drain
+    ///
+    /// Empties a report ring; an order is complete, and goes back to the
+    /// pool, once it is rejected or reported with a zero balance.
+    ///
+    /// @param[inout]  reports  report ring
+    /// @param[inout]  pending  sessions given reports to flush, NULL to
+    ///                         discard the reports
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void drain(report_ring_t& reports, handles_t* pending);
+
+    //##########################################################################
+    /// Schedule
+    ///
+    /// Hands sessions with buffered reports to the readers serving them
+    /// and, unless flushing on an interval, wakes those readers.
+    ///
+    /// @param[inout]  pending  sessions given reports, emptied
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void schedule(handles_t& pending);
+
+    //##########################################################################
+    /// Resume Readers
+    ///
+    /// Flags every reader to resume its paused connections and wakes it.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    void resume_readers();
+
+    //##########################################################################
+    /// Copy Books
+    ///
+    /// Copies the shard's next book, from the symbol id carried in the
+    /// snapshot request's order id on, into snapshot_. Queues the request
+    /// again for the book after it, or marks the shard done once every
+    /// book is copied; the request is kept for the next snapshot.
+    ///
+    /// @param[in]     shard    shard index
+    /// @param[in]     request  snapshot request
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void copy_books(size_t shard, order_ptr request);
+
+    //##########################################################################
+    /// Snapshot Thread
+    ///
+    /// Takes a snapshot every snapshot_interval_ seconds. On SIGINT or
+    /// SIGTERM takes a last snapshot, lets the journal thread write and
+    /// sync what is queued, and exits the process. Messages still arriving
+    /// while the snapshot is taken are journaled but may miss the sync.
     ///
     /// @param[in]     none
     /// @param[inout]  none
     /// @return        none
     /// @throws        none
     //##########################################################################
-    void processor_thread();
+    void snapshot_thread();
 
-    /// copyable mutex
-    typedef boost::shared_ptr<boost::mutex> mutex_ptr;
+    //##########################################################################
+    /// Snapshot
+    ///
+    /// - Note the inbound sequence number and the journal segment in use.
+    /// - Queue a snapshot request on every shard, the ones taken from the
+    ///   order pool at startup.
+    /// - Wait for every shard to copy its books.
+    /// - Write the snapshot file.
+    ///
+    /// @param[in]     none
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void snapshot();
 
-    //#########################################################################
-    /// Multi-index container tag names
-    //#########################################################################
-    struct TRADER_INDEX {};
-    struct SOCKET_INDEX {};
+    //##########################################################################
+    /// Recover
+    ///
+    /// - Map the latest snapshot, if any; it must have been taken with the
+    ///   same number of processors.
+    /// - Read the journal from the segment the snapshot started in, or the
+    ///   whole journal without a snapshot; it must have been written with
+    ///   the same number of processors.
+    /// - Restore the symbol ids of the snapshot and the journal.
+    /// - Rebuild the shards in parallel, one thread per shard (see
+    ///   restore_shard()).
+    /// - Continue the inbound sequence and session ids after the highest
+    ///   ones seen.
+    ///
+    /// @param[in]     config  server configuration
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        std::string if the snapshot or journal can't be read,
+    ///                or a shard can't be restored completely
+    //##########################################################################
+    void recover(const server_config_t& config);
+
+    //##########################################################################
+    /// Restore Shard
+    ///
+    /// Puts the snapshot's resting orders of a shard back into its books,
+    /// then replays the journal messages routed to the shard through its
+    /// order manager; messages a book has already applied are skipped and
+    /// reports are discarded. Restored orders have no connection.
+    ///
+    /// @param[in]     shard    shard index
+    /// @param[in]     file     snapshot, NULL if none
+    /// @param[in]     records  journal records after the snapshot
+    /// @param[inout]  error    why the shard could not be restored
+    ///                         completely, left empty on success
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void restore_shard(size_t shard,
+                       const snapshot_file_t* file,
+                       const std::vector<journal_record_t>& records,
+                       std::string& error);
 
-    //#########################################################################
-    /// Connection Info Table
-    /// - TRADER_INDEX
-    /// - SOCKET_INDEX
-    //#########################################################################
-    typedef mti::multi_index_container<
-      conn_info_ptr,
-      mti::indexed_by<
-        mti::ordered_unique<
-          mti::tag<TRADER_INDEX>,
-          BOOST_MULTI_INDEX_MEMBER(conn_info_t, int, trader_id_)
-        >,
-        mti::ordered_unique<
-          mti::tag<SOCKET_INDEX>,
-          BOOST_MULTI_INDEX_MEMBER(conn_info_t, int, socket_)
-        >
-      >
-    > conn_info_table_t;
+    //##########################################################################
+    /// Disconnect
+    ///
+    /// Queues a disconnect request for the session on every shard so the
+    /// shards cancel its resting orders (cancel on disconnect). Each shard
+    /// cancels only its own orders, in line with its other work. The
+    /// requests are the ones reserve_disconnects() took at login.
+    ///
+    /// @param[in]     conn  conn info of the closing connection
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void disconnect(conn_info_t* conn);
 
     //##########################################################################
-    /// Shortened index typedefs
+    /// Reserve Disconnects
+    ///
+    /// Takes a disconnect request per shard for a session logging in, from
+    /// the order pool's reserve if need be, so the reader never waits on
+    /// the pool when the session closes.
+    ///
+    /// @param[inout]  conn  conn info of the session
+    /// @return        false if the pool is exhausted; nothing is taken
+    /// @throws        none
+    //##########################################################################
+    bool reserve_disconnects(conn_info_t& conn);
+
+    //##########################################################################
+    /// Respond
+    ///
+    /// - Find the conn info of the reported order's session handle.
+    /// - If there is none the connection has been closed.
+    /// - Otherwise buffer the report for the connection (see buffer()).
+    ///
+    /// @param[in]     report   execution report
+    /// @param[inout]  pending  sessions given reports to flush
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void respond(const report_t& report, handles_t& pending);
+
+    //##########################################################################
+    /// Buffer
+    ///
+    /// Unless the session is closed, encodes the message with the
+    /// session's next outbound sequence number, appends it to the conn
+    /// info's send buffer, and notes the session as pending unless it
+    /// already is. The reader serving the session writes the buffer.
+    ///
+    /// @param[inout]  conn     conn info the session was found at
+    /// @param[in]     handle   session handle
+    /// @param[in]     msg      message to send
+    /// @param[inout]  pending  sessions given messages to flush
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void buffer(conn_info_t& conn,
+                session_handle_t handle,
+                const transmission::message_t& msg,
+                handles_t& pending);
+
     //##########################################################################
-    typedef conn_info_table_t::index<TRADER_INDEX>::type  trader_index_t;
-    typedef conn_info_table_t::index<SOCKET_INDEX>::type  socket_index_t;
+    /// Journal Thread
+    ///
+    /// Pins itself to the service CPUs and runs the journal (see
+    /// journal_t::run()). If the journal fails, traces the error and shuts
+    /// the server down by raising SIGTERM.
+    ///
+    /// @param[in]     none
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void journal_thread();
+
+    //##########################################################################
+    /// Build Shard
+    ///
+    /// Constructs the shard's work queue and order manager. Run on a
+    /// thread pinned to the shard's processor CPU, so their pages are first
+    /// touched, and placed, on its NUMA node.
+    ///
+    /// @param[in]  shard   shard index
+    /// @param[in]  config  server configuration
+    /// @return             none
+    /// @throws             none
+    //##########################################################################
+    void build_shard(size_t shard, const server_config_t& config);
+
+    //##########################################################################
+    /// Pin
+    ///
+    /// Pins the calling thread to the CPUs and traces where it runs.
+    ///
+    /// @param[in]  role   thread role, e.g. "reader"
+    /// @param[in]  index  thread index within the role, -1 if only one
+    /// @param[in]  cpus   CPUs, empty leaves the thread unpinned
+    /// @return            none
+    /// @throws            none
+    //##########################################################################
+    void pin(const char* role, int index, const cpus_t& cpus);
+
+    //##########################################################################
+    /// Statistics Thread
+    ///
+    /// Every stats_interval_ seconds traces order pool occupancy and high
+    /// water mark.
+    ///
+    /// @param[in]     none
+    /// @param[inout]  none
+    /// @return        none
+    /// @throws        none
+    //##########################################################################
+    void stats_thread();
+
+    //##########################################################################
+    /// Shard
+    ///
+    /// Maps a symbol onto the shard (processor thread) owning its book.
+    ///
+    /// @param[in]     symbol_id  symbol id
+    /// @param[inout]  none
+    /// @return        shard index in [0, nprocessors_)
+    /// @throws        none
+    //##########################################################################
+    size_t shard(symbol_directory_t::id_t symbol_id) const {
+      return symbol_id % nprocessors_;
+    }
+
+    /// trader ids logged in
+    typedef boost::unordered_set<int> traders_t;
 
     /// work queue of order pointers
     typedef concurrent::queue_t<order_ptr> work_queue_t;
 
-    /// work queue of socket descriptors
-    typedef concurrent::queue_t<int> sockets_t;
+    /// per shard work queues and order managers
+    typedef std::vector<work_queue_t>    work_queues_t;
+    typedef std::vector<order_manager_t> order_managers_t;
 
-    int               socket_;           /// listening socket
-    size_t            nreaders_;         /// number of readers
+    size_t            nreaders_;         /// number of reader threads
     size_t            nprocessors_;      /// number of processors
-    sockets_t         sockets_;          /// client socket connections
-    work_queue_t      work_queue_;       /// work item queue
-    order_manager_t   order_manager_;    /// trade order manager
-    conn_info_table_t conn_info_table_;  /// connection info table
-    boost::mutex      mutex_;            /// sync mechanism
+    size_t            batch_size_;       /// max orders matched per batch
+    int               max_price_;        /// highest price of a new order
+    size_t            flush_micros_;     /// flush interval, 0 = per batch
+    server_config_t::overflow_t
+                      overflow_;         /// policy for a full work queue
+    std::vector<reader_ptr>
+                      readers_;          /// shared state of each reader
+    size_t            stats_interval_;   /// seconds between stats, 0 = off
+    bool              cancel_on_disconnect_;  /// cancel orders of a session
+    boost::atomic<boost::uint64_t>
+                      next_session_;     /// last session id handed out
+    work_queues_t     work_queues_;      /// work item queue per shard
+    order_managers_t  order_managers_;   /// trade order manager per shard
+    boost::shared_ptr<symbol_directory_t>
+                      symbols_;          /// stock to symbol id directory
+    boost::shared_ptr<order_pool_t>
+                      order_pool_;       /// preallocated orders
+    boost::shared_ptr<journal_t>
+                      journal_;          /// inbound journal, NULL if off
+    boost::atomic<boost::uint64_t>
+                      sequence_;         /// last inbound sequence number
+    std::string       snapshot_dir_;     /// snapshots, empty if off
+    size_t            snapshot_interval_;  /// seconds, 0 = shutdown only
+    boost::shared_ptr<snapshot_t>
+                      snapshot_;         /// snapshot being taken
+    orders_t          snapshot_requests_;  /// one per shard, reused
+    bool              handle_signals_;   /// snapshot thread runs
+    sigset_t          signals_;          /// shutdown signals
+    size_t            shm_ring_size_;    /// bytes per shared memory ring
+    bool              shm_busy_poll_;    /// shared memory readers spin
+    cpus_t            reader_cpus_;      /// a CPU per reader, empty if any
+    cpus_t            processor_cpus_;   /// a CPU per processor
+    cpus_t            service_cpus_;     /// journal, snapshot and stats
+    boost::shared_ptr<session_table_t>
+                      sessions_;         /// conn infos by session handle
+    traders_t         traders_;          /// trader ids logged in
+    boost::mutex      mutex_;            /// guards traders_, readers only
   };
 
 }  /// namespace trading
@@ -0,0 +1,352 @@
+#ifndef __SYMBOL_DIRECTORY_HPP__
+#define __SYMBOL_DIRECTORY_HPP__
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <string.h>
+#include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/shared_array.hpp>
+
+namespace trading {
+
+  //############################################################################
+  /// CLASS: Symbol Directory
+  ///
+  /// Maps the 8 byte stock field of a transmission order onto a dense
+  /// symbol id in [0, capacity). Ids are handed out in insertion order so
+  /// order books can live in a flat array indexed by symbol id.
+  ///
+  /// The stock field is packed into a 64 bit key (zero padded after the
+  /// terminating NUL) and looked up in a fixed size open addressing table
+  /// with linear probing, so a lookup is one multiply and usually a single
+  /// 8 byte compare. The table never rehashes: find() takes no lock and is
+  /// safe against a concurrent intern(), which publishes the slot key only
+  /// after its id and name are written.
+  ///
+  /// The directory is either loaded from a configured universe and then
+  /// frozen (unknown stocks are rejected) or left open, in which case new
+  /// stocks are interned on first sight until the capacity is exhausted.
+  //############################################################################
+  class symbol_directory_t {
+  public:
+
+    typedef boost::uint32_t id_t;
+
+    /// returned for unknown or rejected stocks
+    enum { npos = 0xffffffff };
+
+    /// size of the stock field on the wire
+    enum { stock_size = 8 };
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// Allocates a table for up to capacity symbols, sized to the next power
+    /// of two of twice the capacity to keep probe sequences short.
+    ///
+    /// @param[in]  capacity  maximum number of symbols
+    /// @return               none
+    /// @throws               none
+    //##########################################################################
+    explicit symbol_directory_t(size_t capacity = 4096);
+
+    //##########################################################################
+    /// Load
+    ///
+    /// Interns every stock in the universe file (one per line, blank lines
+    /// and lines starting with '#' are ignored) and freezes the directory.
+    ///
+    /// @param[in]  path  universe file
+    /// @return           none
+    /// @throws           std::string if the file can't be read or a stock
+    ///                   is invalid or exceeds the capacity
+    //##########################################################################
+    void load(const std::string& path);
+
+    //##########################################################################
+    /// Find
+    ///
+    /// Lock free lookup of a stock field.
+    ///
+    /// @param[in]  stock  stock field, NUL terminated within stock_size bytes
+    /// @return            symbol id or npos if unknown
+    /// @throws            none
+    //##########################################################################
+    id_t find(const char* stock) const;
+
+    //##########################################################################
+    /// Intern
+    ///
+    /// Finds the stock, inserting it if it is unknown and the directory is
+    /// not frozen. Inserts are serialized on a mutex; lookups of known
+    /// stocks take the lock free path.
+    ///
+    /// @param[in]  stock  stock field, NUL terminated within stock_size bytes
+    /// @return            symbol id or npos if rejected
+    /// @throws            none
+    //##########################################################################
+    id_t intern(const char* stock);
+
+    //##########################################################################
+    /// Restore
+    ///
+    /// Interns a stock under the id it had before a restart (from a
+    /// snapshot or the journal), so books and journaled messages keep
+    /// their symbol ids. Ids need not be contiguous; ids skipped over are
+    /// never handed out. A frozen directory only checks the id.
+    ///
+    /// @param[in]  stock  stock field, NUL terminated within stock_size bytes
+    /// @param[in]  id     symbol id to restore
+    /// @return            false if the stock or id conflicts with the
+    ///                    directory or is out of range
+    /// @throws            none
+    //##########################################################################
+    bool restore(const char* stock, id_t id);
+
+    //##########################################################################
+    /// Name Accessor
+    ///
+    /// @param[in]  id  symbol id
+    /// @return         NUL terminated stock name
+    /// @throws         none
+    //##########################################################################
+    const char* name(id_t id) const { return names_[id].name_; }
+
+    //##########################################################################
+    /// Size Accessor
+    ///
+    /// @param   none
+    /// @return  one past the highest symbol id (the number of interned
+    ///          symbols unless ids were skipped by restore())
+    /// @throws  none
+    //##########################################################################
+    size_t size() const { return size_.load(boost::memory_order_acquire); }
+
+    //##########################################################################
+    /// Capacity Accessor
+    ///
+    /// @param   none
+    /// @return  maximum number of symbols
+    /// @throws  none
+    //##########################################################################
+    size_t capacity() const { return capacity_; }
+
+    //##########################################################################
+    /// Freeze Mutator
+    ///
+    /// After freezing only already interned stocks are accepted.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    void freeze() { frozen_ = true; }
+
+  private:
+
+    //##########################################################################
+    /// Key
+    ///
+    /// Packs the stock field into a 64 bit key.
+    ///
+    /// @param[in]  stock  stock field
+    /// @return            key, or 0 if the stock is empty or not NUL
+    ///                    terminated within stock_size bytes
+    /// @throws            none
+    //##########################################################################
+    static boost::uint64_t key(const char* stock);
+
+    //##########################################################################
+    /// Slot
+    ///
+    /// @param[in]  key  packed stock
+    /// @return          home slot of the key (fibonacci hashing)
+    /// @throws          none
+    //##########################################################################
+    size_t slot(boost::uint64_t key) const {
+      return static_cast<size_t>(
+        (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits_));
+    }
+
+    //##########################################################################
+    /// STRUCT: Slot
+    //##########################################################################
+    struct slot_t {
+      boost::atomic<boost::uint64_t>  key_;  /// 0 while empty
+      id_t                            id_;   /// valid once key_ is set
+    };
+
+    //##########################################################################
+    /// STRUCT: Name
+    //##########################################################################
+    struct name_t {
+      char name_[stock_size];
+    };
+
+    size_t                        capacity_;  /// maximum number of symbols
+    size_t                        bits_;      /// log2 of the table size
+    size_t                        mask_;      /// table size - 1
+    boost::shared_array<slot_t>   slots_;     /// open addressing table
+    std::vector<name_t>           names_;     /// stock name by symbol id
+    boost::atomic<size_t>         size_;      /// number of symbols
+    bool                          frozen_;    /// reject unknown stocks
+    boost::mutex                  mutex_;     /// serializes inserts
+  };
+
+  //############################################################################
+  /// Constructor
+  //############################################################################
+  inline symbol_directory_t::symbol_directory_t(size_t capacity) :
+    capacity_(capacity),
+    bits_(1),
+    names_(capacity),
+    size_(0),
+    frozen_(false) {
+
+    while ((size_t(1) << bits_) < capacity * 2)
+      ++bits_;
+    mask_ = (size_t(1) << bits_) - 1;
+    slots_.reset(new slot_t[mask_ + 1]);
+    for (size_t i = 0; i <= mask_; ++i) {
+      slots_[i].key_.store(0, boost::memory_order_relaxed);
+      slots_[i].id_ = npos;
+    }
+  }
+
+  //############################################################################
+  /// Load
+  //############################################################################
+  inline void symbol_directory_t::load(const std::string& path) {
+
+    std::ifstream ifs(path.c_str());
+    if (! ifs) {
+      throw "Failed to open symbol universe: " + path;
+    }
+    std::string line;
+    while (std::getline(ifs, line)) {
+
+      /// trim whitespace and skip blanks and comments
+      size_t b = line.find_first_not_of(" \t\r");
+      if (b == std::string::npos || line[b] == '#')
+        continue;
+      size_t e = line.find_last_not_of(" \t\r");
+      std::string stock = line.substr(b, e - b + 1);
+
+      if (intern(stock.c_str()) == npos) {
+        throw "Invalid stock or symbol capacity exceeded: " + stock;
+      }
+    }
+    freeze();
+  }
+
+  //############################################################################
+  /// Key
+  //############################################################################
+  inline boost::uint64_t symbol_directory_t::key(const char* stock) {
+
+    size_t n = ::strnlen(stock, stock_size);
+    if (n == 0 || n == stock_size)
+      return 0;
+
+    boost::uint64_t k = 0;
+    ::memcpy(&k, stock, n);
+    return k;
+  }
+
+  //############################################################################
+  /// Find
+  //############################################################################
+  inline symbol_directory_t::id_t
+  symbol_directory_t::find(const char* stock) const {
+
+    boost::uint64_t k = key(stock);
+    if (k == 0)
+      return npos;
+
+    for (size_t i = slot(k); ; i = (i + 1) & mask_) {
+      boost::uint64_t sk = slots_[i].key_.load(boost::memory_order_acquire);
+      if (sk == k)
+        return slots_[i].id_;
+      if (sk == 0)
+        return npos;
+    }
+  }
+
+  //############################################################################
+  /// Intern
+  //############################################################################
+  inline symbol_directory_t::id_t
+  symbol_directory_t::intern(const char* stock) {
+
+    id_t id = find(stock);
+    if (id != npos || frozen_)
+      return id;
+
+    boost::uint64_t k = key(stock);
+    if (k == 0)
+      return npos;
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    /// another thread may have inserted it before we got the lock
+    size_t i = slot(k);
+    for (; ; i = (i + 1) & mask_) {
+      boost::uint64_t sk = slots_[i].key_.load(boost::memory_order_relaxed);
+      if (sk == k)
+        return slots_[i].id_;
+      if (sk == 0)
+        break;
+    }
+    size_t n = size_.load(boost::memory_order_relaxed);
+    if (n == capacity_)
+      return npos;
+
+    /// write id and name before publishing the key to lock free readers
+    id = static_cast<id_t>(n);
+    ::memcpy(names_[id].name_, &k, stock_size);
+    slots_[i].id_ = id;
+    slots_[i].key_.store(k, boost::memory_order_release);
+    size_.store(n + 1, boost::memory_order_release);
+    return id;
+  }
+
+  //############################################################################
+  /// Restore
+  //############################################################################
+  inline bool symbol_directory_t::restore(const char* stock, id_t id) {
+
+    id_t found = find(stock);
+    if (found != npos || frozen_)
+      return found == id;
+
+    boost::uint64_t k = key(stock);
+    if (k == 0 || id >= capacity_)
+      return false;
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    /// the id must not be in use by another stock
+    size_t n = size_.load(boost::memory_order_relaxed);
+    if (id < n && names_[id].name_[0] != '\0')
+      return false;
+
+    size_t i = slot(k);
+    while (slots_[i].key_.load(boost::memory_order_relaxed) != 0)
+      i = (i + 1) & mask_;
+
+    ::memcpy(names_[id].name_, &k, stock_size);
+    slots_[i].id_ = id;
+    slots_[i].key_.store(k, boost::memory_order_release);
+    if (id >= n) {
+      size_.store(id + 1, boost::memory_order_release);
+    }
+    return true;
+  }
+
+}  /// namespace trading
+
+#endif
@@ -2,23 +2,44 @@
 #define __THREADPOOL_HPP__
 
 #include <stdio.h>
+#include <deque>
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
-#include <boost/asio/io_service.hpp>
 
 namespace concurrent {
 
   //############################################################################
   /// CLASS Thread Pool
+  ///
+  /// Work stealing executor. Each thread owns a deque of tasks: a task
+  /// posted from a pool thread goes on the back of that thread's deque and
+  /// is the next it runs (LIFO, while its data is still in cache), a task
+  /// posted from outside the pool goes on the back of the threads' deques
+  /// in turn. A thread with nothing of its own left steals from the front
+  /// of the others' deques (FIFO, the oldest and usually largest work), so
+  /// posters and threads only ever contend on one deque at a time, never on
+  /// a queue shared by the whole pool.
+  ///
+  /// Threads with nothing to run or steal sleep. A poster counts the task
+  /// queued before looking for sleepers, a thread counts itself asleep
+  /// before its last look for tasks, so a post wakes one sleeper, and
+  /// notifies nobody while every thread is busy.
+  ///
+  /// Long running loops posted to the pool keep their thread; tasks left on
+  /// its deque are stolen by the others.
   //############################################################################
   class thread_pool_t {
   public:
 
-    typedef boost::thread_group            thread_group_t;
-    typedef boost::asio::io_service        io_service_t;
-    typedef boost::asio::io_service::work  work_t;
-    typedef boost::shared_ptr<work_t>      work_ptr;
+    typedef boost::thread_group      thread_group_t;
+    typedef boost::function<void()>  task_t;
+
+    /// most threads a pool grows to
+    enum { max_threads = 1024 };
 
     //##########################################################################
     /// Singleton Accessor
@@ -40,19 +61,31 @@ namespace concurrent {
     /// @throws         none
     //##########################################################################
     thread_pool_t() :
-      size_(0)
-    { work_ = boost::make_shared<work_t>(boost::ref(iosvc_)); }
+      size_(0),
+      workers_(new worker_ptr[max_threads]),
+      nworkers_(0),
+      next_(0),
+      pending_(0),
+      sleeping_(0),
+      stop_(false)
+    {}
 
     //##########################################################################
     /// Expand
     ///
-    /// Can be used to expand the thread pool based on the input size.
+    /// Can be used to expand the thread pool based on the input size. Tasks
+    /// posted while the pool had no thread go to the first one.
     ///
     /// @param[in]  sz  number of threads to be added
     /// @return         none
     /// @throws         std::string on failure
     //##########################################################################
     void expand(size_t size) {
+
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (size_ + size > max_threads) {
+        throw std::string("Thread pool too large");
+      }
       size_ += size;
       create_threads(size);
     }
@@ -71,18 +104,20 @@ namespace concurrent {
     //##########################################################################
     /// Stop
     ///
-    /// -# Reset work ptr.
-    /// -# Stop iosvc
+    /// -# Tell the threads to stop, dropping the tasks still queued.
+    /// -# Wake the sleeping threads.
     /// -# Interrupt all threads.
-    /// -# Join on thread pool?
     ///
     /// @param   none
     /// @return  none
     /// @throws  none
     //##########################################################################
     void stop() {
-      work_.reset();
-      iosvc_.stop();
+      stop_.store(true);
+      {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        idle_.notify_all();
+      }
       threads_.interrupt_all();
     }
 
@@ -95,39 +130,176 @@ namespace concurrent {
     //##########################################################################
     template <typename T>
     void post(T t) {
-      iosvc_.post(t);
+      push(task_t(t));
     }
 
     //##########################################################################
-    /// Iosvc Accessor
+    /// Thread Pool Size
     ///
     /// @param   none
-    /// @return  ref to iosvc_
+    /// @return  number of threads in the pool
     /// @throws  none
     //##########################################################################
-    boost::asio::io_service& iosvc() {
-      return iosvc_;
+    size_t size() const {
+      return threads_.size();
     }
 
+    typedef boost::shared_ptr<thread_pool_t> ptr;
+
+  private:
+
     //##########################################################################
-    /// Thread Pool Size
+    /// STRUCT: Worker
+    ///
+    /// A pool thread's deque; the owner works at the back, thieves at the
+    /// front.
+    //##########################################################################
+    struct worker_t {
+      explicit worker_t(size_t index) : index_(index) {}
+
+      size_t              index_;   /// in workers_
+      boost::mutex        mutex_;   /// guards tasks_
+      std::deque<task_t>  tasks_;
+    };
+    typedef boost::shared_ptr<worker_t> worker_ptr;
+
+    //##########################################################################
+    /// Current
     ///
     /// @param   none
-    /// @return  number of threads in the pool
+    /// @return  worker of the calling thread, NULL outside any pool
     /// @throws  none
     //##########################################################################
-    size_t size() const {
-      return threads_.size();
+    static worker_t*& current() {
+      static __thread worker_t* worker = NULL;
+      return worker;
     }
 
-    typedef boost::shared_ptr<thread_pool_t> ptr;
+    //##########################################################################
+    /// Owns
+    ///
+    /// @param[in]  worker  a worker, or NULL
+    /// @return             true if worker is one of this pool's
+    /// @throws             none
+    //##########################################################################
+    bool owns(const worker_t* worker) const {
+      return worker && worker->index_ < nworkers_.load() &&
+        workers_[worker->index_].get() == worker;
+    }
 
-  private:
+    //##########################################################################
+    /// Push
+    ///
+    /// Queues a task on the calling thread's deque, or the next thread's
+    /// if the caller is no thread of this pool, then wakes a sleeper.
+    ///
+    /// @param[in]  task  task to queue
+    /// @return           none
+    /// @throws           none
+    //##########################################################################
+    void push(const task_t& task) {
+
+      worker_t* worker = current();
+      if (! owns(worker)) {
+        size_t n = nworkers_.load();
+        if (n == 0) {
+          boost::lock_guard<boost::mutex> lock(mutex_);
+          if (nworkers_.load() == 0) {
+            backlog_.push_back(task);
+            pending_.fetch_add(1);
+            return;
+          }
+          n = nworkers_.load();
+        }
+        worker = workers_[next_.fetch_add(1) % n].get();
+      }
+      {
+        boost::lock_guard<boost::mutex> lock(worker->mutex_);
+        worker->tasks_.push_back(task);
+      }
+      ////////
+      /// the task counted, then the sleepers; a thread falling asleep
+      /// counts itself, then looks at the tasks, so one sees the other
+      ////////
+      pending_.fetch_add(1);
+      if (sleeping_.load()) {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        idle_.notify_one();
+      }
+    }
+
+    //##########################################################################
+    /// Take
+    ///
+    /// Takes the newest task of the thread's own deque, or else steals the
+    /// oldest task of another thread's.
+    ///
+    /// @param[in]   worker  calling thread's worker
+    /// @param[out]  task    task taken
+    /// @return              false if no task was found
+    /// @throws              none
+    //##########################################################################
+    bool take(worker_t& worker, task_t& task) {
+
+      {
+        boost::lock_guard<boost::mutex> lock(worker.mutex_);
+        if (! worker.tasks_.empty()) {
+          task.swap(worker.tasks_.back());
+          worker.tasks_.pop_back();
+          pending_.fetch_sub(1);
+          return true;
+        }
+      }
+      /// skip a victim busy with its own deque, the next one may do
+      size_t n = nworkers_.load();
+      for (size_t i = 1; i < n; ++i) {
+        worker_t& victim = *workers_[(worker.index_ + i) % n];
+        boost::unique_lock<boost::mutex> lock(victim.mutex_,
+                                              boost::try_to_lock);
+        if (lock.owns_lock() && ! victim.tasks_.empty()) {
+          task.swap(victim.tasks_.front());
+          victim.tasks_.pop_front();
+          pending_.fetch_sub(1);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    //##########################################################################
+    /// Run
+    ///
+    /// Thread function: runs tasks until the pool stops, sleeping while
+    /// there are none.
+    ///
+    /// @param[in]  worker  the thread's worker
+    /// @return             none
+    /// @throws             whatever a task throws
+    //##########################################################################
+    void run(worker_t* worker) {
+
+      current() = worker;
+      task_t task;
+      while (! stop_.load()) {
+        if (take(*worker, task)) {
+          task();
+          task.clear();
+          continue;
+        }
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        sleeping_.fetch_add(1);
+        if (pending_.load() == 0 && ! stop_.load()) {
+          idle_.wait(lock);
+        }
+        sleeping_.fetch_sub(1);
+      }
+    }
 
     //##########################################################################
     /// Create Threads
     ///
-    /// Creates input size number of threads into the boost thread group.
+    /// Creates input size number of threads into the boost thread group,
+    /// each with a worker of its own; the mutex is held.
     ///
     /// @param[in]  size  number of threads to be created
     /// @return           none
@@ -137,10 +309,17 @@ namespace concurrent {
 
       for (int i = 0; i < size; ++i) {
 
+        size_t index = nworkers_.load();
+        worker_ptr worker = boost::make_shared<worker_t>(index);
+        if (index == 0) {
+          worker->tasks_.swap(backlog_);
+        }
+        workers_[index] = worker;
+        nworkers_.store(index + 1);
+
         boost::thread* t =
           threads_.create_thread(
-            boost::bind(&boost::asio::io_service::run,
-                        boost::ref(iosvc_)));
+            boost::bind(&thread_pool_t::run, this, worker.get()));
         if (! t) {
           char buf[256] = {0};
           ::snprintf(buf, sizeof(buf-1), "Thread pool create failed at: %d", i);
@@ -148,11 +327,18 @@ namespace concurrent {
         }
       }
     }
-  
-    size_t          size_;
-    work_ptr        work_;
-    io_service_t    iosvc_;
-    thread_group_t  threads_;
+
+    size_t                          size_;
+    boost::scoped_array<worker_ptr> workers_;   /// first nworkers_ in use
+    boost::atomic<size_t>           nworkers_;
+    boost::atomic<size_t>           next_;      /// next worker posted to
+    boost::atomic<size_t>           pending_;   /// tasks queued, not taken
+    boost::atomic<size_t>           sleeping_;  /// threads asleep in run()
+    boost::atomic<bool>             stop_;
+    boost::mutex                    mutex_;     /// guards growth, sleeping
+    boost::condition_variable       idle_;      /// tasks for sleepers
+    std::deque<task_t>              backlog_;   /// posted before any thread
+    thread_group_t                  threads_;
 
   };  /// class thread_pool_t
 
@@ -0,0 +1,164 @@
+#ifndef __TOPOLOGY_HPP__
+#define __TOPOLOGY_HPP__
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace trading {
+
+  //############################################################################
+  /// CPU Topology
+  ///
+  /// CPU sets for pinning the server's threads, given as lists in the form
+  /// taskset takes, e.g. "2-5,8". A thread pinned before it allocates its
+  /// data gets it on its own NUMA node: Linux places a page on the node of
+  /// the CPU that first touches it.
+  //############################################################################
+
+  typedef std::vector<int> cpus_t;
+
+  //############################################################################
+  /// Parse CPUs
+  ///
+  /// @param[in]  list  comma separated CPU numbers and ranges, may be empty
+  /// @return           CPUs in the order listed
+  /// @throws           std::string if the list is malformed, or names a CPU
+  ///                   outside a cpu_set_t
+  //############################################################################
+  inline cpus_t parse_cpus(const std::string& list) {
+
+    cpus_t cpus;
+    const char* p = list.c_str();
+    while (*p) {
+      char* end;
+      long first = ::strtol(p, &end, 10);
+      long last = first;
+      if (end != p && *end == '-') {
+        p = end + 1;
+        last = ::strtol(p, &end, 10);
+      }
+      if (end == p || (*end && *end != ',') ||
+          first < 0 || last < first || last >= CPU_SETSIZE) {
+        throw std::string("Invalid cpu list: ") + list;
+      }
+      for (long cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+      p = *end ? end + 1 : end;
+    }
+    return cpus;
+  }
+
+  //############################################################################
+  /// Format CPUs
+  ///
+  /// @param[in]  cpus  CPUs
+  /// @return           CPUs as a list, ranges collapsed; "any" if empty
+  /// @throws           none
+  //############################################################################
+  inline std::string format_cpus(const cpus_t& cpus) {
+
+    if (cpus.empty())
+      return "any";
+    std::ostringstream os;
+    for (size_t i = 0; i < cpus.size(); ) {
+      size_t j = i;
+      while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+        ++j;
+      os << (i ? "," : "") << cpus[i];
+      if (j > i)
+        os << "-" << cpus[j];
+      i = j + 1;
+    }
+    return os.str();
+  }
+
+  //############################################################################
+  /// Nth CPU
+  ///
+  /// @param[in]  cpus   CPUs of a role
+  /// @param[in]  index  index of a thread of the role
+  /// @return            the CPU of the thread, the role's CPUs taken in
+  ///                    turn; empty if the role is not pinned
+  /// @throws            none
+  //############################################################################
+  inline cpus_t nth_cpu(const cpus_t& cpus, size_t index) {
+    return cpus.empty() ? cpus : cpus_t(1, cpus[index % cpus.size()]);
+  }
+
+  //############################################################################
+  /// Check CPUs
+  ///
+  /// @param[in]  cpus  CPUs
+  /// @return           none
+  /// @throws           std::string if a CPU is outside the process's
+  ///                   affinity mask, e.g. offline or taken by a cpuset
+  //############################################################################
+  inline void check_cpus(const cpus_t& cpus) {
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+      throw std::string("CPU affinity query failed: ") + ::strerror(errno);
+    }
+    for (size_t i = 0; i < cpus.size(); ++i) {
+      if (! CPU_ISSET(cpus[i], &allowed)) {
+        std::ostringstream os;
+        os << "CPU " << cpus[i] << " is not available to the process";
+        throw os.str();
+      }
+    }
+  }
+
+  //############################################################################
+  /// Pin Thread
+  ///
+  /// Restricts the calling thread to the CPUs.
+  ///
+  /// @param[in]  cpus  CPUs, empty leaves the thread as it is
+  /// @return           false if the affinity could not be set
+  /// @throws           none
+  //############################################################################
+  inline bool pin_thread(const cpus_t& cpus) {
+
+    if (cpus.empty())
+      return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i) {
+      CPU_SET(cpus[i], &set);
+    }
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+  }
+
+  //############################################################################
+  /// Placement
+  ///
+  /// @param   none
+  /// @return  CPU and NUMA node the calling thread runs on, e.g.
+  ///          "cpu 3 node 0"
+  /// @throws  none
+  //############################################################################
+  inline std::string placement() {
+
+    unsigned cpu = 0;
+    unsigned node = 0;
+    std::ostringstream os;
+    if (::syscall(SYS_getcpu, &cpu, &node, NULL) == -1)
+      os << "cpu ? node ?";
+    else
+      os << "cpu " << cpu << " node " << node;
+    return os.str();
+  }
+
+}  /// namespace trading
+
+#endif
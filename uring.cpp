@@ -0,0 +1,259 @@
+#include <uring.hpp>
+
+#ifdef TRADING_HAVE_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+
+namespace trading {
+
+  ////////
+  /// the kernel shares the ring heads and tails with us: loads of what it
+  /// writes acquire, stores of what we write release
+  ////////
+  static unsigned load_acquire(const unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+  }
+
+  static void store_release(unsigned* p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+  }
+
+  static void* map(int fd, size_t size, off_t offset) {
+    void* p = ::mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (p == MAP_FAILED) {
+      throw std::string("Failed to map io_uring: ") + ::strerror(errno);
+    }
+    return p;
+  }
+
+  //###########################################################################
+  /// Constructor (uring_t)
+  //###########################################################################
+  uring_t::
+  uring_t(unsigned entries,
+          unsigned nbuffers,
+          unsigned buffer_size,
+          unsigned short buffer_group) :
+    fd_(-1),
+    sq_ring_(NULL),
+    sq_ring_size_(0),
+    cq_ring_(NULL),
+    cq_ring_size_(0),
+    sqes_(NULL),
+    sqes_size_(0),
+    sq_pending_(0),
+    buf_ring_(NULL),
+    buf_ring_size_(0),
+    buf_mask_(nbuffers - 1),
+    buffer_size_(buffer_size),
+    buffer_group_(buffer_group) {
+
+    struct io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;  /// multishot ops complete many times
+    fd_ = ::syscall(__NR_io_uring_setup, entries, &params);
+    if (fd_ == -1) {
+      throw std::string("io_uring_setup failed: ") + ::strerror(errno);
+    }
+    try {
+      sq_ring_size_ =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      size_t cq_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+      if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = std::max(sq_ring_size_, cq_size);
+      }
+      sq_ring_ = map(fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+      if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+      }
+      else {
+        cq_ring_size_ = cq_size;
+        cq_ring_ = map(fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+      }
+      sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+      sqes_ = static_cast<struct io_uring_sqe*>(
+        map(fd_, sqes_size_, IORING_OFF_SQES));
+
+      char* sq = static_cast<char*>(sq_ring_);
+      sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+      sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      sq_entries_ = params.sq_entries;
+      char* cq = static_cast<char*>(cq_ring_);
+      cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+      ////////
+      /// provided buffer ring: the kernel takes buffers from its head as
+      /// receives complete, recycle() adds them back at the tail
+      ////////
+      buf_ring_size_ = nbuffers * sizeof(struct io_uring_buf);
+      void* p = ::mmap(NULL, buf_ring_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+      if (p == MAP_FAILED) {
+        throw std::string("Failed to map buffer ring: ") + ::strerror(errno);
+      }
+      buf_ring_ = static_cast<struct io_uring_buf_ring*>(p);
+      struct io_uring_buf_reg reg;
+      ::memset(&reg, 0, sizeof(reg));
+      reg.ring_addr = reinterpret_cast<unsigned long>(buf_ring_);
+      reg.ring_entries = nbuffers;
+      reg.bgid = buffer_group_;
+      if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING,
+                    &reg, 1) == -1) {
+        throw std::string("Failed to register buffer ring: ") +
+          ::strerror(errno);
+      }
+      buffers_.resize(static_cast<size_t>(nbuffers) * buffer_size_);
+      for (unsigned id = 0; id < nbuffers; ++id) {
+        recycle(id);
+      }
+    }
+    catch (const std::string&) {
+      release();
+      throw;
+    }
+  }
+
+  //###########################################################################
+  /// Destructor (uring_t)
+  //###########################################################################
+  uring_t::
+  ~uring_t() {
+    release();
+  }
+
+  //###########################################################################
+  /// Release (uring_t)
+  //###########################################################################
+  void
+  uring_t::
+  release() {
+    if (buf_ring_) {
+      ::munmap(buf_ring_, buf_ring_size_);
+      buf_ring_ = NULL;
+    }
+    if (sqes_) {
+      ::munmap(sqes_, sqes_size_);
+      sqes_ = NULL;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = NULL;
+    if (sq_ring_) {
+      ::munmap(sq_ring_, sq_ring_size_);
+      sq_ring_ = NULL;
+    }
+    if (fd_ != -1) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  //###########################################################################
+  /// Get Submission Queue Entry (uring_t)
+  //###########################################################################
+  struct io_uring_sqe*
+  uring_t::
+  sqe() {
+
+    unsigned tail = *sq_tail_;
+    if (tail - load_acquire(sq_head_) == sq_entries_) {
+      submit();
+      if (tail - load_acquire(sq_head_) == sq_entries_) {
+        throw std::string("io_uring submission queue full");
+      }
+    }
+    unsigned index = tail & sq_mask_;
+    struct io_uring_sqe* entry = &sqes_[index];
+    ::memset(entry, 0, sizeof(*entry));
+    sq_array_[index] = index;
+    store_release(sq_tail_, tail + 1);
+    ++sq_pending_;
+    return entry;
+  }
+
+  //###########################################################################
+  /// Submit (uring_t)
+  //###########################################################################
+  void
+  uring_t::
+  submit(unsigned wait) {
+
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    while (sq_pending_ || wait) {
+      long n = ::syscall(__NR_io_uring_enter, fd_, sq_pending_, wait, flags,
+                         NULL, 0);
+      if (n == -1) {
+        if (errno == EINTR)
+          continue;
+        /// completion queue full: the caller reaps, then submits again
+        if (errno == EBUSY || errno == EAGAIN)
+          return;
+        throw std::string("io_uring_enter failed: ") + ::strerror(errno);
+      }
+      sq_pending_ -= n;
+      wait = 0;
+      flags = 0;
+    }
+  }
+
+  //###########################################################################
+  /// Peek (uring_t)
+  //###########################################################################
+  const struct io_uring_cqe*
+  uring_t::
+  peek() {
+
+    unsigned head = *cq_head_;
+    if (head == load_acquire(cq_tail_))
+      return NULL;
+    return &cqes_[head & cq_mask_];
+  }
+
+  //###########################################################################
+  /// Seen (uring_t)
+  //###########################################################################
+  void
+  uring_t::
+  seen() {
+    store_release(cq_head_, *cq_head_ + 1);
+  }
+
+  //###########################################################################
+  /// Recycle (uring_t)
+  //###########################################################################
+  void
+  uring_t::
+  recycle(unsigned id) {
+
+    ////////
+    /// the tail overlays the reserved field of the first entry, so the
+    /// entry is written field by field; the ring is indexed as a plain
+    /// array, bufs is misplaced when the uapi header is compiled as C++
+    ////////
+    unsigned short tail = buf_ring_->tail;
+    struct io_uring_buf* buf =
+      reinterpret_cast<struct io_uring_buf*>(buf_ring_) + (tail & buf_mask_);
+    buf->addr = reinterpret_cast<unsigned long>(buffer(id));
+    buf->len = buffer_size_;
+    buf->bid = id;
+    __atomic_store_n(&buf_ring_->tail, static_cast<unsigned short>(tail + 1),
+                     __ATOMIC_RELEASE);
+  }
+
+}  /// namespace trading
+
+#endif  /// TRADING_HAVE_IO_URING
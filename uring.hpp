@@ -0,0 +1,182 @@
+#ifndef __URING_HPP__
+#define __URING_HPP__
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+////////
+/// io_uring is used through its system calls and the kernel's uapi header,
+/// without liburing; TRADING_HAVE_IO_URING is defined when the header has
+/// everything the server needs (multishot accept and recv, provided buffer
+/// rings). The kernel may still lack support at run time, see uring_t.
+////////
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#      define TRADING_HAVE_IO_URING 1
+#    endif
+#  endif
+#endif
+
+#ifdef TRADING_HAVE_IO_URING
+
+namespace trading {
+
+  //############################################################################
+  /// CLASS: Uring
+  ///
+  /// Minimal io_uring instance for one thread: a submission queue, a
+  /// completion queue and one ring of provided buffers that multishot
+  /// receives pick their buffers from.
+  ///
+  /// Submission queue entries are filled in place and submitted together
+  /// by submit(), one system call for any number of operations, which
+  /// also waits for completions.
+  //############################################################################
+  class uring_t {
+  public:
+
+    //##########################################################################
+    /// Constructor
+    ///
+    /// Sets up the rings and registers the provided buffers.
+    ///
+    /// @param[in]  entries       submission queue entries, power of two
+    /// @param[in]  nbuffers      provided buffers, power of two
+    /// @param[in]  buffer_size   bytes per provided buffer
+    /// @param[in]  buffer_group  group id of the provided buffers
+    /// @return                   none
+    /// @throws                   std::string if the kernel lacks support
+    //##########################################################################
+    uring_t(unsigned entries,
+            unsigned nbuffers,
+            unsigned buffer_size,
+            unsigned short buffer_group = 0);
+
+    //##########################################################################
+    /// Destructor
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    ~uring_t();
+
+    //##########################################################################
+    /// Get Submission Queue Entry
+    ///
+    /// Submits what is queued first if the submission queue is full.
+    ///
+    /// @param   none
+    /// @return  zeroed entry to fill, submitted by the next submit()
+    /// @throws  std::string if submitting fails
+    //##########################################################################
+    struct io_uring_sqe* sqe();
+
+    //##########################################################################
+    /// Submit
+    ///
+    /// @param[in]  wait  completions to wait for, 0 to only submit
+    /// @return           none
+    /// @throws           std::string on failure
+    //##########################################################################
+    void submit(unsigned wait = 0);
+
+    //##########################################################################
+    /// Peek
+    ///
+    /// @param   none
+    /// @return  oldest completion not yet seen, NULL if none
+    /// @throws  none
+    //##########################################################################
+    const struct io_uring_cqe* peek();
+
+    //##########################################################################
+    /// Seen
+    ///
+    /// Hands the completion returned by peek() back to the kernel.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    void seen();
+
+    //##########################################################################
+    /// Buffer Accessor
+    ///
+    /// @param[in]  id  provided buffer id, from a completion's flags
+    /// @return         the buffer
+    /// @throws         none
+    //##########################################################################
+    char* buffer(unsigned id) { return &buffers_[id * buffer_size_]; }
+
+    //##########################################################################
+    /// Recycle
+    ///
+    /// Gives a provided buffer back to the kernel once consumed.
+    ///
+    /// @param[in]  id  provided buffer id
+    /// @return         none
+    /// @throws         none
+    //##########################################################################
+    void recycle(unsigned id);
+
+    //##########################################################################
+    /// Buffer Group Accessor
+    ///
+    /// @param   none
+    /// @return  group id of the provided buffers
+    /// @throws  none
+    //##########################################################################
+    unsigned short buffer_group() const { return buffer_group_; }
+
+  private:
+
+    /// not copyable, owns the mappings
+    uring_t(const uring_t&);
+    uring_t& operator=(const uring_t&);
+
+    //##########################################################################
+    /// Release
+    ///
+    /// Unmaps what is mapped and closes the ring.
+    ///
+    /// @param   none
+    /// @return  none
+    /// @throws  none
+    //##########################################################################
+    void release();
+
+    int                        fd_;
+    void*                      sq_ring_;       /// submission ring mapping
+    size_t                     sq_ring_size_;
+    void*                      cq_ring_;       /// completion ring mapping
+    size_t                     cq_ring_size_;  /// 0 if shared with the sq's
+    struct io_uring_sqe*       sqes_;
+    size_t                     sqes_size_;
+    unsigned*                  sq_head_;
+    unsigned*                  sq_tail_;
+    unsigned*                  sq_array_;
+    unsigned                   sq_mask_;
+    unsigned                   sq_entries_;
+    unsigned                   sq_pending_;    /// filled, not submitted
+    unsigned*                  cq_head_;
+    unsigned*                  cq_tail_;
+    unsigned                   cq_mask_;
+    struct io_uring_cqe*       cqes_;
+    struct io_uring_buf_ring*  buf_ring_;      /// provided buffer ring
+    size_t                     buf_ring_size_;
+    unsigned                   buf_mask_;
+    unsigned                   buffer_size_;
+    unsigned short             buffer_group_;
+    std::vector<char>          buffers_;       /// provided buffer memory
+  };
+
+}  /// namespace trading
+
+#endif  /// TRADING_HAVE_IO_URING
+
+#endif
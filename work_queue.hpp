@@ -1,18 +1,37 @@
 #ifndef _WORK_QUEUE_HPP__
 #define _WORK_QUEUE_HPP__
 
-#include <queue>
+#include <vector>
 #include <iostream>
+#include <boost/circular_buffer.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/move/move.hpp>
 
 namespace concurrent {
 
   //############################################################################
   /// CLASS:  Queue
+  ///
+  /// Items are kept in a ring buffer that doubles its capacity when full, so
+  /// once the queue has grown to its working depth push and pop do no heap
+  /// allocation.
+  ///
+  /// A queue may be given a limit, which bounds what producers queue through
+  /// try_push() and push_wait(): the one refuses an item once the limit is
+  /// reached, the other waits for room. push() always queues, for the few
+  /// items that must not be refused. A consumer learns from pop_batch()
+  /// when a refused producer may try again: once the queue has drained to
+  /// half its limit.
+  ///
+  /// Items are moved in and out where T allows it (Boost.Move), and
+  /// push_batch(), push_batch_wait() and pop_batch() move many items under
+  /// one lock acquisition. Waiting consumers and producers are counted, so
+  /// a push or pop notifies nobody when nobody waits, and otherwise wakes
+  /// one waiter per item rather than all of them.
   //############################################################################
   template <typename T>
   class queue_t {
@@ -21,13 +40,14 @@ namespace concurrent {
     //##########################################################################
     /// Constructor
     ///
-    /// Constructs shared pointers to mutex and condition variable.
+    /// Constructs shared pointers to mutex and condition variables.
     ///
-    /// @param[in/out]  none
-    /// @return         none
-    /// @throws         none
+    /// @param[in]  capacity  initial capacity of the ring buffer
+    /// @param[in]  limit     items queued by bounded producers, 0 = unbounded
+    /// @return               none
+    /// @throws               none
     //##########################################################################
-    queue_t();
+    explicit queue_t(size_t capacity = 1024, size_t limit = 0);
 
     //##########################################################################
     /// Push
@@ -40,6 +60,64 @@ namespace concurrent {
     //##########################################################################
     void push(const T& t);
 
+    //##########################################################################
+    /// Push (move)
+    ///
+    /// @param[in]  t  item moved onto the back of the queue
+    /// @return        none
+    /// @throws        can throw exceptions from boost::thread api
+    //##########################################################################
+    void push(BOOST_RV_REF(T) t);
+
+    //##########################################################################
+    /// Push Batch
+    ///
+    /// Pushes every item onto the queue under a single lock acquisition;
+    /// like push(), never refuses.
+    ///
+    /// @param[inout]  items  moved onto the back of the queue in order, then
+    ///                       cleared
+    /// @return        none
+    /// @throws        can throw exceptions from boost::thread api
+    //##########################################################################
+    void push_batch(std::vector<T>& items);
+
+    //##########################################################################
+    /// Try Push
+    ///
+    /// Pushes item onto queue unless the queue holds limit items or more.
+    ///
+    /// @param[in]  t  item pushed onto the back of the queue
+    /// @return        false if the queue is full
+    /// @throws        can throw exceptions from boost::thread api
+    //##########################################################################
+    bool try_push(const T& t);
+
+    //##########################################################################
+    /// Push Wait
+    ///
+    /// Pushes item onto queue, first waiting for the queue to hold fewer
+    /// than limit items.
+    ///
+    /// @param[in]  t  item pushed onto the back of the queue
+    /// @return        none
+    /// @throws        can throw exceptions from boost::thread api
+    //##########################################################################
+    void push_wait(const T& t);
+
+    //##########################################################################
+    /// Push Batch Wait
+    ///
+    /// Pushes every item onto the queue, as many at a time as there is room
+    /// for below limit, waiting for room in between.
+    ///
+    /// @param[inout]  items  moved onto the back of the queue in order, then
+    ///                       cleared
+    /// @return        none
+    /// @throws        can throw exceptions from boost::thread api
+    //##########################################################################
+    void push_batch_wait(std::vector<T>& items);
+
     //##########################################################################
     /// Pop Front
     ///
@@ -63,20 +141,102 @@ namespace concurrent {
     //##########################################################################
     void pop_front(T& t);
 
+    //##########################################################################
+    /// Pop Batch
+    ///
+    /// Waits until the queue is not empty, then moves up to max items from
+    /// the front of the queue into items under a single lock acquisition.
+    ///
+    /// @param[inout]  items    cleared, then filled with the popped items
+    /// @param[in]     max      maximum number of items to pop
+    /// @param[out]    drained  if given, set when try_push() refused an item
+    ///                         since the last time it was set and the queue
+    ///                         has drained to half its limit, else cleared
+    /// @return        number of items popped
+    /// @throws        std::string on failure
+    //##########################################################################
+    size_t pop_batch(std::vector<T>& items, size_t max, bool* drained = NULL);
+
   private:
 
+    //##########################################################################
+    /// Wake
+    ///
+    /// Wakes as many waiters as items arrived or slots freed; the mutex is
+    /// held.
+    ///
+    /// @param[in]  cond     condition the waiters wait on
+    /// @param[in]  waiters  number of waiters
+    /// @param[in]  n        number of items or slots
+    /// @return              none
+    /// @throws              none
+    //##########################################################################
+    static void wake(boost::condition_variable& cond, size_t waiters, size_t n);
+
+    //##########################################################################
+    /// Grow
+    ///
+    /// Makes room for n more items; the mutex is held.
+    ///
+    /// @param[in]  n  number of items
+    /// @return        none
+    /// @throws        std::bad_alloc
+    //##########################################################################
+    void grow(size_t n);
+
     boost::shared_ptr<boost::mutex>              mutex_;
     boost::shared_ptr<boost::condition_variable> cond_;
-    std::queue<T> queue_;
+    boost::shared_ptr<boost::condition_variable> not_full_;
+    boost::circular_buffer<T> queue_;
+    size_t                    limit_;    /// 0 = unbounded
+    bool                      refused_;  /// try_push() refused an item
+    size_t                    waiting_;  /// producers waiting in push_wait()
+    size_t                    popping_;  /// consumers waiting on empty
   };
 
   //############################################################################
   /// Constructor
   //############################################################################
   template <typename T>
-  inline queue_t<T>::queue_t() :
+  inline queue_t<T>::queue_t(size_t capacity, size_t limit) :
     mutex_(boost::make_shared<boost::mutex>()),
-    cond_(boost::make_shared<boost::condition_variable>()) {
+    cond_(boost::make_shared<boost::condition_variable>()),
+    not_full_(boost::make_shared<boost::condition_variable>()),
+    queue_(capacity),
+    limit_(limit),
+    refused_(false),
+    waiting_(0),
+    popping_(0) {
+  }
+
+  //############################################################################
+  /// Wake
+  //############################################################################
+  template <typename T>
+  inline void queue_t<T>::wake(boost::condition_variable& cond,
+                               size_t waiters,
+                               size_t n) {
+    if (waiters == 0)
+      return;
+    if (n >= waiters) {
+      cond.notify_all();
+      return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      cond.notify_one();
+    }
+  }
+
+  //############################################################################
+  /// Grow
+  //############################################################################
+  template <typename T>
+  inline void queue_t<T>::grow(size_t n) {
+    size_t capacity = queue_.capacity() ? queue_.capacity() : 1;
+    while (capacity - queue_.size() < n)
+      capacity *= 2;
+    if (capacity != queue_.capacity())
+      queue_.set_capacity(capacity);
   }
 
   //############################################################################
@@ -88,8 +248,32 @@ namespace concurrent {
     try {
 
       boost::lock_guard<boost::mutex> lock(*mutex_);
-      queue_.push(t);
-      cond_->notify_all();
+      grow(1);
+      queue_.push_back(t);
+      wake(*cond_, popping_, 1);
+    }
+    catch (const std::exception& ex) {
+      std::cerr << "queue_t<T>::push caught: " << ex.what() << std::endl;
+      throw;
+    }
+    catch (...) {
+      std::cerr << "queue_t<T>::push caught unknown ex" << std::endl;
+      throw;
+    }
+  }
+
+  //############################################################################
+  /// Push (move)
+  //############################################################################
+  template <typename T>
+  inline void queue_t<T>::push(BOOST_RV_REF(T) t) {
+
+    try {
+
+      boost::lock_guard<boost::mutex> lock(*mutex_);
+      grow(1);
+      queue_.push_back(boost::move(t));
+      wake(*cond_, popping_, 1);
     }
     catch (const std::exception& ex) {
       std::cerr << "queue_t<T>::push caught: " << ex.what() << std::endl;
@@ -101,6 +285,133 @@ namespace concurrent {
     }
   }
 
+  //############################################################################
+  /// Push Batch
+  //############################################################################
+  template <typename T>
+  inline void queue_t<T>::push_batch(std::vector<T>& items) {
+
+    if (items.empty())
+      return;
+    try {
+
+      boost::lock_guard<boost::mutex> lock(*mutex_);
+      grow(items.size());
+      for (size_t i = 0; i < items.size(); ++i) {
+        queue_.push_back(boost::move(items[i]));
+      }
+      wake(*cond_, popping_, items.size());
+    }
+    catch (const std::exception& ex) {
+      std::cerr << "queue_t<T>::push_batch caught: " << ex.what()
+                << std::endl;
+      throw;
+    }
+    catch (...) {
+      std::cerr << "queue_t<T>::push_batch caught unknown ex" << std::endl;
+      throw;
+    }
+    items.clear();
+  }
+
+  //############################################################################
+  /// Try Push
+  //############################################################################
+  template <typename T>
+  inline bool queue_t<T>::try_push(const T& t) {
+
+    try {
+
+      boost::lock_guard<boost::mutex> lock(*mutex_);
+      if (limit_ && queue_.size() >= limit_) {
+        refused_ = true;
+        return false;
+      }
+      grow(1);
+      queue_.push_back(t);
+      wake(*cond_, popping_, 1);
+    }
+    catch (const std::exception& ex) {
+      std::cerr << "queue_t<T>::try_push caught: " << ex.what() << std::endl;
+      throw;
+    }
+    catch (...) {
+      std::cerr << "queue_t<T>::try_push caught unknown ex" << std::endl;
+      throw;
+    }
+    return true;
+  }
+
+  //############################################################################
+  /// Push Wait
+  //############################################################################
+  template <typename T>
+  inline void queue_t<T>::push_wait(const T& t) {
+
+    try {
+
+      boost::unique_lock<boost::mutex> lock(*mutex_);
+      while (limit_ && queue_.size() >= limit_) {
+        ++waiting_;
+        not_full_->wait(lock);
+        --waiting_;
+      }
+      grow(1);
+      queue_.push_back(t);
+      wake(*cond_, popping_, 1);
+    }
+    catch (const std::exception& ex) {
+      std::cerr << "queue_t<T>::push_wait caught: " << ex.what() << std::endl;
+      throw;
+    }
+    catch (...) {
+      std::cerr << "queue_t<T>::push_wait caught unknown ex" << std::endl;
+      throw;
+    }
+  }
+
+  //############################################################################
+  /// Push Batch Wait
+  //############################################################################
+  template <typename T>
+  inline void queue_t<T>::push_batch_wait(std::vector<T>& items) {
+
+    if (items.empty())
+      return;
+    try {
+
+      boost::unique_lock<boost::mutex> lock(*mutex_);
+      size_t pushed = 0;
+      while (pushed < items.size()) {
+        while (limit_ && queue_.size() >= limit_) {
+          ++waiting_;
+          not_full_->wait(lock);
+          --waiting_;
+        }
+        size_t n = items.size() - pushed;
+        if (limit_ && n > limit_ - queue_.size())
+          n = limit_ - queue_.size();
+        grow(n);
+        for (size_t i = pushed; i < pushed + n; ++i) {
+          queue_.push_back(boost::move(items[i]));
+        }
+        pushed += n;
+        wake(*cond_, popping_, n);
+      }
+    }
+    catch (const std::exception& ex) {
+      std::cerr << "queue_t<T>::push_batch_wait caught: " << ex.what()
+                << std::endl;
+      throw;
+    }
+    catch (...) {
+      std::cerr << "queue_t<T>::push_batch_wait caught unknown ex"
+                << std::endl;
+      throw;
+    }
+    items.clear();
+  }
+
   //############################################################################
   /// Pop Front
   //############################################################################
@@ -111,11 +422,14 @@ namespace concurrent {
 
       boost::unique_lock<boost::mutex> lock(*mutex_);
 
-      while (queue_.empty())
+      while (queue_.empty()) {
+        ++popping_;
         cond_->wait(lock);
-    
-      t = queue_.front();
-      queue_.pop();
+        --popping_;
+      }
+      t = boost::move(queue_.front());
+      queue_.pop_front();
+      wake(*not_full_, waiting_, 1);
     }
     catch (const std::exception& ex) {
       std::cerr << "queue_t<T>::pop_front caught: " << ex.what() << std::endl;
@@ -137,6 +451,52 @@ namespace concurrent {
     return item;
   }
 
+  //############################################################################
+  /// Pop Batch
+  //############################################################################
+  template <typename T>
+  inline size_t queue_t<T>::pop_batch(std::vector<T>& items,
+                                      size_t max,
+                                      bool* drained) {
+
+    items.clear();
+    if (drained)
+      *drained = false;
+    try {
+
+      boost::unique_lock<boost::mutex> lock(*mutex_);
+
+      while (queue_.empty()) {
+        ++popping_;
+        cond_->wait(lock);
+        --popping_;
+      }
+      while (! queue_.empty() && items.size() < max) {
+        items.push_back(boost::move(queue_.front()));
+        queue_.pop_front();
+      }
+      wake(*not_full_, waiting_, items.size());
+      ////////
+      /// refused producers come back once there is room for a burst, not
+      /// for every item popped
+      ////////
+      if (refused_ && queue_.size() <= limit_ / 2) {
+        refused_ = false;
+        if (drained)
+          *drained = true;
+      }
+    }
+    catch (const std::exception& ex) {
+      std::cerr << "queue_t<T>::pop_batch caught: " << ex.what() << std::endl;
+      throw;
+    }
+    catch (...) {
+      std::cerr << "queue_t<T>::pop_batch caught unknown ex" << std::endl;
+      throw;
+    }
+    return items.size();
+  }
+
 }  /// namespace concurrent
 
 #endif  /// _WORK_QUEUE_HPP__
@@ -2,14 +2,131 @@
 #define __XMIT_ORDER_HPP__
 
 #include <iostream>
+#include <string.h>
+#include <boost/cstdint.hpp>
 #include <order.hpp>
 
 namespace transmission {
 
   //############################################################################
-  /// STRUCT: Transmission Order
+  /// Wire Protocol
+  ///
+  /// Every message starts with an 8 byte header: length (of the whole
+  /// message, header included, u16), type (u8), reserved (u8) and sequence
+  /// number (u32). Each side numbers the messages it sends 1, 2, 3, ... per
+  /// session; the server closes a session whose messages skip or repeat a
+  /// number. All integers are little endian whatever the host; stocks are
+  /// 8 bytes, NUL padded. No message is longer than max_size.
+  ///
+  /// The session opens with a login, which negotiates the version:
+  /// - login         client  16  version (u16, highest the client speaks),
+  ///                             reserved (u16), trader id (u32)
+  /// - login_ack     server  24  version (u16, agreed), flags (u16, see
+  ///                             flags_t), reserved (u32), session id (u64)
+  /// - login_reject  server  16  version (u16, highest the server speaks),
+  ///                             reason (u16, see reason_t), reserved (u32);
+  ///                             the server closes the connection
+  /// Then, from the client:
+  /// - new_order             28  stock (8), quantity (s32), price (s32),
+  ///                             side (u8, 0 = buy), reserved (3)
+  /// - cancel                16  order id (u64)
+  /// - amend                 20  order id (u64), quantity (s32)
+  /// And from the server, one message per execution report:
+  /// - ack, cancelled,       32  order id (u64), ref (u32), quantity (s32),
+  ///   amended, rejected         price (s32), balance (s32)
+  /// - fill                  32  as an ack, with the traded quantity and
+  ///                             price; the counterparty's order id is not
+  ///                             disclosed
+  /// ref is the client's sequence number of the message that entered the
+  /// reported order or request: the new order for an ack or a fill, the
+  /// rejected message for a reject. balance is what is left of the order
+  /// after the report; a fill with balance 0 completes it.
+  /// - throttled             32  as a reject; the server was too busy to
+  ///                             take the message named by ref, which may
+  ///                             be sent again
+  //############################################################################
+
+  /// protocol versions the server speaks
+  enum {
+    min_version = 1,
+    max_version = 1
+  };
+
+  /// sizes on the wire
+  enum {
+    header_size = 8,
+    max_size    = 32
+  };
+
+  //############################################################################
+  /// Little Endian Encoding
+  ///
+  /// Byte by byte, so alignment and host order don't matter; compilers
+  /// turn these into single moves on little endian hosts.
   //############################################################################
-  struct order_t {
+  inline void put16(char* p, boost::uint16_t v) {
+    p[0] = v; p[1] = v >> 8;
+  }
+
+  inline void put32(char* p, boost::uint32_t v) {
+    put16(p, v); put16(p + 2, v >> 16);
+  }
+
+  inline void put64(char* p, boost::uint64_t v) {
+    put32(p, v); put32(p + 4, v >> 32);
+  }
+
+  inline boost::uint16_t get16(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return u[0] | u[1] << 8;
+  }
+
+  inline boost::uint32_t get32(const char* p) {
+    return get16(p) | static_cast<boost::uint32_t>(get16(p + 2)) << 16;
+  }
+
+  inline boost::uint64_t get64(const char* p) {
+    return get32(p) | static_cast<boost::uint64_t>(get32(p + 4)) << 32;
+  }
+
+  //############################################################################
+  /// STRUCT: Message
+  ///
+  /// Decoded message of any type, in host order; type_ says which fields
+  /// are in use (see the wire protocol above). Built from an execution
+  /// report for the server's reports; encode() and decode() convert to and
+  /// from the wire.
+  //############################################################################
+  struct message_t {
+
+    /// Message Type
+    enum type_t {
+      login = 1,
+      login_ack,
+      login_reject,
+      new_order,
+      cancel,
+      amend,
+      ack,
+      fill,
+      cancelled,
+      amended,
+      rejected,
+      throttled
+    };
+
+    /// Login Flags (login_ack)
+    enum flags_t {
+      cancel_on_disconnect = 1   /// resting orders cancelled on disconnect
+    };
+
+    /// Login Reject Reasons
+    enum reason_t {
+      bad_version = 1,           /// no version both sides speak
+      duplicate_login,           /// trader id already logged in
+      session_limit              /// server has no session left, or no
+                                 /// order for its disconnect requests
+    };
 
     //##########################################################################
     /// Default Constructor
@@ -19,59 +136,226 @@ namespace transmission {
     /// @return        none
     /// @throws        none
     //##########################################################################
-    order_t() :
-      trader_id_(0),
-      quantity_(0),
-      balance_(0),
-      side_(0) {
-      ::memset(&stock_,  '\0', sizeof(stock_));
-      ::memset(&trader_, '\0', sizeof(trader_));
+    message_t() {
+      ::memset(this, 0, sizeof(*this));
     }
 
     //##########################################################################
-    /// Constructor (from order_ptr)
+    /// Constructor (from report_t)
+    ///
+    /// Report types map onto the server message types from ack on, in the
+    /// same order.
     ///
-    /// @param[in]     order  order pointer
-    /// @param[inout]         none
-    /// @return               none
-    /// @throws               none
+    /// @param[in]     report  execution report
+    /// @param[inout]          none
+    /// @return                none
+    /// @throws                none
     //##########################################################################
-    order_t(const trading::order_ptr& order) :
-      trader_id_(order->trader_id()),
-      quantity_(order->quantity()),
-      balance_(order->balance()),
-      side_(order->side()) {
-      strcpy(stock_, order->stock().c_str());
-      strcpy(trader_, order->trader().c_str());
+    explicit message_t(const trading::report_t& report) {
+      ::memset(this, 0, sizeof(*this));
+      type_ = ack + report.type_;
+      order_id_ = report.order_id_;
+      ref_ = report.order_->client_sequence();
+      quantity_ = report.quantity_;
+      balance_ = report.balance_;
+      price_ = report.price_;
     }
 
-    char stock_[8];
-    char trader_[64];
-    int  trader_id_;
-    int  quantity_;
-    int  balance_;
-    int  side_;
+    int              type_;        /// type_t
+    boost::uint32_t  sequence_;    /// sender's message sequence number
+    boost::uint64_t  order_id_;    /// server assigned order id
+    boost::uint64_t  session_id_;  /// (login_ack)
+    boost::uint32_t  ref_;         /// client sequence of the reported order
+    int              trader_id_;   /// (login)
+    int              quantity_;
+    int              balance_;
+    int              price_;       /// limit price or fill price in ticks
+    int              side_;        /// 0 = buy, 1 = sell
+    int              version_;     /// (login, login_ack, login_reject)
+    int              flags_;       /// flags_t (login_ack)
+    int              reason_;      /// reason_t (login_reject)
+    char             stock_[8];
   };
 
+  //############################################################################
+  /// Size
+  ///
+  /// @param[in]  type  message type
+  /// @return           size of the message on the wire, 0 if unknown
+  /// @throws           none
+  //############################################################################
+  inline size_t size(int type) {
+    static const size_t sizes[] = {
+      0, 16, 24, 16, 28, 16, 20, 32, 32, 32, 32, 32, 32
+    };
+    return type > 0 && type <= message_t::throttled ? sizes[type] : 0;
+  }
+
+  //############################################################################
+  /// Encode
+  ///
+  /// @param[in]   msg  message
+  /// @param[out]  buf  at least max_size bytes
+  /// @return           bytes written
+  /// @throws           none
+  //############################################################################
+  inline size_t encode(const message_t& msg, char* buf) {
+
+    size_t n = size(msg.type_);
+    ::memset(buf, 0, n);
+    put16(buf, n);
+    buf[2] = msg.type_;
+    put32(buf + 4, msg.sequence_);
+    char* p = buf + header_size;
+
+    switch (msg.type_) {
+    case message_t::login:
+      put16(p, msg.version_);
+      put32(p + 4, msg.trader_id_);
+      break;
+    case message_t::login_ack:
+      put16(p, msg.version_);
+      put16(p + 2, msg.flags_);
+      put64(p + 8, msg.session_id_);
+      break;
+    case message_t::login_reject:
+      put16(p, msg.version_);
+      put16(p + 2, msg.reason_);
+      break;
+    case message_t::new_order:
+      ::memcpy(p, msg.stock_, sizeof(msg.stock_));
+      put32(p + 8, msg.quantity_);
+      put32(p + 12, msg.price_);
+      p[16] = msg.side_;
+      break;
+    case message_t::cancel:
+      put64(p, msg.order_id_);
+      break;
+    case message_t::amend:
+      put64(p, msg.order_id_);
+      put32(p + 8, msg.quantity_);
+      break;
+    default:
+      put64(p, msg.order_id_);
+      put32(p + 8, msg.ref_);
+      put32(p + 12, msg.quantity_);
+      put32(p + 16, msg.price_);
+      put32(p + 20, msg.balance_);
+      break;
+    }
+    return n;
+  }
+
+  //############################################################################
+  /// Decode
+  ///
+  /// Decodes the message at the front of a receive buffer.
+  ///
+  /// @param[in]   buf   received bytes
+  /// @param[in]   have  number of bytes in buf
+  /// @param[out]  msg   message decoded
+  /// @return            bytes decoded, 0 if the message is incomplete, -1 if
+  ///                    the type is unknown or the length is wrong for it
+  /// @throws            none
+  //############################################################################
+  inline int decode(const char* buf, size_t have, message_t& msg) {
+
+    if (have < header_size)
+      return 0;
+    size_t n = get16(buf);
+    int type = static_cast<unsigned char>(buf[2]);
+    if (n != size(type))
+      return -1;
+    if (have < n)
+      return 0;
+
+    msg = message_t();
+    msg.type_ = type;
+    msg.sequence_ = get32(buf + 4);
+    const char* p = buf + header_size;
+
+    switch (type) {
+    case message_t::login:
+      msg.version_ = get16(p);
+      msg.trader_id_ = get32(p + 4);
+      break;
+    case message_t::login_ack:
+      msg.version_ = get16(p);
+      msg.flags_ = get16(p + 2);
+      msg.session_id_ = get64(p + 8);
+      break;
+    case message_t::login_reject:
+      msg.version_ = get16(p);
+      msg.reason_ = get16(p + 2);
+      break;
+    case message_t::new_order:
+      ::memcpy(msg.stock_, p, sizeof(msg.stock_));
+      msg.quantity_ = get32(p + 8);
+      msg.price_ = get32(p + 12);
+      msg.side_ = p[16];
+      break;
+    case message_t::cancel:
+      msg.order_id_ = get64(p);
+      break;
+    case message_t::amend:
+      msg.order_id_ = get64(p);
+      msg.quantity_ = get32(p + 8);
+      break;
+    default:
+      msg.order_id_ = get64(p);
+      msg.ref_ = get32(p + 8);
+      msg.quantity_ = get32(p + 12);
+      msg.price_ = get32(p + 16);
+      msg.balance_ = get32(p + 20);
+      break;
+    }
+    return n;
+  }
+
   //############################################################################
   /// Opeartor<<
   ///
-  /// @param[inout]  os    output stream
-  /// @param[in]    order  order pointer
-  /// @return              updated output stream
-  /// @throws              none
+  /// @param[inout]  os   output stream
+  /// @param[in]     msg  message
+  /// @return             updated output stream
+  /// @throws             none
   //############################################################################
-  std::ostream& operator<<(std::ostream& os, const order_t& order) {
-    os << order.stock_     << "  "
-       << order.trader_    << "  "
-       << order.trader_id_ << "  "
-       << order.quantity_  << "  "
-       << order.balance_  << "  "
-       << order.side_     << "("
-       << (order.side_ == 0 ? "Buy" : "Sell") << ")";
+  inline std::ostream& operator<<(std::ostream& os, const message_t& msg) {
+    static const char* types[] = {
+      "?", "Login", "LoginAck", "LoginReject", "New", "Cancel", "Amend",
+      "Ack", "Fill", "Cancelled", "Amended", "Rejected", "Throttled"
+    };
+    os << (size(msg.type_) ? types[msg.type_] : "?")
+       << "  #" << msg.sequence_;
+    switch (msg.type_) {
+    case message_t::login:
+      os << "  v" << msg.version_ << "  trader " << msg.trader_id_;
+      break;
+    case message_t::login_ack:
+      os << "  v" << msg.version_ << "  session " << msg.session_id_
+         << "  flags " << msg.flags_;
+      break;
+    case message_t::login_reject:
+      os << "  v" << msg.version_ << "  reason " << msg.reason_;
+      break;
+    case message_t::new_order:
+      os << "  " << std::string(msg.stock_, ::strnlen(msg.stock_, 8))
+         << "  " << msg.quantity_
+         << "  " << msg.side_ << "(" << (msg.side_ == 0 ? "Buy" : "Sell")
+         << ")  @" << msg.price_;
+      break;
+    case message_t::cancel:
+    case message_t::amend:
+      os << "  " << msg.order_id_ << "  " << msg.quantity_;
+      break;
+    default:
+      os << "  " << msg.order_id_ << "  ref " << msg.ref_ << "  "
+         << msg.quantity_ << "  " << msg.balance_ << "  @" << msg.price_;
+      break;
+    }
     return os;
   }
 
-}  /// namespace trading
+}  /// namespace transmission
 
 #endif